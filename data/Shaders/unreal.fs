@@ -10,6 +10,8 @@ in FragData {
     vec2 texCoords;
 } vsIn;
 
+flat in int materialIdx;
+
 /* ==============================================================================
         Structures
  ============================================================================== */
@@ -21,6 +23,13 @@ struct Light {
     bool   state;      // On/off flag
 };
 
+struct Material {
+    vec4  diffuse;     // Negative when sampled from diffuseTex
+    vec4  spec;
+    float metallic;    // Negative when sampled from metallicTex
+    float roughness;   // Negative when sampled from roughTex
+};
+
 /* ==============================================================================
         Uniforms
  ============================================================================== */
@@ -39,23 +48,23 @@ uniform cameraBlock {
     vec3 ViewPos;
 };
 
-const int NUM_LIGHTS = 4;
+const int NUM_LIGHTS    = 4;
+const int MAX_MATERIALS = 256;
 
 uniform lightBlock {
     Light lights[NUM_LIGHTS];
 };
 
+layout(std140) uniform materialBlock {
+    Material materials[MAX_MATERIALS];
+};
+
 // Material parameters
 uniform sampler2D diffuseTex;
 uniform sampler2D normalTex;
 uniform sampler2D metallicTex;
 uniform sampler2D roughTex;
 
-uniform vec3  diffuse;
-uniform float metallic;
-uniform float roughness;
-uniform vec3  spec;
-
 // IBL precomputation
 uniform samplerCube irradianceTex;
 uniform samplerCube ggxTex;
@@ -83,8 +92,10 @@ const float PI = 3.14159265358979;
 out vec4 outColor;
 
 vec3 perturbNormal(in sampler2D normalMap) {
-    // Fetch normal from map and adjust to linear space
-    vec3 normal = texture(normalMap, vsIn.texCoords).xyz * 2.0 - 1.0;
+    // Fetch normal from map and adjust to linear space, z is rebuilt since BC5 maps only store x and y
+    vec3 normal;
+    normal.xy = texture(normalMap, vsIn.texCoords).xy * 2.0 - 1.0;
+    normal.z  = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
 
     // Calculate uv derivatives
     vec2 duvdx = dFdx(vsIn.texCoords);
@@ -104,6 +115,11 @@ vec3 perturbNormal(in sampler2D normalMap) {
 
 const float MAX_GGX_LOD = 4.0;
 
+/* ==============================================================================
+        Material features
+ ============================================================================== */
+// The generic program checks the material at runtime, specialized programs are
+// compiled with SPECIALIZED and one HAS_* define per feature (see ShaderVariants)
 float fetchParameter(sampler2D samp, float val) {
     if (val >= 0.0)
         return val;
@@ -111,28 +127,65 @@ float fetchParameter(sampler2D samp, float val) {
         return texture(samp, vsIn.texCoords).r;
 }
 
-vec3 fetchDiffuse() {
+vec3 fetchDiffuse(vec3 diffuse) {
+#ifndef SPECIALIZED
     if (diffuse.r >= 0)
         return diffuse;
     else
         return toLinearRGB(texture(diffuseTex, vsIn.texCoords).rgb, gamma);
+#elif defined(HAS_DIFFUSE_TEX)
+    return toLinearRGB(texture(diffuseTex, vsIn.texCoords).rgb, gamma);
+#else
+    return diffuse;
+#endif
+}
+
+vec3 fetchNormal() {
+#if !defined(SPECIALIZED) || defined(HAS_NORMAL_MAP)
+    return perturbNormal(normalTex);
+#else
+    return normalize(vsIn.normal);
+#endif
+}
+
+float fetchMetallic(float metallic) {
+#ifndef SPECIALIZED
+    return fetchParameter(metallicTex, metallic);
+#elif defined(HAS_METALLIC_TEX)
+    return texture(metallicTex, vsIn.texCoords).r;
+#else
+    return metallic;
+#endif
+}
+
+float fetchRoughness(float roughness) {
+#ifndef SPECIALIZED
+    return fetchParameter(roughTex, roughness);
+#elif defined(HAS_ROUGH_TEX)
+    return texture(roughTex, vsIn.texCoords).r;
+#else
+    return roughness;
+#endif
 }
 
 void main(void) {
     vec3 V = normalize(ViewPos - vsIn.position);
-    vec3 N = perturbNormal(normalTex);
+    vec3 N = fetchNormal();
     vec3 R = reflect(-V, N); 
 
     float NdotV = max(dot(N, V), 0.0);
 
-    float rough = fetchParameter(roughTex, roughness);
-    float metal = fetchParameter(metallicTex, metallic);
+    Material mat = materials[materialIdx];
+    vec3 spec    = mat.spec.rgb;
+
+    float rough = fetchRoughness(mat.roughness);
+    float metal = fetchMetallic(mat.metallic);
 
     /* ==============================================================================
             Environment
     ============================================================================== */
     // Diffuse component
-    vec3 kd         = fetchDiffuse();
+    vec3 kd         = fetchDiffuse(mat.diffuse.rgb);
     vec3 irradiance = texture(irradianceTex, N).rgb;
     vec3 diffuse    = kd * irradiance; // Appendix, formula X
 
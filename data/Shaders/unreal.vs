@@ -11,8 +11,11 @@ layout(location = 3) in vec3 Tangent;
 /* ==============================================================================
         Uniforms
  ============================================================================== */
-uniform mat4 ModelMatrix;
-uniform mat3 NormalMatrix;
+layout(std140) uniform objectBlock {
+    mat4 ModelMatrix;
+    mat4 NormalMatrix;
+    int  MaterialIdx;
+};
 
 uniform cameraBlock {
     mat4 ViewMatrix;
@@ -31,11 +34,14 @@ out FragData {
     vec2 texCoords;
 } vsOut;
 
+flat out int materialIdx;
+
 void main(void) {
     // Everything in world coordinates
     vsOut.position  = vec3(ModelMatrix * vec4(Position, 1.0));   
-    vsOut.normal    = normalize(NormalMatrix * Normal);
+    vsOut.normal    = normalize(mat3(NormalMatrix) * Normal);
     vsOut.texCoords = TexCoords;
+    materialIdx     = MaterialIdx;
 
     // Return position in MVP coordinates
     gl_Position = ViewProjMatrix * vec4(vsOut.position, 1.0);
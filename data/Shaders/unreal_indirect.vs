@@ -0,0 +1,62 @@
+#version 430
+
+/* ==============================================================================
+        Stage Inputs
+ ============================================================================== */
+layout(location = 0) in vec3 Position;	
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec2 TexCoords;
+layout(location = 3) in vec3 Tangent;
+
+// Index of the draw inside the multi-draw call (DRAW_ID_ATTRIB in RenderInterface.h)
+layout(location = 12) in uint DrawIdx;
+
+/* ==============================================================================
+        Uniforms
+ ============================================================================== */
+uniform cameraBlock {
+    mat4 ViewMatrix;
+    mat4 ProjMatrix;
+    mat4 ViewProjMatrix;
+    vec3 ViewPos;
+};
+
+// Per-draw data (see TransformData and DrawData in Renderer.h)
+struct Transform {
+    mat4 ModelMatrix;
+    mat4 NormalMatrix;
+};
+
+layout(std430, binding = 0) readonly buffer transformBuffer {
+    Transform transforms[];
+};
+
+layout(std430, binding = 1) readonly buffer drawBuffer {
+    uvec2 draws[]; // x: transform index, y: material index
+};
+
+/* ==============================================================================
+        Stage Outputs
+============================================================================== */
+// Passes everything in world coordinates to the fragment shader
+out FragData {
+    vec3 position;
+    vec3 normal; 
+    vec2 texCoords;
+} vsOut;
+
+flat out int materialIdx;
+
+void main(void) {
+    uvec2 draw = draws[DrawIdx];
+    Transform transform = transforms[draw.x];
+
+    // Everything in world coordinates
+    vsOut.position  = vec3(transform.ModelMatrix * vec4(Position, 1.0));   
+    vsOut.normal    = normalize(mat3(transform.NormalMatrix) * Normal);
+    vsOut.texCoords = TexCoords;
+    materialIdx     = int(draw.y);
+
+    // Return position in MVP coordinates
+    gl_Position = ViewProjMatrix * vec4(vsOut.position, 1.0);
+}
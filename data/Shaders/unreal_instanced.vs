@@ -0,0 +1,47 @@
+#version 400
+
+/* ==============================================================================
+        Stage Inputs
+ ============================================================================== */
+layout(location = 0) in vec3 Position;	
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec2 TexCoords;
+layout(location = 3) in vec3 Tangent;
+
+// Per-instance attributes (see InstanceData in Renderer.h)
+layout(location = 4)  in mat4 ModelMatrix;   // Locations 4 to 7
+layout(location = 8)  in mat3 NormalMatrix;  // Locations 8 to 10
+layout(location = 11) in uint MaterialIdx;
+
+/* ==============================================================================
+        Uniforms
+ ============================================================================== */
+uniform cameraBlock {
+    mat4 ViewMatrix;
+    mat4 ProjMatrix;
+    mat4 ViewProjMatrix;
+    vec3 ViewPos;
+};
+
+/* ==============================================================================
+        Stage Outputs
+============================================================================== */
+// Passes everything in world coordinates to the fragment shader
+out FragData {
+    vec3 position;
+    vec3 normal; 
+    vec2 texCoords;
+} vsOut;
+
+flat out int materialIdx;
+
+void main(void) {
+    // Everything in world coordinates
+    vsOut.position  = vec3(ModelMatrix * vec4(Position, 1.0));   
+    vsOut.normal    = normalize(NormalMatrix * Normal);
+    vsOut.texCoords = TexCoords;
+    materialIdx     = int(MaterialIdx);
+
+    // Return position in MVP coordinates
+    gl_Position = ViewProjMatrix * vec4(vsOut.position, 1.0);
+}
@@ -0,0 +1,312 @@
+#include <Benchmark.h>
+
+#include <pugixml.hpp>
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace pbr;
+
+/* ===================================================================================
+        Camera path
+=====================================================================================*/
+bool CameraPath::load(const std::string& filePath) {
+    pugi::xml_document doc;
+    if (!doc.load_file(filePath.c_str()))
+        return false;
+
+    _keys.clear();
+
+    // <cameraPath><keyframe time="0" position="x y z" pitch="0" yaw="0"/>...</cameraPath>
+    for (pugi::xml_node node : doc.child("cameraPath").children("keyframe")) {
+        CameraKeyframe key;
+        key.time  = node.attribute("time").as_float();
+        key.pitch = node.attribute("pitch").as_float();
+        key.yaw   = node.attribute("yaw").as_float();
+
+        std::istringstream pos(node.attribute("position").as_string("0 0 0"));
+        pos >> key.position.x >> key.position.y >> key.position.z;
+
+        addKeyframe(key);
+    }
+
+    return !_keys.empty();
+}
+
+bool CameraPath::save(const std::string& filePath) const {
+    pugi::xml_document doc;
+    pugi::xml_node root = doc.append_child("cameraPath");
+
+    for (const CameraKeyframe& key : _keys) {
+        std::ostringstream pos;
+        pos << key.position.x << " " << key.position.y << " " << key.position.z;
+
+        pugi::xml_node node = root.append_child("keyframe");
+        node.append_attribute("time")     = key.time;
+        node.append_attribute("position") = pos.str().c_str();
+        node.append_attribute("pitch")    = key.pitch;
+        node.append_attribute("yaw")      = key.yaw;
+    }
+
+    return doc.save_file(filePath.c_str());
+}
+
+void CameraPath::addKeyframe(const CameraKeyframe& key) {
+    // Keep keyframes sorted by time
+    auto it = std::upper_bound(_keys.begin(), _keys.end(), key, [](const CameraKeyframe& a, const CameraKeyframe& b) {
+        return a.time < b.time;
+    });
+
+    _keys.insert(it, key);
+}
+
+void CameraPath::clear() {
+    _keys.clear();
+}
+
+bool CameraPath::empty() const {
+    return _keys.empty();
+}
+
+float CameraPath::duration() const {
+    if (_keys.empty())
+        return 0.0f;
+
+    return _keys.back().time - _keys.front().time;
+}
+
+CameraKeyframe CameraPath::sample(float time) const {
+    if (_keys.size() == 1)
+        return _keys.front();
+
+    float length = duration();
+    if (length > 0.0f)
+        time = _keys.front().time + fmodf(time, length);
+
+    // First keyframe after time, interpolate with the one before it
+    auto next = std::upper_bound(_keys.begin(), _keys.end(), time, [](float t, const CameraKeyframe& key) {
+        return t < key.time;
+    });
+
+    if (next == _keys.begin())
+        return _keys.front();
+    if (next == _keys.end())
+        return _keys.back();
+
+    const CameraKeyframe& a = *(next - 1);
+    const CameraKeyframe& b = *next;
+    float t = (time - a.time) / (b.time - a.time);
+
+    CameraKeyframe key;
+    key.time     = time;
+    key.position = a.position + (b.position - a.position) * t;
+    key.pitch    = lerp(t, a.pitch, b.pitch);
+
+    // Take the short way around, yaw is kept in [0, 2PI[
+    float dyaw = b.yaw - a.yaw;
+    if (dyaw > PI)
+        dyaw -= 2.0f * PI;
+    else if (dyaw < -PI)
+        dyaw += 2.0f * PI;
+    key.yaw = a.yaw + dyaw * t;
+
+    return key;
+}
+
+/* ===================================================================================
+        Results
+=====================================================================================*/
+BenchmarkResults::BenchmarkResults() : _processKB(0), _gpuUsedKB(-1) { }
+
+void BenchmarkResults::addFrame(const FrameSample& frame) {
+    _frames.push_back(frame);
+}
+
+void BenchmarkResults::setGpuTime(uint32 frame, float time) {
+    if (frame < _frames.size())
+        _frames[frame].gpuTime = time;
+}
+
+void BenchmarkResults::addPassTime(const std::string& pass, float time) {
+    _passTimes[pass].push_back(time);
+}
+
+void BenchmarkResults::setMemory(uint64 processKB, int64 gpuUsedKB) {
+    _processKB = processKB;
+    _gpuUsedKB = gpuUsedKB;
+}
+
+uint32 BenchmarkResults::numFrames() const {
+    return (uint32)_frames.size();
+}
+
+static Percentiles computePercentiles(vec<float>& values) {
+    Percentiles p;
+    memset(&p, 0, sizeof(Percentiles));
+
+    if (values.empty())
+        return p;
+
+    std::sort(values.begin(), values.end());
+
+    // Nearest rank
+    auto rank = [&values](float pct) {
+        size_t idx = (size_t)ceilf(pct * values.size());
+        return values[idx > 0 ? idx - 1 : 0];
+    };
+
+    double sum = 0.0;
+    for (float v : values)
+        sum += v;
+
+    p.mean = (float)(sum / values.size());
+    p.p50  = rank(0.50f);
+    p.p95  = rank(0.95f);
+    p.p99  = rank(0.99f);
+    p.max  = values.back();
+
+    return p;
+}
+
+Percentiles BenchmarkResults::cpuTimes() const {
+    vec<float> values;
+    for (const FrameSample& frame : _frames)
+        values.push_back(frame.cpuTime);
+
+    return computePercentiles(values);
+}
+
+Percentiles BenchmarkResults::gpuTimes() const {
+    vec<float> values;
+    for (const FrameSample& frame : _frames)
+        if (frame.gpuTime >= 0.0f)
+            values.push_back(frame.gpuTime);
+
+    return computePercentiles(values);
+}
+
+// Quoted JSON string, control characters escaped
+static std::string jsonString(const std::string& str) {
+    std::ostringstream out;
+    out << '"';
+
+    for (char c : str) {
+        switch (c) {
+        case '"':  out << "\\\""; break;
+        case '\\': out << "\\\\"; break;
+        case '\n': out << "\\n";  break;
+        case '\r': out << "\\r";  break;
+        case '\t': out << "\\t";  break;
+        default:
+            if ((unsigned char)c < 0x20)
+                out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+            else
+                out << c;
+        }
+    }
+
+    out << '"';
+    return out.str();
+}
+
+static void writePercentiles(std::ostream& out, const Percentiles& p) {
+    out << "{ \"mean\": " << p.mean << ", \"p50\": " << p.p50 << ", \"p95\": " << p.p95
+        << ", \"p99\": " << p.p99 << ", \"max\": " << p.max << " }";
+}
+
+bool BenchmarkResults::writeJson(const std::string& filePath, const BenchmarkSettings& settings,
+                                 int32 width, int32 height) const {
+    std::ofstream out(filePath);
+    if (!out)
+        return false;
+
+    out << std::fixed << std::setprecision(4);
+    out << "{" << std::endl;
+    out << "  \"cameraPath\": " << jsonString(settings.pathFile) << "," << std::endl;
+    out << "  \"width\": " << width << "," << std::endl;
+    out << "  \"height\": " << height << "," << std::endl;
+    out << "  \"frames\": " << _frames.size() << "," << std::endl;
+    out << "  \"warmupFrames\": " << settings.warmupFrames << "," << std::endl;
+
+    out << "  \"cpuMs\": ";
+    writePercentiles(out, cpuTimes());
+    out << "," << std::endl;
+
+    out << "  \"gpuMs\": ";
+    writePercentiles(out, gpuTimes());
+    out << "," << std::endl;
+
+    // GPU passes in name order
+    out << "  \"gpuPassMs\": {";
+    for (auto it = _passTimes.begin(); it != _passTimes.end(); ++it) {
+        vec<float> values = it->second;
+        out << (it != _passTimes.begin() ? "," : "") << std::endl << "    " << jsonString(it->first) << ": ";
+        writePercentiles(out, computePercentiles(values));
+    }
+    out << std::endl << "  }," << std::endl;
+
+    // RHI statistics, mean and max per frame
+    auto writeStat = [this, &out](const char* name, uint64 (*value)(const RHIFrameStats&), bool last) {
+        uint64 sum = 0, max = 0;
+        for (const FrameSample& frame : _frames) {
+            sum += value(frame.stats);
+            max  = std::max(max, value(frame.stats));
+        }
+
+        out << "    \"" << name << "\": { \"mean\": " << (_frames.empty() ? 0.0 : (double)sum / _frames.size())
+            << ", \"max\": " << max << " }" << (last ? "" : ",") << std::endl;
+    };
+
+    out << "  \"rhi\": {" << std::endl;
+    writeStat("drawCalls",       [](const RHIFrameStats& s) { return (uint64)s.drawCalls;       }, false);
+    writeStat("triangles",       [](const RHIFrameStats& s) { return (uint64)s.triangles;       }, false);
+    writeStat("programSwitches", [](const RHIFrameStats& s) { return (uint64)s.programSwitches; }, false);
+    writeStat("textureBinds",    [](const RHIFrameStats& s) { return (uint64)s.textureBinds;    }, false);
+    writeStat("uniformCalls",    [](const RHIFrameStats& s) { return (uint64)s.uniformCalls;    }, false);
+    writeStat("bytesUploaded",   [](const RHIFrameStats& s) { return (uint64)s.bytesUploaded;   }, false);
+    writeStat("mapCalls",        [](const RHIFrameStats& s) { return (uint64)s.mapCalls;        }, false);
+    writeStat("texturesCreated", [](const RHIFrameStats& s) { return (uint64)s.texturesCreated; }, false);
+    writeStat("texturesDeleted", [](const RHIFrameStats& s) { return (uint64)s.texturesDeleted; }, false);
+    writeStat("buffersCreated",  [](const RHIFrameStats& s) { return (uint64)s.buffersCreated;  }, false);
+    writeStat("buffersDeleted",  [](const RHIFrameStats& s) { return (uint64)s.buffersDeleted;  }, true);
+    out << "  }," << std::endl;
+
+    out << "  \"memory\": { \"processPeakKB\": " << _processKB << ", \"gpuUsedKB\": " << _gpuUsedKB << " }," << std::endl;
+
+    // Raw samples, [cpu ms, gpu ms, draw calls] per frame
+    out << "  \"samples\": [";
+    for (size_t f = 0; f < _frames.size(); ++f) {
+        out << (f > 0 ? ", " : "") << "[" << _frames[f].cpuTime << ", "
+            << _frames[f].gpuTime << ", " << _frames[f].stats.drawCalls << "]";
+    }
+    out << "]" << std::endl;
+    out << "}" << std::endl;
+
+    return true;
+}
+
+uint64 pbr::processMemoryKB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    return (uint64)usage.ru_maxrss;
+#endif
+}
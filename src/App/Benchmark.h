@@ -0,0 +1,93 @@
+#ifndef __PBR_BENCHMARK_H__
+#define __PBR_BENCHMARK_H__
+
+#include <PBR.h>
+#include <PBRMath.h>
+#include <RenderInterface.h>
+
+#include <map>
+
+using namespace pbr::math;
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    struct CameraKeyframe {
+        float time;
+        Vec3  position;
+        float pitch;
+        float yaw;
+    };
+
+    // Recorded camera motion, played back with linear interpolation between keyframes
+    class PBR_SHARED CameraPath {
+    public:
+        bool load(const std::string& filePath);
+        bool save(const std::string& filePath) const;
+
+        void addKeyframe(const CameraKeyframe& key);
+        void clear();
+
+        bool  empty()    const;
+        float duration() const;
+
+        // Time wraps around, so paths shorter than the benchmark loop
+        CameraKeyframe sample(float time) const;
+
+    private:
+        vec<CameraKeyframe> _keys;
+    };
+
+    struct BenchmarkSettings {
+        std::string pathFile;
+        std::string outFile;
+        uint32 numFrames;
+        uint32 warmupFrames;
+    };
+
+    struct FrameSample {
+        float cpuTime;      // ms from update until all GL commands were submitted
+        float gpuTime;      // ms, negative when the timer result of the frame never arrived
+        RHIFrameStats stats;
+    };
+
+    struct Percentiles {
+        float mean;
+        float p50;
+        float p95;
+        float p99;
+        float max;
+    };
+
+    class PBR_SHARED BenchmarkResults {
+    public:
+        BenchmarkResults();
+
+        void addFrame(const FrameSample& frame);
+        // Timer results arrive frames late, they are set on the frame they measured
+        void setGpuTime(uint32 frame, float time);
+        void addPassTime(const std::string& pass, float time);
+        void setMemory(uint64 processKB, int64 gpuUsedKB);
+
+        uint32 numFrames() const;
+        Percentiles cpuTimes() const;
+        Percentiles gpuTimes() const;
+
+        bool writeJson(const std::string& filePath, const BenchmarkSettings& settings,
+                       int32 width, int32 height) const;
+
+    private:
+        vec<FrameSample> _frames;
+        std::map<std::string, vec<float>> _passTimes;
+        uint64 _processKB;
+        int64  _gpuUsedKB;
+    };
+
+    // Peak resident memory of the process
+    PBR_SHARED uint64 processMemoryKB();
+
+}
+
+#endif
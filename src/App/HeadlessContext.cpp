@@ -0,0 +1,130 @@
+#include <HeadlessContext.h>
+
+#ifdef PBR_HEADLESS
+
+#include <EGL/eglext.h>
+
+#include <iostream>
+
+using namespace pbr;
+
+HeadlessContext::HeadlessContext() : _display(EGL_NO_DISPLAY), _context(EGL_NO_CONTEXT), 
+                                     _fbo(0), _colorRb(0), _depthRb(0) { }
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+bool HeadlessContext::create(int width, int height) {
+    // Prefer the surfaceless platform, it does not need a display server
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = 
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (getPlatformDisplay)
+        _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+
+    if (_display == EGL_NO_DISPLAY)
+        _display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, &major, &minor)) {
+        std::cerr << "ERROR: Could not initialize an EGL display." << std::endl;
+        return false;
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "ERROR: EGL display does not support desktop OpenGL." << std::endl;
+        return false;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint numConfigs;
+    if (!eglChooseConfig(_display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1) {
+        std::cerr << "ERROR: No suitable EGL config." << std::endl;
+        return false;
+    }
+
+    // Same context the windowed application asks GLUT for
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION,       4,
+        EGL_CONTEXT_MINOR_VERSION,       1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#if defined(PBR_GL_CHECKS) && defined(EGL_CONTEXT_OPENGL_DEBUG)
+        EGL_CONTEXT_OPENGL_DEBUG,        EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+
+    _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (_context == EGL_NO_CONTEXT) {
+        std::cerr << "ERROR: Could not create an OpenGL 4.1 core context." << std::endl;
+        return false;
+    }
+
+    // Needs EGL_KHR_surfaceless_context, rendering goes to our own framebuffer
+    if (!eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context)) {
+        std::cerr << "ERROR: Could not make the context current without a surface." << std::endl;
+        return false;
+    }
+
+    glewExperimental = GL_TRUE;
+    GLenum result = glewInit();
+    if (result != GLEW_OK) {
+        std::cerr << "ERROR glewInit: " << glewGetErrorString(result) << std::endl;
+        return false;
+    }
+    glGetError();
+
+    // Offscreen render target
+    glGenRenderbuffers(1, &_colorRb);
+    glBindRenderbuffer(GL_RENDERBUFFER, _colorRb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &_depthRb);
+    glBindRenderbuffer(GL_RENDERBUFFER, _depthRb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorRb);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, _depthRb);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR: Offscreen framebuffer is incomplete." << std::endl;
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+
+    return true;
+}
+
+void HeadlessContext::destroy() {
+    if (_context != EGL_NO_CONTEXT) {
+        glDeleteFramebuffers(1, &_fbo);
+        glDeleteRenderbuffers(1, &_colorRb);
+        glDeleteRenderbuffers(1, &_depthRb);
+        _fbo = _colorRb = _depthRb = 0;
+
+        eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(_display, _context);
+        _context = EGL_NO_CONTEXT;
+    }
+
+    if (_display != EGL_NO_DISPLAY) {
+        eglTerminate(_display);
+        _display = EGL_NO_DISPLAY;
+    }
+}
+
+GLuint HeadlessContext::framebuffer() const {
+    return _fbo;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __PBR_HEADLESSCONTEXT_H__
+#define __PBR_HEADLESSCONTEXT_H__
+
+// Offscreen OpenGL context for machines without a display
+// Only built with PBR_HEADLESS defined, links against libEGL
+// GLEW has to be built with GLEW_EGL to resolve entry points for EGL contexts
+#ifdef PBR_HEADLESS
+
+#include <EGL/egl.h>
+#include <GL/glew.h>
+
+#include <PBR.h>
+
+namespace pbr {
+
+    class HeadlessContext {
+    public:
+        HeadlessContext();
+        ~HeadlessContext();
+
+        // Creates a surfaceless core context and a framebuffer of the given size
+        // Set LIBGL_ALWAYS_SOFTWARE=1 to use Mesa's software rasterizer
+        bool create(int width, int height);
+        void destroy();
+
+        // Framebuffer every frame renders into
+        GLuint framebuffer() const;
+
+    private:
+        EGLDisplay _display;
+        EGLContext _context;
+
+        GLuint _fbo;
+        GLuint _colorRb;
+        GLuint _depthRb;
+    };
+
+}
+
+#endif
+
+#endif
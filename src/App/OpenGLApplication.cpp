@@ -1,22 +1,47 @@
+// Windowed application only, PBR_NULL_RHI builds run the CPU benchmark in main.cpp
+#ifndef PBR_NULL_RHI
+
 #include <OpenGLApplication.h>
+#include <HeadlessContext.h>
+#include <Benchmark.h>
+#include <RenderInterface.h>
+#include <Image.h>
+#include <Profiler.h>
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
 
 #include <iostream>
 #include <sstream>
+#include <iomanip>
+#include <chrono>
 
 using namespace pbr;
 
 OpenGLApplication::OpenGLApplication(const std::string& title, int width, int height)
-    : _title(title), _width(width), _height(height), _frameCount(0), _windowHandle(-1) { }
+    : _title(title), _width(width), _height(height), _frameCount(0), _windowHandle(-1), 
+      _headless(false), _context(nullptr), _benchmarking(false), 
+      _pipelined(false), _quit(false), _frameReady(false), _pendingStart(0.0), 
+      _latencyAccum(0.0), _latencyCount(0), _latency(0.0f) { }
+
+OpenGLApplication::~OpenGLApplication() {
+    stopUpdateThread();
+
+#ifdef PBR_HEADLESS
+    delete _context;
+#endif
+}
 
 void OpenGLApplication::init(int argc, char* argv[]) {
     // Setup glut
     glutInit(&argc, argv);
     glutInitContextVersion(4, 1);
     glutInitContextProfile(GLUT_CORE_PROFILE);
+#ifdef PBR_GL_CHECKS
+    glutInitContextFlags(GLUT_FORWARD_COMPATIBLE | GLUT_DEBUG);
+#else
     glutInitContextFlags(GLUT_FORWARD_COMPATIBLE);
+#endif
     glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE, GLUT_ACTION_GLUTMAINLOOP_RETURNS);
     glutInitWindowSize(_width, _height);
     glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA | GLUT_MULTISAMPLE);
@@ -36,6 +61,153 @@ void OpenGLApplication::init(int argc, char* argv[]) {
     }
     GLenum err_code = glGetError();
 
+    initGL();
+}
+
+#ifdef PBR_HEADLESS
+bool OpenGLApplication::initHeadless() {
+    _context = new HeadlessContext();
+    if (!_context->create(_width, _height))
+        return false;
+
+    _headless = true;
+    initGL();
+
+    return true;
+}
+
+void OpenGLApplication::runHeadless(int numFrames, const std::string& outPrefix) {
+    for (int f = 0; f < numFrames; ++f) {
+        // Fixed time step so runs are reproducible
+        update(FIXED_DELTA_TIME);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, _context->framebuffer());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        RHI.beginFrame();
+        drawScene();
+        RHI.endFrame();
+        glFinish();
+
+        std::ostringstream oss;
+        oss << outPrefix << std::setw(4) << std::setfill('0') << f << ".png";
+        saveFrame(oss.str());
+
+        std::cout << "[INFO] Rendered frame " << f + 1 << "/" << numFrames << std::endl;
+    }
+}
+#endif
+
+bool OpenGLApplication::headless() const {
+    return _headless;
+}
+
+bool OpenGLApplication::runBenchmark(const BenchmarkSettings& settings) {
+    CameraPath path;
+    if (!path.load(settings.pathFile)) {
+        std::cerr << "ERROR: Could not load camera path " << settings.pathFile << std::endl;
+        return false;
+    }
+
+    // Update and rendering run in lockstep so every run sees the same frames
+    _pipelined    = false;
+    _benchmarking = true;
+
+    BenchmarkResults results;
+    uint32 totalFrames = settings.warmupFrames + settings.numFrames;
+
+    // RHI frame index of the first measured frame, timer results are matched to samples with it
+    int64 firstFrame    = -1;
+    int64 lastGpuFrame  = RHI.gpuFrameIndex();
+    int64 lastPassFrame = RHI.gpuPassFrameIndex();
+
+    for (uint32 f = 0; f < totalFrames; ++f) {
+        setCameraKeyframe(path.sample(f * FIXED_DELTA_TIME));
+
+        if (f == settings.warmupFrames)
+            firstFrame = RHI.frameIndex();
+
+        double frameStart = currentTime();
+        update(FIXED_DELTA_TIME);
+
+#ifdef PBR_HEADLESS
+        if (_headless)
+            glBindFramebuffer(GL_FRAMEBUFFER, _context->framebuffer());
+#endif
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        RHI.beginFrame();
+        drawScene();
+        RHI.endFrame();
+
+        double frameEnd = currentTime();
+
+        if (_headless) {
+            glFlush();
+        } else {
+            glutSwapBuffers();
+            glutMainLoopEvent();
+        }
+
+        // Warm-up frames fill caches and the timer query pipeline
+        if (f >= settings.warmupFrames) {
+            FrameSample frame;
+            frame.cpuTime = (float)((frameEnd - frameStart) * 1000.0);
+            frame.gpuTime = -1.0f;
+            frame.stats   = RHI.frameStats();
+            results.addFrame(frame);
+        }
+
+        // Timer results read back this frame belong to earlier frames, the last few never arrive
+        if (RHI.gpuFrameIndex() != lastGpuFrame) {
+            lastGpuFrame = RHI.gpuFrameIndex();
+            if (firstFrame >= 0 && lastGpuFrame >= firstFrame)
+                results.setGpuTime((uint32)(lastGpuFrame - firstFrame), RHI.gpuFrameTime());
+        }
+
+        if (RHI.gpuPassFrameIndex() != lastPassFrame) {
+            lastPassFrame = RHI.gpuPassFrameIndex();
+            if (firstFrame >= 0 && lastPassFrame >= firstFrame)
+                for (const GPUPassTiming& pass : RHI.gpuPassTimings())
+                    results.addPassTime(pass.name, pass.time);
+        }
+    }
+
+    uint64 gpuUsedKB, gpuTotalKB;
+    bool hasGpuMemory = RHI.gpuMemoryInfo(gpuUsedKB, gpuTotalKB);
+    results.setMemory(processMemoryKB(), hasGpuMemory ? (int64)gpuUsedKB : -1);
+
+    _benchmarking = false;
+
+    Percentiles cpu = results.cpuTimes();
+    Percentiles gpu = results.gpuTimes();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "[INFO] Benchmark, " << results.numFrames() << " frames" << std::endl;
+    std::cout << "[INFO] CPU ms p50 " << cpu.p50 << ", p95 " << cpu.p95 << ", p99 " << cpu.p99 << std::endl;
+    std::cout << "[INFO] GPU ms p50 " << gpu.p50 << ", p95 " << gpu.p95 << ", p99 " << gpu.p99 << std::endl;
+
+    if (!results.writeJson(settings.outFile, settings, _width, _height)) {
+        std::cerr << "ERROR: Could not write benchmark results to " << settings.outFile << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool OpenGLApplication::benchmarking() const {
+    return _benchmarking;
+}
+
+void OpenGLApplication::saveFrame(const std::string& path) {
+    sref<Image> img = RHI.getImage(0, 0, _width, _height);
+    img->flipY();
+    if (!img->saveImage(path))
+        std::cerr << "ERROR: Could not save frame to " << path << std::endl;
+}
+
+void OpenGLApplication::setCameraKeyframe(const CameraKeyframe& key) {
+
+}
+
+void OpenGLApplication::initGL() {
     // Print system info
     const GLubyte *renderer = glGetString(GL_RENDERER);
     const GLubyte *vendor   = glGetString(GL_VENDOR);
@@ -62,8 +234,14 @@ void OpenGLApplication::init(int argc, char* argv[]) {
 }
 
 void OpenGLApplication::updateFPS() {
+    if (_latencyCount > 0)
+        _latency = (float)(_latencyAccum / _latencyCount * 1000.0);
+    _latencyAccum = 0.0;
+    _latencyCount = 0;
+
     std::ostringstream oss;
-    oss << _title << ": " << _frameCount << " FPS @ (" << _width << "x" << _height << ")";
+    oss << _title << ": " << _frameCount << " FPS, " << std::fixed << std::setprecision(1) << _latency << " ms latency";
+    oss << (_pipelined ? " (pipelined)" : "") << " @ (" << _width << "x" << _height << ")";
     std::string s = oss.str();
     glutSetWindow(_windowHandle);
     glutSetWindowTitle(s.c_str());
@@ -84,38 +262,155 @@ void OpenGLApplication::update(float dt) {
 
 }
 
+void OpenGLApplication::publishFrame() {
+
+}
+
+void OpenGLApplication::acquireFrame() {
+
+}
+
 void OpenGLApplication::render() {
-    int timeSinceStart = glutGet(GLUT_ELAPSED_TIME);
-    int deltaTime = timeSinceStart - _oldTimeSinceStart;
-    _oldTimeSinceStart = timeSinceStart;
+    PROFILE_ZONE("Frame");
 
-    float dt = (float)deltaTime / 1000.0f;
+    double frameStart;
 
-    // Limit the delta time to avoid large intervals
-    if (dt > 0.25f)
-        dt = 0.25f;
+    if (_pipelined) {
+        // Take the frame published by the update thread, it can start on the next one
+        std::unique_lock<std::mutex> lock(_frameMutex);
+        _frameCond.wait(lock, [this]() { return _frameReady || _quit; });
+        if (!_frameReady)
+            return;
 
-    // --------------------------------------
-    //   Update step
-    // --------------------------------------
-    update(dt);
+        acquireFrame();
+        frameStart  = _pendingStart;
+        _frameReady = false;
+
+        lock.unlock();
+        _frameCond.notify_all();
+    } else {
+        int timeSinceStart = glutGet(GLUT_ELAPSED_TIME);
+        int deltaTime = timeSinceStart - _oldTimeSinceStart;
+        _oldTimeSinceStart = timeSinceStart;
+
+        float dt = (float)deltaTime / 1000.0f;
+
+        // Limit the delta time to avoid large intervals
+        if (dt > 0.25f)
+            dt = 0.25f;
+
+        // --------------------------------------
+        //   Update step
+        // --------------------------------------
+        frameStart = currentTime();
+
+        PROFILE_ZONE("Update");
+        update(dt);
+    }
 
     // --------------------------------------
     //   Render step
     // --------------------------------------
     ++_frameCount;
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    RHI.beginFrame();
     drawScene();
+    RHI.endFrame();
     glutSwapBuffers();
 
-    _mouseDx = 0;
-    _mouseDy = 0;
+    _latencyAccum += currentTime() - frameStart;
+    ++_latencyCount;
+
+    if (!_pipelined) {
+        _mouseDx = 0;
+        _mouseDy = 0;
+    }
 }
 
-void OpenGLApplication::loop() const {
+void OpenGLApplication::updateLoop() {
+    CPUProfiler::get().setThreadName("Update");
+
+    double lastTime = currentTime();
+
+    while (!_quit) {
+        double frameStart = currentTime();
+
+        // Limit the delta time to avoid large intervals
+        float dt = (float)(frameStart - lastTime);
+        if (dt > 0.25f)
+            dt = 0.25f;
+        lastTime = frameStart;
+
+        // Update frame N + 1 while the render thread draws frame N
+        {
+            PROFILE_ZONE("Update");
+            std::lock_guard<std::mutex> lock(_stateMutex);
+            update(dt);
+
+            _mouseDx = 0;
+            _mouseDy = 0;
+        }
+
+        // Wait until the render thread took the previous frame
+        std::unique_lock<std::mutex> lock(_frameMutex);
+        _frameCond.wait(lock, [this]() { return !_frameReady || _quit; });
+        if (_quit)
+            break;
+
+        {
+            std::lock_guard<std::mutex> stateLock(_stateMutex);
+            publishFrame();
+        }
+
+        _pendingStart = frameStart;
+        _frameReady   = true;
+
+        lock.unlock();
+        _frameCond.notify_all();
+    }
+}
+
+void OpenGLApplication::loop() {
+    if (_pipelined)
+        _updateThread = std::thread(&OpenGLApplication::updateLoop, this);
+
     glutMainLoop();
 }
 
+void OpenGLApplication::stopUpdateThread() {
+    if (!_updateThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(_frameMutex);
+        _quit = true;
+    }
+    _frameCond.notify_all();
+
+    _updateThread.join();
+}
+
+void OpenGLApplication::setPipelined(bool state) {
+    _pipelined = state;
+}
+
+bool OpenGLApplication::pipelined() const {
+    return _pipelined;
+}
+
+std::mutex& OpenGLApplication::stateMutex() {
+    return _stateMutex;
+}
+
+float OpenGLApplication::frameLatency() const {
+    return _latency;
+}
+
+double OpenGLApplication::currentTime() const {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
 void OpenGLApplication::idle() const {
     glutPostRedisplay();
 }
@@ -203,4 +498,6 @@ void OpenGLApplication::setKeyUpCallback(void (*keyUp)(unsigned char, int, int))
 
 void OpenGLApplication::setMouseButtonCallback(void (*mouseBtn)(int button, int state, int x, int y)) {
     glutMouseFunc(mouseBtn);
-}
\ No newline at end of file
+}
+
+#endif
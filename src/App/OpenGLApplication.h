@@ -2,22 +2,57 @@
 #define __PBR_OGLAPP_H__
 
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 namespace pbr {
 
+    class HeadlessContext;
+    class CameraPath;
+    struct CameraKeyframe;
+    struct BenchmarkSettings;
+
     class OpenGLApplication {
     public:
         OpenGLApplication(const std::string& title, int width, int height);
+        virtual ~OpenGLApplication();
 
         void init(int argc, char* argv[]);
+
+#ifdef PBR_HEADLESS
+        // Offscreen mode, no window or GLUT, renders numFrames and writes each one to an image
+        bool initHeadless();
+        void runHeadless(int numFrames, const std::string& outPrefix);
+#endif
+        bool headless() const;
+
+        // Replays a camera path with a fixed time step and writes frame time statistics
+        // Runs instead of loop(), in the window or in the headless context
+        bool runBenchmark(const BenchmarkSettings& settings);
+        bool benchmarking() const;
+
         void setTitle(const std::string& title);
         void updateFPS();       
         void render();
-        void loop() const;
+        void loop();
         void refresh() const;
 
         void updateMouse(int x, int y);
 
+        // Pipelined mode runs update() on its own thread, one frame ahead of rendering
+        // Must be set before loop()
+        void setPipelined(bool state);
+        bool pipelined() const;
+        void stopUpdateThread();
+
+        // Guards state shared by the update thread, input callbacks and the GUI
+        std::mutex& stateMutex();
+
+        // Average time in ms from the start of a frame's update until its buffer swap
+        float frameLatency() const;
+
         void setCloseCallback(void (*close)());
         void setDisplayCallback(void (*display)());
         void setReshapeCallback(void (*reshape)(int, int));
@@ -40,8 +75,17 @@ namespace pbr {
         virtual void prepare()   = 0;
         virtual void drawScene() = 0;
         virtual void update(float dt);
+        // Reads back the current framebuffer and writes it to path
+        virtual void saveFrame(const std::string& path);
+        virtual void setCameraKeyframe(const CameraKeyframe& key);
 
     protected:
+        // Pipelined mode hooks
+        // publishFrame runs on the update thread after update(), it must copy everything drawScene reads
+        // acquireFrame runs on the render thread and makes the last published frame the current one
+        virtual void publishFrame();
+        virtual void acquireFrame();
+
         int _width;
         int _height;
 
@@ -69,6 +113,31 @@ namespace pbr {
         float _accumTime;
 
         const float FIXED_DELTA_TIME = 0.01f;
+
+        void initGL();
+        void updateLoop();
+        double currentTime() const;
+
+        bool _headless;
+        HeadlessContext* _context;
+
+        bool _benchmarking;
+
+        // Pipelined mode
+        bool _pipelined;
+        std::thread _updateThread;
+        std::atomic<bool> _quit;
+
+        std::mutex _stateMutex;
+        std::mutex _frameMutex;
+        std::condition_variable _frameCond;
+        bool   _frameReady;
+        double _pendingStart;
+
+        // Latency measurement
+        double _latencyAccum;
+        int    _latencyCount;
+        float  _latency;
     };
 
 }
@@ -1,3 +1,6 @@
+// Windowed application only, PBR_NULL_RHI builds run the CPU benchmark in main.cpp
+#ifndef PBR_NULL_RHI
+
 #include <PBRApp.h>
 
 #include <Resources.h>
@@ -19,9 +22,13 @@
 #include <GUI.h>
 
 #include <Utils.h>
+#include <Profiler.h>
 
 using namespace pbr;
 
+// Time between keyframes of recorded camera paths
+static const float CAMERA_KEY_INTERVAL = 0.1f;
+
 void initializeEngine() {
     // Initialize resource manager
     Resource.initialize();
@@ -31,11 +38,15 @@ void initializeEngine() {
 }
 
 PBRApp::PBRApp(const std::string& title, int width, int height) : OpenGLApplication(title, width, height), 
-                         _skyToggle(true), _selectedShape(nullptr), _showGUI(true), _skybox(1), _f0(0.04f) {
+                         _skyToggle(true), _instancing(true), _indirectDraws(false), _threadedRecording(false),
+                         _selectedShape(nullptr), _showGUI(true), _showStats(false), _skybox(1), _f0(0.04f),
+                         _recordingPath(false), _recordTime(0.0f), _nextKeyTime(0.0f) {
 
 }
 
 void PBRApp::prepare() {
+    PROFILE_ZONE("PBRApp::prepare");
+
     std::cout << std::endl;
     std::cout << "[INFO] Initializing renderer..." << std::endl;
 
@@ -106,10 +117,19 @@ void PBRApp::prepare() {
 }
 
 void PBRApp::drawScene() {
-    _renderer.render(_scene, *_camera);
+    if (pipelined()) {
+        _renderer.render(_scene, _currentFrame);
+    } else {
+        _renderer.setParams(rendererParams());
+        _renderer.render(_scene, *_camera);
+    }
 
-    if (_showGUI)
+    if (_showGUI && !headless() && !benchmarking()) {
+        // The GUI edits state read by the update thread
+        std::lock_guard<std::mutex> lock(stateMutex());
+        GPUPassScope pass("GUI");
         drawInterface();
+    }
 }
 
 void PBRApp::restoreToneDefaults() {
@@ -148,11 +168,36 @@ void PBRApp::update(float dt) {
         _camera->updateViewMatrix();
     }
 
-    // Update renderer parameters
-    _renderer.setExposure(_exposure);
-    _renderer.setGamma(_gamma);
-    _renderer.setToneParams(_toneParams);
-    _renderer.setSkyboxDraw(_skyToggle);
+    if (_recordingPath) {
+        if (_recordTime >= _nextKeyTime) {
+            _cameraPath.addKeyframe({ _recordTime, _camera->position(), _camera->pitch(), _camera->yaw() });
+            _nextKeyTime += CAMERA_KEY_INTERVAL;
+        }
+        _recordTime += dt;
+    }
+}
+
+RendererParams PBRApp::rendererParams() const {
+    RendererParams params;
+    params.gamma    = _gamma;
+    params.exposure = _exposure;
+    memcpy(params.toneParams, _toneParams, sizeof(float) * 7);
+
+    params.drawSkybox        = _skyToggle;
+    params.instancing        = _instancing;
+    params.indirect          = _indirectDraws;
+    params.threadedRecording = _threadedRecording;
+    params.viewHeight        = (float)_height;
+
+    return params;
+}
+
+void PBRApp::publishFrame() {
+    Renderer::captureFrame(_scene, *_camera, rendererParams(), _pendingFrame);
+}
+
+void PBRApp::acquireFrame() {
+    std::swap(_pendingFrame, _currentFrame);
 }
 
 void PBRApp::cleanup()  {
@@ -167,6 +212,12 @@ void PBRApp::processKeyPress(unsigned char key, int x, int y)  {
 
     if (key == 'p')
         takeSnapshot();
+
+    if (key == 'c')
+        toggleRecording();
+
+    if (key == 'i')
+        _showStats = !_showStats;
 }
 
 void PBRApp::processMouseClick(int button, int state, int x, int y) {
@@ -218,6 +269,23 @@ void PBRApp::drawInterface() {
         changeSkybox(_skybox);
     ImGui::End();
 
+    // Renderer window
+    ImGui::Begin("Renderer");
+    ImGui::Checkbox("Instancing", &_instancing);
+    ImGui::Checkbox("Threaded recording", &_threadedRecording);
+    if (RHI.supportsIndirectDraws())
+        ImGui::Checkbox("Multi-draw indirect", &_indirectDraws);
+    else
+        ImGui::TextWrapped("Multi-draw indirect needs OpenGL 4.3.");
+    ImGui::Checkbox("Show statistics", &_showStats);
+    ImGui::End();
+
+    // GPU timings window
+    ImGui_GPUProfiler();
+
+    if (_showStats)
+        ImGui_RHIStats();
+
     // Tone map window
     ImGui::Begin("Uncharted Tone Map");
 
@@ -279,6 +347,8 @@ void PBRApp::drawInterface() {
     ImGui::TextWrapped("Press right click and move the mouse to orient the camera. WASD for movement.");
     ImGui::TextWrapped("Press 'H' to toggle GUI visibility.");
     ImGui::TextWrapped("Press 'P' to take a snapshot! Do not forget to hide the GUI by pressing 'H' first, if desired.");
+    ImGui::TextWrapped("Press 'C' to start or stop recording a camera path for benchmarks.");
+    ImGui::TextWrapped("Press 'I' to toggle rendering statistics.");
     ImGui::TextWrapped("By clicking the middle mouse button, it is possible to pick objects and change some of their parameters.");
 
     ImGui::End();
@@ -291,7 +361,26 @@ void PBRApp::changeSkybox(int id) {
 }
 
 void PBRApp::takeSnapshot() {
-    sref<Image> img = RHI.getImage(0, 0, _width, _height);
-    img->flipY();
-    img->saveImage("snapshot.png");
-}
\ No newline at end of file
+    saveFrame("snapshot.png");
+}
+
+void PBRApp::toggleRecording() {
+    _recordingPath = !_recordingPath;
+
+    if (_recordingPath) {
+        _cameraPath.clear();
+        _recordTime  = 0.0f;
+        _nextKeyTime = 0.0f;
+        std::cout << "[INFO] Recording camera path..." << std::endl;
+    } else if (_cameraPath.save("camera_path.xml")) {
+        std::cout << "[INFO] Camera path saved to camera_path.xml" << std::endl;
+    }
+}
+
+void PBRApp::setCameraKeyframe(const CameraKeyframe& key) {
+    _camera->setPosition(key.position);
+    _camera->setPitchYaw(key.pitch, key.yaw);
+    _camera->updateViewMatrix();
+}
+
+#endif
@@ -2,6 +2,7 @@
 #define __PBR_PBRAPP_H__
 
 #include <OpenGLApplication.h>
+#include <Benchmark.h>
 
 #include <Scene.h>
 #include <Renderer.h>
@@ -20,19 +21,31 @@ namespace pbr {
         void drawScene() override;
         void update(float dt) override;
         void cleanup()   override;
+        void setCameraKeyframe(const CameraKeyframe& key) override;
 
         void processKeyPress(unsigned char key, int x, int y) override;
         void processMouseClick(int button, int state, int x, int y) override;
 
+    protected:
+        void publishFrame() override;
+        void acquireFrame() override;
+
     private:
+        RendererParams rendererParams() const;
+
         void drawInterface();
         void restoreToneDefaults();
         void changeSkybox(int id);
         void takeSnapshot();
+        void toggleRecording();
 
         Scene    _scene;
         Renderer _renderer;
 
+        // Pipelined mode, written by the update thread and drawn by the render thread
+        FrameSnapshot _pendingFrame;
+        FrameSnapshot _currentFrame;
+
         sref<Camera> _camera;
 
         float _rotAngleX;
@@ -49,12 +62,22 @@ namespace pbr {
         Color _diffuse;
 
         bool _showGUI;
+        bool _showStats;
         bool _skyToggle;
+        bool _instancing;
+        bool _indirectDraws;
+        bool _threadedRecording;
 
         Shape* _selectedShape;
 
         int _skybox;
         vec<Skybox> _skyboxes;
+
+        // Camera path recording for benchmarks
+        CameraPath _cameraPath;
+        bool  _recordingPath;
+        float _recordTime;
+        float _nextKeyTime;
     };
 
 }
@@ -90,6 +90,19 @@ void Camera::updateViewMatrix() {
     //_objToWorld = translation(-_position) * _orientation.toMatrix();
 }
 
+float Camera::pitch() const {
+    return _pitch;
+}
+
+float Camera::yaw() const {
+    return _yaw;
+}
+
+void Camera::setPitchYaw(float pitch, float yaw) {
+    _pitch = pitch;
+    _yaw   = yaw;
+}
+
 void Camera::updateOrientation(float dpdx, float dydx) {
 /*    _pitch += dpdx;
     _yaw   -= dydx;
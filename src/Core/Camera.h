@@ -37,6 +37,11 @@ namespace pbr {
 
         Mat4 viewProjMatrix() const;
 
+        float pitch() const;
+        float yaw()   const;
+
+        // Absolute orientation, the view matrix is rebuilt by updateViewMatrix
+        void setPitchYaw(float pitch, float yaw);
         void updateOrientation(float dp, float dy);
 
         void updateViewMatrix();
@@ -35,6 +35,14 @@ void Geometry::setRRID(RRID id) {
     _id = id;
 }
 
+RRID Geometry::arenaRRID() const {
+    return _arenaId;
+}
+
+void Geometry::setArenaRRID(RRID id) {
+    _arenaId = id;
+}
+
 void Geometry::addVertex(const Vertex& vertex) {
     _vertices.push_back(vertex);
 }
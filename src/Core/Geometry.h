@@ -20,11 +20,15 @@ namespace pbr {
 
     class PBR_SHARED Geometry {
     public:
-        Geometry() : _id(-1) { }
+        Geometry() : _id(-1), _arenaId(-1) { }
 
         RRID rrid() const;
         void setRRID(RRID id);
 
+        // Sub-allocation of the geometry in a shared geometry arena
+        RRID arenaRRID() const;
+        void setArenaRRID(RRID id);
+
         const std::vector<Vertex>& vertices() const;
         const std::vector<uint32>& indices()  const;
 
@@ -41,6 +45,7 @@ namespace pbr {
 
     private:
         RRID _id;
+        RRID _arenaId;
         std::vector<uint32> _indices;
         std::vector<Vertex> _vertices;
     };
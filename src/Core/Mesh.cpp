@@ -28,25 +28,26 @@ Mesh::Mesh(const std::string& objPath, const Mat4& objToWorld) {
     Resource.addGeometry(objFile.objName, _geometry);
 }
 
+Mesh::Mesh(const sref<Geometry>& geometry) {
+    _geometry = geometry;
+}
+
 void Mesh::prepare() {
     // Calculate bounding box
     _bbox = _geometry->bbox();
 
-    // Upload geometry to the GPU
-    RHI.uploadGeometry(_geometry);
+    // Upload geometry to the GPU, once for meshes sharing it
+    if (_geometry->rrid() == -1)
+        RHI.uploadGeometry(_geometry);
 }
 
 void Mesh::draw() {
-    updateMatrix();
-
     if (_prog == -1)
         _material->use();
     else
         RHI.useProgram(_prog);
 
-    RHI.setMatrix4("ModelMatrix",  objToWorld());
-    RHI.setMatrix3("NormalMatrix", normalMatrix());
-
+    // Per-draw matrices are bound by the renderer in the object block
     if (_material)
         _material->uploadData();
 
@@ -9,6 +9,7 @@ namespace pbr {
     public:
         Mesh(const std::string& objFile);
         Mesh(const std::string& objFile, const Mat4& objToWorld);
+        Mesh(const sref<Geometry>& geometry);
 
         void prepare() override;
         void draw()    override;
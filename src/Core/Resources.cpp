@@ -3,10 +3,19 @@
 #include <Geometry.h>
 #include <Shape.h>
 #include <Shader.h>
+#include <ShaderVariants.h>
+#include <Image.h>
+#include <RenderInterface.h>
+#include <TextureStreamer.h>
+
+#include <path.h>
+
+#include <cctype>
+#include <cstring>
 
 using namespace pbr;
 
-Resources::Resources() { }
+Resources::Resources() : _cacheStats() { }
 Resources::~Resources() { }
 
 Resources& Resources::get() {
@@ -34,6 +43,10 @@ void Resources::addTexture(const std::string& name, const sref<Texture>& texture
     _textures[name] = texture;
 }
 
+void Resources::addShaderVariants(const std::string& name, const sref<ShaderVariants>& variants) {
+    _shaderVariants[name] = variants;
+}
+
 bool Resources::deleteGeometry(const std::string& name) {
     auto it = _geometry.find(name);
     if (it != _geometry.end()) {
@@ -90,9 +103,120 @@ Texture* Resources::getTexture(const std::string& name) {
     return _textures.at(name).get();
 }
 
+ShaderVariants* Resources::getShaderVariants(const std::string& name) {
+    return _shaderVariants.at(name).get();
+}
+
+std::string Resources::textureKey(const std::string& path, const std::string& variant) {
+    filesystem::path file(path);
+
+    // Missing files keep their path, loading them fails anyway
+    std::string canonical = file.exists() ? file.make_absolute().str() : file.str();
+#if defined(PBR_WINDOWS)
+    std::transform(canonical.begin(), canonical.end(), canonical.begin(), ::tolower);
+#endif
+
+    return canonical + "|" + variant;
+}
+
+RRID Resources::acquireTexture(const std::string& key) {
+    auto it = _textureKeys.find(key);
+    if (it == _textureKeys.end())
+        return -1;
+
+    ++_cacheStats.hits;
+    ++_cachedTextures[it->second].refs;
+    return it->second;
+}
+
+RRID Resources::acquireTexture(uint64 contentHash, const std::string& key, const Image& image) {
+    auto it = _textureHashes.find(contentHash);
+    if (it == _textureHashes.end())
+        return -1;
+
+    // Different images with the same hash keep textures of their own
+    CachedTexture& cached = _cachedTextures[it->second];
+    const Image& other = *cached.image;
+    if (other.format() != image.format() || other.width() != image.width() || other.height() != image.height() ||
+        other.depth() != image.depth() || other.numLevels() != image.numLevels() ||
+        memcmp(other.data(), image.data(), image.totalSize()) != 0)
+        return -1;
+
+    ++_cacheStats.contentHits;
+    ++cached.refs;
+    if (_textureKeys.emplace(key, it->second).second)
+        cached.keys.push_back(key);
+
+    return it->second;
+}
+
+void Resources::addCachedTexture(const std::string& key, uint64 contentHash, RRID id, const sref<Image>& image) {
+    CachedTexture& cached = _cachedTextures[id];
+    cached.image       = image;
+    cached.contentHash = contentHash;
+    cached.refs        = 1;
+    cached.keys.push_back(key);
+
+    // On a hash collision the first texture keeps the hash
+    _textureKeys[key] = id;
+    _textureHashes.emplace(contentHash, id);
+
+    ++_cacheStats.misses;
+    ++_cacheStats.textures;
+    _cacheStats.imageBytes += image->totalSize();
+}
+
+bool Resources::releaseTexture(RRID id) {
+    auto it = _cachedTextures.find(id);
+    if (it == _cachedTextures.end())
+        return false; // Not cached
+
+    CachedTexture& cached = it->second;
+    if (--cached.refs > 0)
+        return true;
+
+    for (const std::string& key : cached.keys)
+        _textureKeys.erase(key);
+
+    auto hash = _textureHashes.find(cached.contentHash);
+    if (hash != _textureHashes.end() && hash->second == id)
+        _textureHashes.erase(hash);
+
+    --_cacheStats.textures;
+    _cacheStats.imageBytes -= cached.image->totalSize();
+
+    _cachedTextures.erase(it);
+
+    // Streamed textures stop streaming before their storage goes away
+    Streamer.removeTexture(id);
+    RHI.deleteTexture(id);
+
+    return true;
+}
+
+sref<Image> Resources::cachedImage(RRID id) const {
+    auto it = _cachedTextures.find(id);
+    if (it == _cachedTextures.end())
+        return nullptr;
+
+    return it->second.image;
+}
+
+TextureCacheStats Resources::textureCacheStats() const {
+    return _cacheStats;
+}
+
 void Resources::cleanup() {
     _geometry.clear();
     _shapes.clear();
     _shaders.clear();
     _textures.clear();
+    _shaderVariants.clear();
+
+    _cachedTextures.clear();
+    _textureKeys.clear();
+    _textureHashes.clear();
+
+    _cacheStats.textures   = 0;
+    _cacheStats.imageBytes = 0;
 }
\ No newline at end of file
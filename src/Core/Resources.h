@@ -14,11 +14,24 @@ namespace pbr {
     class Shape;
     class Geometry;
     class Shader;
+    class ShaderVariants;
     class Texture;
+    class Image;
+
+    template<class T>
+    using vec = std::vector<T>;
 
     template<class KT, class T> 
     using map = std::unordered_map<KT, T>;
 
+    struct TextureCacheStats {
+        uint32 hits;          // Found by key
+        uint32 contentHits;   // Another file with the same content
+        uint32 misses;        // Loaded from the file and uploaded
+        uint32 textures;
+        size_t imageBytes;    // System memory held by the cached images
+    };
+
     class Resources {
     public:
         ~Resources();
@@ -31,6 +44,7 @@ namespace pbr {
         void addShape   (const std::string& name, const sref<Shape>& shape);
         void addShader  (const std::string& name, const sref<Shader>& shader);
         void addTexture (const std::string& name, const sref<Texture>& texture);
+        void addShaderVariants(const std::string& name, const sref<ShaderVariants>& variants);
 
         bool deleteGeometry(const std::string& name);
         bool deleteShape   (const std::string& name);
@@ -41,6 +55,27 @@ namespace pbr {
         Shape*    getShape   (const std::string& name);
         Shader*   getShader  (const std::string& name);
         Texture*  getTexture (const std::string& name);
+        ShaderVariants* getShaderVariants(const std::string& name);
+
+        /* ===================================================================================
+                Texture cache
+        =====================================================================================*/
+        // Textures loaded from files, shared by every user of the same file or of the same content
+        // The key is the canonical path of the file and how it was prepared, the hash is taken on the prepared image
+        // Each acquire (and the add) takes a reference, the texture is deleted when the last one is released
+        static std::string textureKey(const std::string& path, const std::string& variant);
+
+        RRID acquireTexture(const std::string& key);
+        // Content lookup once the file is loaded, a hit also maps the key to the texture found
+        // The hash only finds a candidate, its image is compared with the loaded one before sharing it
+        RRID acquireTexture(uint64 contentHash, const std::string& key, const Image& image);
+        void addCachedTexture(const std::string& key, uint64 contentHash, RRID id, const sref<Image>& image);
+        bool releaseTexture(RRID id);
+
+        // Image the texture was created from, kept for readbacks and streaming
+        sref<Image> cachedImage(RRID id) const;
+
+        TextureCacheStats textureCacheStats() const;
 
         void cleanup();
 
@@ -53,6 +88,19 @@ namespace pbr {
         map<std::string, sref<Shape>>    _shapes;
         map<std::string, sref<Shader>>   _shaders;
         map<std::string, sref<Texture>>  _textures;
+        map<std::string, sref<ShaderVariants>> _shaderVariants;
+
+        struct CachedTexture {
+            sref<Image>      image;
+            uint64           contentHash;
+            uint32           refs;
+            vec<std::string> keys;
+        };
+
+        map<RRID, CachedTexture>    _cachedTextures;
+        map<std::string, RRID>      _textureKeys;
+        map<uint64, RRID>           _textureHashes;
+        TextureCacheStats           _cacheStats;
     };
 
 }
@@ -3,12 +3,56 @@
 #include <Resources.h>
 #include <RenderInterface.h>
 #include <Texture.h>
+#include <Profiler.h>
+#include <TextureStreamer.h>
+
+#include <iostream>
 
 using namespace pbr;
 
+// Creates the texture once the first level is ready, each level is uploaded while the next ones are decoded
+static RRID loadCubemap(const std::string& filePath, const TexSampler& sampler) {
+    Cubemap cube;
+    RRID tex = -1;
+
+    bool loaded = cube.mapCubemap(filePath, [&](CubemapFace face, uint32 lvl) {
+        if (tex == -1)
+            tex = RHI.createTexture(IMGTYPE_CUBE, cube.format(), cube.width(), cube.height(), 1,
+                                    sampler, cube.numLevels());
+
+        size_t size = cube.size(face, lvl);
+        StagingRegion region;
+        if (!RHI.allocStaging(size, region)) {
+            RHI.submitStaging();
+            if (!RHI.allocStaging(size, region)) {
+                RHI.setTextureData(tex, lvl, cube.data(face, lvl), face);
+                return;
+            }
+        }
+
+        memcpy(region.ptr, cube.data(face, lvl), size);
+        RHI.uploadTexture(tex, face, lvl, region, 0);
+    });
+
+    if (tex != -1) {
+        RHI.submitStaging();
+        if (loaded)
+            return tex;
+
+        // Files that fail part way drop the levels uploaded so far
+        RHI.deleteTexture(tex);
+    }
+
+    // Missing or broken files still get a texture
+    std::cerr << "[ERROR] Could not load cubemap " << filePath << std::endl;
+    return RHI.createCubemap(Cubemap(), sampler);
+}
+
 Skybox::Skybox(RRID cubeProg, RRID cubeTex) : _geoId(-1), _cubeProg(cubeProg), _cubeTex(cubeTex) { }
 
 Skybox::Skybox(const std::string& folder) {
+    PROFILE_ZONE("Skybox::load");
+
     _cubeProg = Resource.getShader("skybox")->id();
 
     // Load cubemap
@@ -16,23 +60,27 @@ Skybox::Skybox(const std::string& folder) {
     cubeSampler.setFilterMode(FILTER_LINEAR, FILTER_LINEAR);
     cubeSampler.setWrapMode(WRAP_CLAMP_EDGE, WRAP_CLAMP_EDGE, WRAP_CLAMP_EDGE);
 
-    Cubemap cube;
-    cube.loadCubemap(folder + "/cube.cube");
-    _cubeTex = RHI.createCubemap(cube, cubeSampler);
+    // Only the background is streamed, levels of the prefiltered maps stand for roughness
+    // Uploads read the levels straight from the mapped files, the streamed cube keeps its mapping
+    sref<Cubemap> cube = make_sref<Cubemap>();
+    if (!cube->mapCubemap(folder + "/cube.cube")) {
+        std::cerr << "[ERROR] Could not load cubemap " << folder << "/cube.cube" << std::endl;
+        _cubeTex = RHI.createCubemap(Cubemap(), cubeSampler);
+    } else if (TextureStreamer::streamable(*cube)) {
+        _cubeTex = Streamer.addCubemap(cube, cubeSampler);
+    } else {
+        _cubeTex = RHI.createCubemap(*cube, cubeSampler);
+    }
     Resource.addTexture("sky-" + folder, RHI.getTexture(_cubeTex));
 
-    Cubemap irradianceCube;
-    irradianceCube.loadCubemap(folder + "/irradiance.cube");
-    _irradianceTex = RHI.createCubemap(irradianceCube, cubeSampler);
+    _irradianceTex = loadCubemap(folder + "/irradiance.cube", cubeSampler);
     Resource.addTexture("irradiance-" + folder, RHI.getTexture(_irradianceTex));
 
     TexSampler ggxSampler;
     ggxSampler.setFilterMode(FILTER_LINEAR_MIP_LINEAR, FILTER_LINEAR);
     ggxSampler.setWrapMode(WRAP_CLAMP_EDGE, WRAP_CLAMP_EDGE, WRAP_CLAMP_EDGE);
 
-    Cubemap ggxCube;
-    ggxCube.loadCubemap(folder + "/ggx.cube");
-    _ggxTex = RHI.createCubemap(ggxCube, ggxSampler);
+    _ggxTex = loadCubemap(folder + "/ggx.cube", ggxSampler);
     Resource.addTexture("ggx-" + folder, RHI.getTexture(_ggxTex));
 }
 
@@ -45,8 +93,7 @@ void Skybox::initialize() {
 void Skybox::draw() const {
     RHI.useProgram(_cubeProg);
 
-    glActiveTexture(GL_TEXTURE5);
-    RHI.bindTexture(_cubeTex);
+    RHI.bindTexture(5, _cubeTex);
 
     RHI.drawGeometry(_geoId);
     RHI.useProgram(0);
@@ -1,7 +1,16 @@
+// Windowed application only, PBR_NULL_RHI builds run the CPU benchmark in main.cpp
+#ifndef PBR_NULL_RHI
+
 #include <GUI.h>
 
 #include <GL/glew.h>
 
+#include <RenderInterface.h>
+#include <Resources.h>
+
+#include <map>
+#include <string>
+
 using namespace ImGui;
 
 GLint g_ShaderHandle;
@@ -235,6 +244,79 @@ void pbr::ImGui_NewFrame(int mouseX, int mouseY, bool mouseBtns[3]) {
     ImGui::NewFrame();
 }
 
+// Number of frames kept by the profiler plots
+static const int PROFILER_HISTORY = 120;
+
+struct ProfilerHistory {
+    float values[PROFILER_HISTORY];
+    int   offset;
+
+    ProfilerHistory() : offset(0) { memset(values, 0, sizeof(values)); }
+
+    void add(float value) {
+        values[offset] = value;
+        offset = (offset + 1) % PROFILER_HISTORY;
+    }
+
+    float average() const {
+        float sum = 0.0f;
+        for (int i = 0; i < PROFILER_HISTORY; ++i)
+            sum += values[i];
+        return sum / PROFILER_HISTORY;
+    }
+};
+
+void pbr::ImGui_GPUProfiler() {
+    static ProfilerHistory frame;
+    static std::map<std::string, ProfilerHistory> passes;
+
+    const RenderInterface& rhi = RenderInterface::get();
+    if (rhi.gpuFrameTime() >= 0.0f)
+        frame.add(rhi.gpuFrameTime());
+
+    for (const GPUPassTiming& pass : rhi.gpuPassTimings())
+        passes[pass.name].add(pass.time);
+
+    ImGui::Begin("GPU Profiler");
+
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "%.3f ms", frame.average());
+    ImGui::PlotLines("Frame", frame.values, PROFILER_HISTORY, frame.offset, overlay, FLOAT_MAXIMUM, FLOAT_MAXIMUM, ImVec2(0, 60));
+
+    ImGui::Separator();
+
+    for (const GPUPassTiming& pass : rhi.gpuPassTimings()) {
+        const ProfilerHistory& history = passes[pass.name];
+
+        snprintf(overlay, sizeof(overlay), "%.3f ms", history.average());
+        ImGui::PlotLines(pass.name, history.values, PROFILER_HISTORY, history.offset, overlay, FLOAT_MAXIMUM, FLOAT_MAXIMUM, ImVec2(0, 40));
+    }
+
+    ImGui::End();
+}
+
+void pbr::ImGui_RHIStats() {
+    const RHIFrameStats& stats = RenderInterface::get().frameStats();
+
+    ImGui::Begin("RHI Statistics");
+    ImGui::Text("Draw calls:        %u",    stats.drawCalls);
+    ImGui::Text("Triangles:         %llu",  (unsigned long long)stats.triangles);
+    ImGui::Text("Program switches:  %u",    stats.programSwitches);
+    ImGui::Text("Texture binds:     %u",    stats.textureBinds);
+    ImGui::Text("Uniform calls:     %u",    stats.uniformCalls);
+    ImGui::Text("Uploaded:          %.1f KB", stats.bytesUploaded / 1024.0f);
+    ImGui::Text("Map/unmap calls:   %u",    stats.mapCalls);
+    ImGui::Separator();
+    ImGui::Text("Textures created:  %u, deleted: %u", stats.texturesCreated, stats.texturesDeleted);
+    ImGui::Text("Buffers created:   %u, deleted: %u", stats.buffersCreated, stats.buffersDeleted);
+    ImGui::Separator();
+
+    TextureCacheStats cache = Resource.textureCacheStats();
+    ImGui::Text("Cached textures:   %u, %.1f MB", cache.textures, cache.imageBytes / (1024.0f * 1024.0f));
+    ImGui::Text("Cache hits:        %u, by content: %u, misses: %u", cache.hits, cache.contentHits, cache.misses);
+    ImGui::End();
+}
+
 struct ImVec3 { float x, y, z; ImVec3(float _x = 0.0f, float _y = 0.0f, float _z = 0.0f) { x = _x; y = _y; z = _z; } };
 
 void imgui_easy_theming(ImVec3 color_for_text, ImVec3 color_for_head, ImVec3 color_for_area, ImVec3 color_for_body, ImVec3 color_for_pops) {
@@ -301,4 +383,6 @@ void SetupImGuiStyle2() {
     static ImVec3 color_for_pops = ImVec3(33.f / 255.f, 46.f / 255.f, 60.f / 255.f);
     static ImVec3 color_for_slider_button = ImVec3(255.f / 255.f, 144.f / 255.f, 37.f / 255.f);
     imgui_easy_theming(color_for_text, color_for_head, color_for_area, color_for_body, color_for_pops);
-}
\ No newline at end of file
+}
+
+#endif
@@ -14,6 +14,12 @@ namespace pbr {
 
     void ImGui_Init(float width, float height);
     void ImGui_NewFrame(int mouseX, int mouseY, bool mouseBtns[3]);
+
+    // Window with rolling GPU timings of the frame and its passes
+    void ImGui_GPUProfiler();
+
+    // Window with the RHI statistics of the last frame
+    void ImGui_RHIStats();
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <CommandBuffer.h>
+
+#include <RenderInterface.h>
+
+using namespace pbr;
+
+CommandBuffer::CommandBuffer() { }
+
+void CommandBuffer::reset() {
+    _data.clear();
+}
+
+bool CommandBuffer::empty() const {
+    return _data.empty();
+}
+
+size_t CommandBuffer::size() const {
+    return _data.size();
+}
+
+const uint8* CommandBuffer::data() const {
+    return _data.data();
+}
+
+template<class T>
+T* CommandBuffer::push(CommandType type) {
+    size_t offset = _data.size();
+    size_t size   = alignSize(sizeof(T), 8);
+
+    _data.resize(offset + size);
+
+    T* cmd = (T*)&_data[offset];
+    cmd->header.type = type;
+    cmd->header.size = (uint32)size;
+
+    return cmd;
+}
+
+void CommandBuffer::useProgram(RRID id) {
+    CmdUseProgram* cmd = push<CmdUseProgram>(CMD_USE_PROGRAM);
+    cmd->program = id;
+}
+
+void CommandBuffer::bindRingRange(RRID ring, uint32 index, size_t offset, size_t size) {
+    CmdBindRingRange* cmd = push<CmdBindRingRange>(CMD_BIND_RING_RANGE);
+    cmd->ring   = ring;
+    cmd->index  = index;
+    cmd->offset = offset;
+    cmd->size   = size;
+}
+
+void CommandBuffer::bindBufferRange(RRID buffer, uint32 index, size_t offset, size_t size) {
+    CmdBindBufferRange* cmd = push<CmdBindBufferRange>(CMD_BIND_BUFFER_RANGE);
+    cmd->buffer = buffer;
+    cmd->index  = index;
+    cmd->offset = offset;
+    cmd->size   = size;
+}
+
+void CommandBuffer::bindTexture(uint32 slot, RRID id) {
+    CmdBindTexture* cmd = push<CmdBindTexture>(CMD_BIND_TEXTURE);
+    cmd->slot    = slot;
+    cmd->texture = id;
+}
+
+void CommandBuffer::bindMaterial(const Material* mat) {
+    CmdBindMaterial* cmd = push<CmdBindMaterial>(CMD_BIND_MATERIAL);
+    cmd->material = mat;
+}
+
+void CommandBuffer::drawGeometry(RRID id) {
+    CmdDrawGeometry* cmd = push<CmdDrawGeometry>(CMD_DRAW_GEOMETRY);
+    cmd->geometry     = id;
+    cmd->numInstances = 1;
+}
+
+void CommandBuffer::drawGeometryInstanced(RRID id, uint32 numInstances) {
+    CmdDrawGeometry* cmd = push<CmdDrawGeometry>(CMD_DRAW_INSTANCED);
+    cmd->geometry     = id;
+    cmd->numInstances = numInstances;
+}
+
+void CommandBuffer::setInstanceLayout(RRID vertArray, RRID buffer, size_t offset, const BufferLayout& layout) {
+    CmdInstanceLayout* cmd = push<CmdInstanceLayout>(CMD_INSTANCE_LAYOUT);
+    cmd->vertArray = vertArray;
+    cmd->buffer    = buffer;
+    cmd->offset    = offset;
+    cmd->layout    = &layout;
+}
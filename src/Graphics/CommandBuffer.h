@@ -0,0 +1,110 @@
+#ifndef __PBR_COMMANDBUFFER_H__
+#define __PBR_COMMANDBUFFER_H__
+
+#include <PBR.h>
+
+namespace pbr {
+
+    class Material;
+    struct BufferLayout;
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    enum CommandType : uint32 {
+        CMD_USE_PROGRAM       = 0,
+        CMD_BIND_RING_RANGE   = 1,
+        CMD_BIND_TEXTURE      = 2,
+        CMD_BIND_MATERIAL     = 3,
+        CMD_DRAW_GEOMETRY     = 4,
+        CMD_DRAW_INSTANCED    = 5,
+        CMD_INSTANCE_LAYOUT   = 6,
+        CMD_BIND_BUFFER_RANGE = 7
+    };
+
+    // Commands are plain data, written back to back in the buffer
+    // Every command starts with its header and is padded to 8 bytes
+    struct CommandHeader {
+        CommandType type;
+        uint32      size;
+    };
+
+    struct CmdUseProgram {
+        CommandHeader header;
+        RRID program;
+    };
+
+    struct CmdBindRingRange {
+        CommandHeader header;
+        RRID   ring;
+        uint32 index;
+        uint64 offset;
+        uint64 size;
+    };
+
+    struct CmdBindBufferRange {
+        CommandHeader header;
+        RRID   buffer;
+        uint32 index;
+        uint64 offset;
+        uint64 size;
+    };
+
+    struct CmdBindTexture {
+        CommandHeader header;
+        uint32 slot;
+        RRID   texture;
+    };
+
+    struct CmdBindMaterial {
+        CommandHeader header;
+        const Material* material;
+    };
+
+    struct CmdDrawGeometry {
+        CommandHeader header;
+        RRID   geometry;
+        uint32 numInstances;
+    };
+
+    // The layout is not copied, it must outlive the replay
+    struct CmdInstanceLayout {
+        CommandHeader header;
+        RRID   vertArray;
+        RRID   buffer;
+        uint64 offset;
+        const BufferLayout* layout;
+    };
+
+    // Linear list of RHI commands
+    // Recorded on any thread, replayed on the GL thread with RenderInterface::execute
+    class PBR_SHARED CommandBuffer {
+    public:
+        CommandBuffer();
+
+        // Clears the commands but keeps the memory for the next recording
+        void reset();
+
+        bool   empty() const;
+        size_t size()  const;
+        const uint8* data() const;
+
+        void useProgram(RRID id);
+        void bindRingRange(RRID ring, uint32 index, size_t offset, size_t size);
+        void bindBufferRange(RRID buffer, uint32 index, size_t offset, size_t size);
+        void bindTexture(uint32 slot, RRID id);
+        void bindMaterial(const Material* mat);
+        void drawGeometry(RRID id);
+        void drawGeometryInstanced(RRID id, uint32 numInstances);
+        void setInstanceLayout(RRID vertArray, RRID buffer, size_t offset, const BufferLayout& layout);
+
+    private:
+        template<class T>
+        T* push(CommandType type);
+
+        vec<uint8> _data;
+    };
+
+}
+
+#endif
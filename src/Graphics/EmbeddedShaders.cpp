@@ -0,0 +1,13 @@
+#include <EmbeddedShaders.h>
+
+using namespace pbr;
+
+#include <EmbeddedShaders.inl>
+
+const EmbeddedShader* pbr::findEmbeddedShader(const std::string& name) {
+    for (const EmbeddedShader& shader : EMBEDDED_SHADERS)
+        if (name == shader.name)
+            return &shader;
+
+    return nullptr;
+}
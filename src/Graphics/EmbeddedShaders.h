@@ -0,0 +1,21 @@
+#ifndef __PBR_EMBEDDEDSHADERS_H__
+#define __PBR_EMBEDDEDSHADERS_H__
+
+#include <PBR.h>
+
+namespace pbr {
+
+    // Shader sources compiled into the binary by tools/embed_shaders.py (pre-build step)
+    // Includes are resolved and comments stripped, hash is FNV-1a of the source
+    struct EmbeddedShader {
+        const char* name;
+        uint64      hash;
+        const char* source;
+    };
+
+    // Null when no shader of that file name was embedded
+    PBR_SHARED const EmbeddedShader* findEmbeddedShader(const std::string& name);
+
+}
+
+#endif
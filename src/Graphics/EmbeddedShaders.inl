@@ -0,0 +1,662 @@
+// Generated by tools/embed_shaders.py from data/Shaders, do not edit
+
+static PBR_CONSTEXPR EmbeddedShader EMBEDDED_SHADERS[] = {
+    { "common.fs", 0x4f43e585c6bbf706ULL,
+        R"PBR_SHADER(#version 400
+
+
+const float PI = 3.14159265358979;
+
+
+
+
+
+
+vec3 toLinearRGB(vec3 c, float gamma) {
+    return pow(c, vec3(gamma));
+}
+
+
+vec3 toInverseGamma(vec3 c, float gamma) {
+    return pow(c, vec3(1.0 / gamma));
+}
+
+vec3 simpleToneMap(vec3 c, float exp) {
+	vec3 color = exp * c;
+	return color / (color + vec3(1.0));
+}
+
+vec3 unchartedTonemap(vec3 c, float exp) {
+	float A = 0.15;
+	float B = 0.50;
+	float C = 0.10;
+	float D = 0.20;
+	float E = 0.02;
+	float F = 0.30;
+	float W = 11.2;
+
+	c = exp * c;
+	return ((c * (A * c + C * B) + D * E) / (c * (A * c + B) + D * F)) - E / F;
+}
+
+vec3 unchartedTonemap(vec3 v, float A, float B, float C, float D, float E, float J) {
+	return ((v * (A * v + C * B) + D * E) / (v * (A * v + B) + D * J)) - E / J;
+}
+
+vec3 unchartedTonemapParam(vec3 c, float exp, float A, float B, float C, float D, float E, float J, float W) {
+	vec3 scale = unchartedTonemap(vec3(W), A, B, C, D, E, J);
+	vec3 ret   = unchartedTonemap(exp * c, A, B, C, D, E, J);
+	return ret / scale;
+}
+
+
+float luminance(vec3 c) {
+    vec3 RGBtoY = vec3(0.2126, 0.7152, 0.0722);
+    return dot(c, RGBtoY);
+}
+
+
+float fresnelSchlick(float cosTheta){
+    float A = clamp(1.0 - cosTheta, 0, 1);
+    return pow(A, 5);
+}
+
+vec3 fresnelSchlickUnreal(float cosTheta, vec3 F0) {
+    return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
+
+
+
+
+
+
+float brdfLambert() {
+    return 1.0 / PI;
+}
+
+
+float brdfBurley(in float roughness, in float NdotV, in float NdotL, in float VdotH) {
+	float FD90 = 0.5 + 2 * VdotH * VdotH * roughness;
+    float FV = fresnelSchlick(NdotV);
+    float FL = fresnelSchlick(NdotL);
+    float FD = mix(1.0, FD90, FL) * mix(1.0, FD90, FV);
+
+	return (1.0 / PI) * FD;
+}
+
+
+
+float brdfOrenNayarTriAce() {
+	return 0.0f;
+}
+
+
+
+
+
+float specMicrofacet(in float HdotL, in float HdotR, in float D, in float G) {
+    if (HdotL == 0 || HdotR == 0)
+        return 0;
+
+    float F = fresnelSchlick(HdotL);
+    return (D * G * F) / (4.0 * HdotL * HdotR);
+}
+
+
+
+
+
+
+float distGGX(vec3 N, vec3 H, float roughness) {
+    float a  = roughness * roughness;
+    float a2 = a * a;
+
+    float NdotH  = max(dot(N, H), 0.0);
+    float NdotH2 = NdotH * NdotH;
+
+    float denom = (NdotH2 * (a2 - 1.0) + 1.0);
+    denom = PI * denom * denom;
+
+    return a2 / denom;
+}
+
+
+float distBeckmann(float NdotH, float roughness) {
+	float a  = roughness * roughness;
+	float a2 = a * a;
+
+	float NdotH2 = NdotH * NdotH;
+
+	return exp((NdotH2 - 1) / (a2 * NdotH2)) / (PI * a2 * NdotH2 * NdotH2);
+}
+
+
+float geoGGX(float NdotV, float roughness) {
+
+    float r = (roughness + 1.0) / 2.0;
+    float k = (r * r) / 2.0;
+
+    return NdotV / (NdotV * (1.0 - k) + k);
+}
+
+
+float geoGGX_IBL(float NdotV, float roughness) {
+    float a = roughness;
+    float k = (a * a) / 2.0;
+
+    return NdotV / (NdotV * (1.0 - k) + k);
+}
+
+float geoSmith(vec3 N, vec3 V, vec3 L, float roughness) {
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+
+    float GGX1 = geoGGX(NdotV, roughness);
+    float GGX2 = geoGGX(NdotL, roughness);
+
+    return GGX1 * GGX2;
+}
+
+
+
+
+
+
+
+float bssrdfHKIsotropic(float NdotL, float NdotV, float LdotH, float roughness) {
+    float FL = fresnelSchlick(NdotL);
+    float FV = fresnelSchlick(NdotV);
+
+    float Fss90 = LdotH * LdotH * roughness;
+    float Fss = mix(1.0, Fss90, FL) * mix(1.0, Fss90, FV);
+
+    return 1.25 * (Fss * (1 / (NdotL + NdotV) - .5) + .5);
+})PBR_SHADER" },
+    { "skybox.fs", 0x6faa3592f21fd053ULL,
+        R"PBR_SHADER(#version 400
+
+
+
+
+in vec3 worldPos;
+
+
+
+
+uniform rendererBlock {
+	float gamma;
+	float exposure;
+
+
+	float A, B, C, D, E, J, W;
+};
+
+uniform samplerCube envMap;
+
+
+
+
+vec3 simpleToneMap(vec3 c, float exp);
+vec3 unchartedTonemap(vec3 c, float exp);
+vec3 unchartedTonemapParam(vec3 c, float exp, float A, float B, float C, float D, float E, float J, float W);
+vec3 toInverseGamma(vec3 c, float gamma);
+
+
+
+
+out vec4 outColor;
+
+void main() {
+    vec3 envColor = textureLod(envMap, worldPos, 2.0).rgb;
+
+
+    envColor = unchartedTonemapParam(envColor, exposure, A, B, C, D, E, J, W);
+	envColor = toInverseGamma(envColor, gamma);
+
+    outColor = vec4(envColor, 1.0);
+}
+)PBR_SHADER" },
+    { "skybox.vs", 0xbb920adcc2a4e4afULL,
+        R"PBR_SHADER(#version 400 core
+
+
+
+
+layout(location = 0) in vec3 Position;
+
+
+
+
+uniform cameraBlock {
+	mat4 ViewMatrix;
+	mat4 ProjMatrix;
+	mat4 ViewProjMatrix;
+	vec3 ViewPos;
+};
+
+
+
+
+out vec3 worldPos;
+
+void main() {
+    worldPos = Position;
+
+	mat4 rotView = mat4(mat3(ViewMatrix));
+	vec4 clipPos = ProjMatrix * rotView * vec4(worldPos, 1.0);
+
+	gl_Position = clipPos.xyww;
+})PBR_SHADER" },
+    { "unreal.fs", 0x8e3909095ae49e59ULL,
+        R"PBR_SHADER(#version 400
+
+
+
+
+
+in FragData {
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+} vsIn;
+
+flat in int materialIdx;
+
+
+
+
+struct Light {
+    vec3   position;
+    float  auxA;
+    vec3   emission;
+    int    type;
+    bool   state;
+};
+
+struct Material {
+    vec4  diffuse;
+    vec4  spec;
+    float metallic;
+    float roughness;
+};
+
+
+
+
+uniform rendererBlock {
+    float gamma;
+    float exposure;
+
+
+    float A, B, C, D, E, J, W;
+};
+
+uniform cameraBlock {
+    mat4 ViewMatrix;
+    mat4 ProjMatrix;
+    mat4 ViewProjMatrix;
+    vec3 ViewPos;
+};
+
+const int NUM_LIGHTS    = 4;
+const int MAX_MATERIALS = 256;
+
+uniform lightBlock {
+    Light lights[NUM_LIGHTS];
+};
+
+layout(std140) uniform materialBlock {
+    Material materials[MAX_MATERIALS];
+};
+
+
+uniform sampler2D diffuseTex;
+uniform sampler2D normalTex;
+uniform sampler2D metallicTex;
+uniform sampler2D roughTex;
+
+
+uniform samplerCube irradianceTex;
+uniform samplerCube ggxTex;
+uniform sampler2D   brdfTex;
+
+
+
+
+vec3 toLinearRGB(vec3 c, float gamma);
+vec3 simpleToneMap(vec3 c, float exp);
+vec3 unchartedTonemap(vec3 c, float exp);
+vec3 unchartedTonemapParam(vec3 c, float exp, float A, float B, float C, float D, float E, float J, float W);
+vec3 toInverseGamma(vec3 c, float gamma);
+vec3 fresnelSchlickUnreal(float cosTheta, vec3 F0);
+
+float geoGGX(float NdotV, float roughness);
+float geoSmith(vec3 N, vec3 V, vec3 L, float roughness);
+float distGGX(vec3 N, vec3 H, float roughness);
+
+const float PI = 3.14159265358979;
+
+
+
+
+out vec4 outColor;
+
+vec3 perturbNormal(in sampler2D normalMap) {
+
+    vec3 normal;
+    normal.xy = texture(normalMap, vsIn.texCoords).xy * 2.0 - 1.0;
+    normal.z  = sqrt(max(0.0, 1.0 - dot(normal.xy, normal.xy)));
+
+
+    vec2 duvdx = dFdx(vsIn.texCoords);
+    vec2 duvdy = dFdy(vsIn.texCoords);
+
+
+    vec3 dpdx = dFdx(vsIn.position);
+    vec3 dpdy = dFdy(vsIn.position);
+
+
+    vec3 N =  normalize(vsIn.normal);
+    vec3 T =  normalize(dpdx * duvdy.t - dpdy * duvdx.t);
+    vec3 B = -normalize(cross(N, T));
+
+    return normalize(mat3(T, B, N) * normal);
+}
+
+const float MAX_GGX_LOD = 4.0;
+
+
+
+
+
+
+float fetchParameter(sampler2D samp, float val) {
+    if (val >= 0.0)
+        return val;
+    else
+        return texture(samp, vsIn.texCoords).r;
+}
+
+vec3 fetchDiffuse(vec3 diffuse) {
+#ifndef SPECIALIZED
+    if (diffuse.r >= 0)
+        return diffuse;
+    else
+        return toLinearRGB(texture(diffuseTex, vsIn.texCoords).rgb, gamma);
+#elif defined(HAS_DIFFUSE_TEX)
+    return toLinearRGB(texture(diffuseTex, vsIn.texCoords).rgb, gamma);
+#else
+    return diffuse;
+#endif
+}
+
+vec3 fetchNormal() {
+#if !defined(SPECIALIZED) || defined(HAS_NORMAL_MAP)
+    return perturbNormal(normalTex);
+#else
+    return normalize(vsIn.normal);
+#endif
+}
+
+float fetchMetallic(float metallic) {
+#ifndef SPECIALIZED
+    return fetchParameter(metallicTex, metallic);
+#elif defined(HAS_METALLIC_TEX)
+    return texture(metallicTex, vsIn.texCoords).r;
+#else
+    return metallic;
+#endif
+}
+
+float fetchRoughness(float roughness) {
+#ifndef SPECIALIZED
+    return fetchParameter(roughTex, roughness);
+#elif defined(HAS_ROUGH_TEX)
+    return texture(roughTex, vsIn.texCoords).r;
+#else
+    return roughness;
+#endif
+}
+
+void main(void) {
+    vec3 V = normalize(ViewPos - vsIn.position);
+    vec3 N = fetchNormal();
+    vec3 R = reflect(-V, N);
+
+    float NdotV = max(dot(N, V), 0.0);
+
+    Material mat = materials[materialIdx];
+    vec3 spec    = mat.spec.rgb;
+
+    float rough = fetchRoughness(mat.roughness);
+    float metal = fetchMetallic(mat.metallic);
+
+
+
+
+
+    vec3 kd         = fetchDiffuse(mat.diffuse.rgb);
+    vec3 irradiance = texture(irradianceTex, N).rgb;
+    vec3 diffuse    = kd * irradiance;
+
+
+    vec3 F0 = mix(spec, kd, metal);
+    vec3 F  = fresnelSchlickUnreal(NdotV, spec);
+
+
+    vec3 prefGGX = textureLod(ggxTex, R, rough * MAX_GGX_LOD).rgb;
+    vec3 brdf    = texture(brdfTex, vec2(NdotV, rough)).rgb;
+
+    vec3 brdfInt  = F0 * brdf.r + brdf.g;
+    vec3 specular = prefGGX * brdfInt;
+
+
+    vec3 retColor = (1.0 - F) * (1.0 - metal) * di)PBR_SHADER"
+        R"PBR_SHADER(ffuse + specular;
+
+
+
+
+    vec3 Lrad = vec3(0.0);
+    for(int i = 0; i < NUM_LIGHTS; ++i) {
+        if (!lights[i].state)
+            continue;
+
+        vec3 L = normalize(lights[i].position - vsIn.position);
+        vec3 H = normalize(V + L);
+
+        float HdotV = max(dot(H, V), 0.0);
+        float NdotL = max(dot(N, L), 0.0);
+
+        float dist = length(lights[i].position - vsIn.position);
+        vec3 Li    = lights[i].emission / (dist * dist);
+
+        float fGGX = distGGX(N, H, rough);
+        float Geo  = geoSmith(N, V, L, rough);
+        vec3  Fr   = fresnelSchlickUnreal(HdotV, F0);
+
+        vec3  nom     = fGGX * Geo * Fr;
+        float denom   = 4 * NdotV * NdotL + 0.0001;
+        vec3 contrib  = nom / denom;
+
+
+        Lrad += ((vec3(1.0) - Fr) * (1.0 - metal) * kd / PI + contrib) * Li * NdotL;
+    }
+
+
+    retColor = retColor + Lrad;
+
+
+
+
+
+    retColor = unchartedTonemapParam(retColor, exposure, A, B, C, D, E, J, W);
+    retColor = toInverseGamma(retColor, gamma);
+
+    outColor = vec4(retColor, 1.0);
+}
+)PBR_SHADER" },
+    { "unreal.vs", 0x8880122fc3862697ULL,
+        R"PBR_SHADER(#version 400
+
+
+
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec2 TexCoords;
+layout(location = 3) in vec3 Tangent;
+
+
+
+
+layout(std140) uniform objectBlock {
+    mat4 ModelMatrix;
+    mat4 NormalMatrix;
+    int  MaterialIdx;
+};
+
+uniform cameraBlock {
+    mat4 ViewMatrix;
+    mat4 ProjMatrix;
+    mat4 ViewProjMatrix;
+    vec3 ViewPos;
+};
+
+
+
+
+
+out FragData {
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+} vsOut;
+
+flat out int materialIdx;
+
+void main(void) {
+
+    vsOut.position  = vec3(ModelMatrix * vec4(Position, 1.0));
+    vsOut.normal    = normalize(mat3(NormalMatrix) * Normal);
+    vsOut.texCoords = TexCoords;
+    materialIdx     = MaterialIdx;
+
+
+    gl_Position = ViewProjMatrix * vec4(vsOut.position, 1.0);
+})PBR_SHADER" },
+    { "unreal_indirect.vs", 0x5463cad30042c256ULL,
+        R"PBR_SHADER(#version 430
+
+
+
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec2 TexCoords;
+layout(location = 3) in vec3 Tangent;
+
+
+layout(location = 12) in uint DrawIdx;
+
+
+
+
+uniform cameraBlock {
+    mat4 ViewMatrix;
+    mat4 ProjMatrix;
+    mat4 ViewProjMatrix;
+    vec3 ViewPos;
+};
+
+
+struct Transform {
+    mat4 ModelMatrix;
+    mat4 NormalMatrix;
+};
+
+layout(std430, binding = 0) readonly buffer transformBuffer {
+    Transform transforms[];
+};
+
+layout(std430, binding = 1) readonly buffer drawBuffer {
+    uvec2 draws[];
+};
+
+
+
+
+
+out FragData {
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+} vsOut;
+
+flat out int materialIdx;
+
+void main(void) {
+    uvec2 draw = draws[DrawIdx];
+    Transform transform = transforms[draw.x];
+
+
+    vsOut.position  = vec3(transform.ModelMatrix * vec4(Position, 1.0));
+    vsOut.normal    = normalize(mat3(transform.NormalMatrix) * Normal);
+    vsOut.texCoords = TexCoords;
+    materialIdx     = int(draw.y);
+
+
+    gl_Position = ViewProjMatrix * vec4(vsOut.position, 1.0);
+}
+)PBR_SHADER" },
+    { "unreal_instanced.vs", 0x095ba9af1bd05605ULL,
+        R"PBR_SHADER(#version 400
+
+
+
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec3 Normal;
+layout(location = 2) in vec2 TexCoords;
+layout(location = 3) in vec3 Tangent;
+
+
+layout(location = 4)  in mat4 ModelMatrix;
+layout(location = 8)  in mat3 NormalMatrix;
+layout(location = 11) in uint MaterialIdx;
+
+
+
+
+uniform cameraBlock {
+    mat4 ViewMatrix;
+    mat4 ProjMatrix;
+    mat4 ViewProjMatrix;
+    vec3 ViewPos;
+};
+
+
+
+
+
+out FragData {
+    vec3 position;
+    vec3 normal;
+    vec2 texCoords;
+} vsOut;
+
+flat out int materialIdx;
+
+void main(void) {
+
+    vsOut.position  = vec3(ModelMatrix * vec4(Position, 1.0));
+    vsOut.normal    = normalize(NormalMatrix * Normal);
+    vsOut.texCoords = TexCoords;
+    materialIdx     = int(MaterialIdx);
+
+
+    gl_Position = ViewProjMatrix * vec4(vsOut.position, 1.0);
+}
+)PBR_SHADER" },
+};
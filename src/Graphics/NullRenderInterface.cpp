@@ -0,0 +1,747 @@
+#include <RenderInterface.h>
+
+// Null backend, selected at compile time with PBR_NULL_RHI
+// Validates arguments, counts calls and hands out resource ids without touching GL,
+// so the CPU cost of the engine can be measured on machines without a GPU
+#ifdef PBR_NULL_RHI
+
+#include <Geometry.h>
+
+#include <Image.h>
+#include <Texture.h>
+#include <Resources.h>
+
+#include <Renderer.h>
+
+using namespace pbr;
+using namespace pbr::math;
+
+static NullRHICounters stats;
+
+// Counts the call, and the rejection when the condition does not hold
+static bool validate(bool cond, const char* call) {
+    ++stats.calls;
+    if (cond)
+        return true;
+
+    ++stats.invalidCalls;
+#ifdef _DEBUG
+    std::cerr << "[NullRHI] Invalid arguments to " << call << std::endl;
+#endif
+    return false;
+}
+
+template<class T>
+static bool validId(const ResourcePool<T>& res, RRID id) {
+    return res.valid(id);
+}
+
+RenderInterface::RenderInterface() : _currProgram(0), _currProgramId(0), _uniformAlign(256), _storageAlign(256),
+                                     _vertArrays(RES_VERTARRAY), _buffers(RES_BUFFER), _rings(RES_RINGBUFFER),
+                                     _arenas(RES_ARENA), _arenaGeometry(RES_ARENAGEOMETRY), _programs(RES_PROGRAM),
+                                     _textures(RES_TEXTURE), _frameQuery(0), _frameIndex(0), _gpuFrameTime(-1.0f),
+                                     _gpuFrameIndex(-1), _passDepth(0), _passFrameIndex(-1), _parallelCompile(false) {
+    memset(_frameQueries, 0, sizeof(_frameQueries));
+    memset(_frameQueryFrame, 0, sizeof(_frameQueryFrame));
+    memset(_frameQueryPending, 0, sizeof(_frameQueryPending));
+    memset(_passPools, 0, sizeof(_passPools));
+    memset(&_frameStats, 0, sizeof(RHIFrameStats));
+    memset(&_lastFrameStats, 0, sizeof(RHIFrameStats));
+
+    _staging.buffer     = 0;
+    _staging.ptr        = nullptr;
+    _staging.size       = 0;
+    _staging.head       = 0;
+    _staging.persistent = false;
+
+    resetCounters();
+}
+
+RenderInterface::~RenderInterface() {
+    _rings.forEach([](RHIRingBuffer& ring) {
+        delete[] ring.ptr;
+    });
+    delete[] _staging.ptr;
+}
+
+void RenderInterface::initialize() {
+    _currProgram   = 0;
+    _currProgramId = 0;
+
+    // Stand-in for the BRDF precomputation
+    TexSampler brdfSampler;
+    RRID brdfId = createTexture(IMGTYPE_2D, IMGFMT_RG16F, 1, 1, 1, brdfSampler);
+    Resource.addTexture("brdf", getTexture(brdfId));
+
+    // Sources are read but never compiled
+    loadShaderVariants();
+
+    sref<Shader> skyProg = make_sref<Shader>("skybox");
+    skyProg->link();
+    Resource.addShader("skybox", skyProg);
+}
+
+const NullRHICounters& RenderInterface::counters() const {
+    return stats;
+}
+
+void RenderInterface::resetCounters() {
+    memset(&stats, 0, sizeof(NullRHICounters));
+}
+
+/* ===================================================================================
+        Textures
+=====================================================================================*/
+RRID RenderInterface::createTexture(const Image& img, const TexSampler& sampler) {
+    validate(true, "createTexture");
+    ++stats.resources;
+    ++_frameStats.texturesCreated;
+
+    RRID resId = _textures.add();
+
+    TexFormat fmt;
+    fmt.imgFmt  = img.format();
+    fmt.imgType = img.type();
+    fmt.levels  = img.numLevels();
+    fmt.pType   = img.compType();
+
+    sref<Texture> tex = make_sref<GPUTexture>(resId, img.width(), img.height(), img.depth(), sampler, fmt);
+    _textures[resId] = { handleIndex(resId) + 1, 0, 0, 0, 0, tex };
+
+    return resId;
+}
+
+RRID RenderInterface::createTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height, uint32 depth,
+                                    const TexSampler& sampler, uint32 numLevels) {
+    if (!validate(width > 0 && height > 0 && depth > 0 && numLevels > 0, "createTexture"))
+        return -1;
+    ++stats.resources;
+    ++_frameStats.texturesCreated;
+
+    RRID resId = _textures.add();
+
+    TexFormat texFmt;
+    texFmt.imgFmt  = fmt;
+    texFmt.imgType = type;
+    texFmt.pType   = formatToImgComp(fmt);
+    texFmt.levels  = numLevels;
+
+    sref<Texture> tex = make_sref<GPUTexture>(resId, width, height, depth, sampler, texFmt);
+    _textures[resId] = { handleIndex(resId) + 1, 0, 0, 0, 0, tex };
+
+    return resId;
+}
+
+RRID RenderInterface::createCubemap(const Cubemap& cube, const TexSampler& sampler) {
+    validate(true, "createCubemap");
+    ++stats.resources;
+    ++_frameStats.texturesCreated;
+
+    RRID resId = _textures.add();
+
+    TexFormat fmt;
+    fmt.imgFmt  = cube.format();
+    fmt.imgType = IMGTYPE_CUBE;
+    fmt.levels  = cube.numLevels();
+    fmt.pType   = cube.compType();
+
+    sref<Texture> tex = make_sref<GPUTexture>(resId, cube.width(), cube.height(), 1, sampler, fmt);
+    _textures[resId] = { handleIndex(resId) + 1, 0, 0, 0, 0, tex };
+
+    return resId;
+}
+
+bool RenderInterface::supportsCompressedFormat(ImageFormat fmt) const {
+    return isCompressed(fmt);
+}
+
+bool RenderInterface::readTexture(RRID id, Image& img) {
+    validate(validId(_textures, id), "readTexture");
+    return false; // Nothing to read back
+}
+
+bool RenderInterface::readCubemap(RRID id, Cubemap& cube) {
+    validate(validId(_textures, id), "readCubemap");
+    return false; // Nothing to read back
+}
+
+void RenderInterface::generateMipmaps(RRID id) {
+    validate(validId(_textures, id), "generateMipmaps");
+}
+
+void RenderInterface::setTextureData(RRID id, uint32 level, const void* pixels, uint32 face) {
+    validate(validId(_textures, id) && pixels != nullptr && face < 6, "setTextureData");
+}
+
+void RenderInterface::uploadTexture(RRID id, uint32 face, uint32 level, const StagingRegion& region, size_t offset) {
+    if (validate(validId(_textures, id) && face < 6 && region.ptr != nullptr && offset < region.size, "uploadTexture"))
+        issueStaging(region);
+}
+
+// Uploads never wait for a GPU, staging memory is free again as soon as they are submitted
+void RenderInterface::submitStaging() {
+    validate(true, "submitStaging");
+
+    auto issued = [](const RHIStagingRange& range) { return range.issued; };
+    _staging.ranges.erase(std::remove_if(_staging.ranges.begin(), _staging.ranges.end(), issued), _staging.ranges.end());
+}
+
+RRID RenderInterface::createStreamedTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height,
+                                            const TexSampler& sampler, uint32 numLevels) {
+    if (!validate((type == IMGTYPE_2D || type == IMGTYPE_CUBE) && width > 0 && height > 0 && numLevels > 0, "createStreamedTexture"))
+        return -1;
+    ++stats.resources;
+    ++_frameStats.texturesCreated;
+
+    RRID resId = _textures.add();
+
+    TexFormat texFmt;
+    texFmt.imgFmt  = fmt;
+    texFmt.imgType = type;
+    texFmt.pType   = formatToImgComp(fmt);
+    texFmt.levels  = numLevels;
+
+    sref<Texture> tex = make_sref<GPUTexture>(resId, width, height, 1, sampler, texFmt);
+    _textures[resId] = { handleIndex(resId) + 1, 0, 0, 0, 0, tex };
+
+    return resId;
+}
+
+void RenderInterface::allocTextureLevel(RRID id, uint32 level) {
+    validate(validId(_textures, id) && level < _textures[id].tex->format().levels, "allocTextureLevel");
+}
+
+void RenderInterface::freeTextureLevel(RRID id, uint32 level) {
+    validate(validId(_textures, id) && level < _textures[id].tex->format().levels, "freeTextureLevel");
+}
+
+void RenderInterface::setBaseLevel(RRID id, uint32 level) {
+    validate(validId(_textures, id) && level < _textures[id].tex->format().levels, "setBaseLevel");
+}
+
+void RenderInterface::createStaging() {
+    _staging.size       = STAGING_BUFFER_SIZE;
+    _staging.head       = 0;
+    _staging.persistent = true;
+    _staging.ptr        = new uint8[_staging.size];
+}
+
+void RenderInterface::retireStaging(bool wait) {
+
+}
+
+bool RenderInterface::deleteTexture(RRID id) {
+    if (!validate(validId(_textures, id) && _textures[id].id != 0, "deleteTexture"))
+        return false;
+
+    ++_frameStats.texturesDeleted;
+    return _textures.remove(id);
+}
+
+void RenderInterface::bindTexture(RRID id) {
+    if (validate(validId(_textures, id) && _textures[id].id != 0, "bindTexture")) {
+        ++stats.textureBinds;
+        ++_frameStats.textureBinds;
+    }
+}
+
+void RenderInterface::bindTexture(uint32 slot, RRID id) {
+    if (validate(slot < 32 && validId(_textures, id) && _textures[id].id != 0, "bindTexture")) {
+        ++stats.textureBinds;
+        ++_frameStats.textureBinds;
+    }
+}
+
+sref<Image> RenderInterface::getImage(int32 x, int32 y, int32 w, int32 h) const {
+    sref<Image> img = make_sref<Image>();
+    img->init(IMGFMT_RGB8, w, h, 1, 1);
+    return img;
+}
+
+/* ===================================================================================
+        Shaders
+=====================================================================================*/
+uint32 RenderInterface::compileShader(const ShaderSource& source) {
+    if (!validate(!source.source().empty(), "compileShader"))
+        return 0;
+
+    static uint32 numShaders = 0;
+    return ++numShaders;
+}
+
+bool RenderInterface::deleteShader(const ShaderSource& source) {
+    return validate(source.id() != 0, "deleteShader");
+}
+
+RRID RenderInterface::linkProgram(const Shader& shader) {
+    return submitProgram(shader);
+}
+
+uint32 RenderInterface::submitShader(const ShaderSource& source) {
+    return compileShader(source);
+}
+
+RRID RenderInterface::submitProgram(const Shader& shader) {
+    validate(true, "submitProgram");
+    ++stats.resources;
+
+    // Linked right away, never pending
+    RRID resId = _programs.add();
+    _programs[resId].id     = handleIndex(resId) + 1;
+    _programs[resId].status = PROGRAM_READY;
+    _programs[resId].name   = shader.name();
+
+    return resId;
+}
+
+ProgramStatus RenderInterface::programStatus(RRID id, bool wait) {
+    if (!validate(validId(_programs, id), "programStatus"))
+        return PROGRAM_FAILED;
+
+    return _programs[id].status;
+}
+
+bool RenderInterface::deleteProgram(RRID id) {
+    if (!validate(validId(_programs, id), "deleteProgram"))
+        return false;
+
+    if (_currProgram == id)
+        useProgram(0);
+
+    return _programs.remove(id);
+}
+
+bool RenderInterface::supportsParallelCompile() const {
+    return true;
+}
+
+std::string RenderInterface::getShaderError(uint32 shader) {
+    return "";
+}
+
+std::string RenderInterface::getProgramError(uint32 program) {
+    return "";
+}
+
+void RenderInterface::useProgram(RRID id) {
+    // Handle 0 unbinds the current program
+    if (!validate(id == 0 || validId(_programs, id), "useProgram"))
+        return;
+
+    ++stats.programBinds;
+    if (id != _currProgram)
+        ++_frameStats.programSwitches;
+
+    _currProgram   = id;
+    _currProgramId = id != 0 ? _programs[id].id : 0;
+}
+
+void RenderInterface::setFloat(const std::string& name, float val) {
+    if (validate(!name.empty(), "setFloat")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setVector3(const std::string& name, const Vec3& vec) {
+    if (validate(!name.empty(), "setVector3")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setVector4(const std::string& name, const Vec4& vec) {
+    if (validate(!name.empty(), "setVector4")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setMatrix3(const std::string& name, const Mat3& mat) {
+    if (validate(!name.empty(), "setMatrix3")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setMatrix4(const std::string& name, const Mat4& mat) {
+    if (validate(!name.empty(), "setMatrix4")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setSampler(const std::string& name, uint32 id) {
+    if (validate(!name.empty() && id < 32, "setSampler")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setFloat(int32 loc, float val) {
+    if (validate(loc >= 0, "setFloat")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setVector3(int32 loc, const Vec3& vec) {
+    if (validate(loc >= 0, "setVector3")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setVector4(int32 loc, const Vec4& vec) {
+    if (validate(loc >= 0, "setVector4")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setMatrix3(int32 loc, const Mat3& mat) {
+    if (validate(loc >= 0, "setMatrix3")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setMatrix4(int32 loc, const Mat4& mat) {
+    if (validate(loc >= 0, "setMatrix4")) {
+        ++stats.uniformSets;
+        ++_frameStats.uniformCalls;
+    }
+}
+
+void RenderInterface::setBufferBlock(const std::string& name, uint32 binding) {
+    validate(!name.empty(), "setBufferBlock");
+}
+
+int32 RenderInterface::uniformLocation(RRID id, const std::string& name) {
+    validate(validId(_programs, id) && !name.empty(), "uniformLocation");
+    return 0;
+}
+
+uint32 RenderInterface::uniformBlockLocation(RRID id, const std::string& name) {
+    validate(validId(_programs, id) && !name.empty(), "uniformBlockLocation");
+    return 0;
+}
+
+/* ===================================================================================
+        Geometry
+=====================================================================================*/
+void RenderInterface::drawGeometry(RRID id) {
+    if (!validate(validId(_vertArrays, id) && _vertArrays[id].id != 0, "drawGeometry"))
+        return;
+
+    ++stats.draws;
+    ++_frameStats.drawCalls;
+    _frameStats.triangles += (_vertArrays[id].numIndices > 0 ? _vertArrays[id].numIndices : _vertArrays[id].numVertices) / 3;
+}
+
+void RenderInterface::drawGeometryInstanced(RRID id, uint32 numInstances) {
+    if (!validate(validId(_vertArrays, id) && _vertArrays[id].id != 0 && numInstances > 0, "drawGeometryInstanced"))
+        return;
+
+    ++stats.draws;
+    ++_frameStats.drawCalls;
+    _frameStats.triangles += (uint64)((_vertArrays[id].numIndices > 0 ? _vertArrays[id].numIndices : _vertArrays[id].numVertices) / 3) * numInstances;
+}
+
+RRID RenderInterface::uploadGeometry(const sref<Geometry>& geo) {
+    RRID resId = createVertexArray();
+
+    RHIVertArray& vertArray = _vertArrays[resId];
+    vertArray.numVertices = (GLsizei)geo->vertices().size();
+    vertArray.numIndices  = (GLsizei)geo->indices().size();
+
+    geo->setRRID(resId);
+
+    return resId;
+}
+
+/* ===================================================================================
+        Geometry arenas
+=====================================================================================*/
+RRID RenderInterface::createGeometryArena(uint32 maxVertices, uint32 maxIndices, uint32 maxDraws) {
+    validate(maxVertices > 0 && maxIndices > 0 && maxDraws > 0, "createGeometryArena");
+    ++stats.resources;
+
+    RHIGeometryArena arena;
+    arena.vertArray    = createVertexArray();
+    arena.vertexBuffer = createBuffer(BUFFER_VERTEX, STATIC, sizeof(Vertex) * maxVertices, nullptr);
+    arena.indexBuffer  = createBuffer(BUFFER_INDEX,  STATIC, sizeof(uint32) * maxIndices,  nullptr);
+    arena.drawIdBuffer = createBuffer(BUFFER_VERTEX, STATIC, sizeof(uint32) * maxDraws,    nullptr);
+    arena.maxVertices  = maxVertices;
+    arena.maxIndices   = maxIndices;
+    arena.numVertices  = 0;
+    arena.numIndices   = 0;
+
+    RRID resId = _arenas.add(arena);
+
+    return resId;
+}
+
+RRID RenderInterface::uploadGeometry(RRID id, const sref<Geometry>& geo) {
+    if (!validate(validId(_arenas, id), "uploadGeometry"))
+        return -1;
+
+    RHIGeometryArena& arena = _arenas[id];
+
+    size_t numVerts   = geo->vertices().size();
+    size_t numIndices = geo->indices().size() > 0 ? geo->indices().size() : numVerts;
+
+    if (arena.numVertices + numVerts > arena.maxVertices ||
+        arena.numIndices + numIndices > arena.maxIndices)
+        return -1; // Arena is full
+
+    RHIArenaGeometry sub;
+    sub.arena      = id;
+    sub.baseVertex = arena.numVertices;
+    sub.firstIndex = arena.numIndices;
+    sub.numIndices = (uint32)numIndices;
+
+    arena.numVertices += (uint32)numVerts;
+    arena.numIndices  += (uint32)numIndices;
+
+    RRID resId = _arenaGeometry.add(sub);
+
+    geo->setArenaRRID(resId);
+
+    return resId;
+}
+
+void RenderInterface::multiDrawIndirect(RRID arena, RRID ring, size_t offset, uint32 drawCount, uint64 numTriangles) {
+    if (!validate(validId(_arenas, arena) && validId(_rings, ring) && offset % 4 == 0, "multiDrawIndirect"))
+        return;
+
+    stats.draws += drawCount;
+    ++_frameStats.drawCalls;
+    _frameStats.triangles += numTriangles;
+}
+
+bool RenderInterface::supportsIndirectDraws() const {
+    return true;
+}
+
+/* ===================================================================================
+        Buffers
+=====================================================================================*/
+RRID RenderInterface::createVertexArray() {
+    validate(true, "createVertexArray");
+    ++stats.resources;
+
+    RRID resId = _vertArrays.add();
+
+    RHIVertArray& vertArray = _vertArrays[resId];
+    vertArray.id          = handleIndex(resId) + 1;
+    vertArray.numIndices  = 0;
+    vertArray.numVertices = 0;
+
+    return resId;
+}
+
+bool RenderInterface::deleteVertexArray(RRID id) {
+    if (!validate(validId(_vertArrays, id) && _vertArrays[id].id != 0, "deleteVertexArray"))
+        return false;
+
+    for (RRID buffer : _vertArrays[id].buffers)
+        deleteBuffer(buffer);
+
+    return _vertArrays.remove(id);
+}
+
+RRID RenderInterface::createBuffer(BufferType type, BufferUsage usage, size_t size, void* data) {
+    validate(size > 0, "createBuffer");
+    ++stats.resources;
+
+    ++_frameStats.buffersCreated;
+    if (data)
+        _frameStats.bytesUploaded += size;
+
+    RRID resId = _buffers.add();
+    _buffers[resId] = { handleIndex(resId) + 1, (GLenum)type };
+
+    return resId;
+}
+
+void RenderInterface::bindBufferBase(RRID id, uint32 index) {
+    if (validate(validId(_buffers, id) && _buffers[id].id != 0, "bindBufferBase"))
+        ++stats.bufferBinds;
+}
+
+void RenderInterface::bindBufferRange(RRID id, uint32 index, size_t offset, size_t size) {
+    if (validate(validId(_buffers, id) && size > 0 && offset % _uniformAlign == 0, "bindBufferRange"))
+        ++stats.bufferBinds;
+}
+
+void RenderInterface::setBufferLayout(RRID id, uint32 idx, AttribType type, uint32 numElems, uint32 stride, size_t offset) {
+    validate(validId(_buffers, id) && numElems > 0 && numElems <= 4, "setBufferLayout");
+}
+
+void RenderInterface::setBufferLayout(RRID id, const BufferLayout& layout) {
+    validate(validId(_buffers, id) && layout.entries != nullptr, "setBufferLayout");
+}
+
+void RenderInterface::setInstanceLayout(RRID vertArray, RRID id, size_t offset, const BufferLayout& layout) {
+    validate(validId(_vertArrays, vertArray) && validId(_buffers, id) && layout.entries != nullptr, "setInstanceLayout");
+}
+
+bool RenderInterface::updateBuffer(RRID id, size_t size, void* data) {
+    if (!validate(validId(_buffers, id) && _buffers[id].id != 0 && data != nullptr, "updateBuffer"))
+        return false;
+
+    ++stats.bufferUpdates;
+    _frameStats.bytesUploaded += size;
+    return true;
+}
+
+bool RenderInterface::updateBuffer(RRID id, size_t offset, size_t size, const void* data) {
+    if (!validate(validId(_buffers, id) && _buffers[id].id != 0 && data != nullptr, "updateBuffer"))
+        return false;
+
+    ++stats.bufferUpdates;
+    _frameStats.bytesUploaded += size;
+    return true;
+}
+
+bool RenderInterface::deleteBuffer(RRID id) {
+    if (!validate(validId(_buffers, id) && _buffers[id].id != 0, "deleteBuffer"))
+        return false;
+
+    ++_frameStats.buffersDeleted;
+    return _buffers.remove(id);
+}
+
+/* ===================================================================================
+        Ring buffers
+=====================================================================================*/
+RRID RenderInterface::createRingBuffer(BufferType type, size_t frameSize) {
+    validate(frameSize > 0, "createRingBuffer");
+
+    // Same layout as the GL backend, backed by plain memory so packing costs stay real
+    RHIRingBuffer ring;
+    ring.alignment  = (type == BUFFER_SHARED)  ? _uniformAlign :
+                      (type == BUFFER_STORAGE) ? _storageAlign : 16;
+    ring.frameSize  = alignSize(frameSize, ring.alignment);
+    ring.head       = 0;
+    ring.flushed    = 0;
+    ring.frame      = 0;
+    ring.persistent = true;
+    ring.ptr        = new uint8[ring.frameSize * NUM_RING_FRAMES];
+    ring.buffer     = createBuffer(type, STREAM, ring.frameSize * NUM_RING_FRAMES, nullptr);
+
+    for (uint32 f = 0; f < NUM_RING_FRAMES; ++f)
+        ring.fences[f] = 0;
+
+    RRID resId = _rings.add(ring);
+
+    return resId;
+}
+
+void RenderInterface::reserveRingBuffer(RRID id, size_t frameSize) {
+    if (!validate(validId(_rings, id), "reserveRingBuffer"))
+        return;
+
+    RHIRingBuffer& ring = _rings[id];
+    if (frameSize <= ring.frameSize)
+        return;
+
+    frameSize = std::max(frameSize, ring.frameSize + ring.frameSize / 2);
+
+    ring.frameSize = alignSize(frameSize, ring.alignment);
+    ring.head      = 0;
+    ring.flushed   = 0;
+    ring.frame     = 0;
+
+    delete[] ring.ptr;
+    ring.ptr = new uint8[ring.frameSize * NUM_RING_FRAMES];
+
+    BufferType type = (BufferType)_buffers[ring.buffer].target;
+    deleteBuffer(ring.buffer);
+    ring.buffer = createBuffer(type, STREAM, ring.frameSize * NUM_RING_FRAMES, nullptr);
+}
+
+void RenderInterface::beginRingFrame(RRID id) {
+    if (!validate(validId(_rings, id), "beginRingFrame"))
+        return;
+
+    _rings[id].head    = 0;
+    _rings[id].flushed = 0;
+}
+
+void RenderInterface::endRingFrame(RRID id) {
+    if (!validate(validId(_rings, id), "endRingFrame"))
+        return;
+
+    _rings[id].frame = (_rings[id].frame + 1) % NUM_RING_FRAMES;
+}
+
+void RenderInterface::bindRingRange(RRID id, uint32 index, size_t offset, size_t size) {
+    if (!validate(validId(_rings, id), "bindRingRange"))
+        return;
+
+    RHIRingBuffer& ring = _rings[id];
+    if (!validate(offset % ring.alignment == 0 && offset + size <= ring.frameSize * NUM_RING_FRAMES, "bindRingRange"))
+        return;
+
+    ++stats.bufferBinds;
+}
+
+void RenderInterface::flushRingBuffer(RHIRingBuffer& ring) {
+    ring.flushed = ring.head;
+}
+
+/* ===================================================================================
+        Frame timing
+=====================================================================================*/
+void RenderInterface::beginFrame() {
+    validate(true, "beginFrame");
+    _passDepth = 0;
+}
+
+void RenderInterface::endFrame() {
+    validate(true, "endFrame");
+
+    _lastFrameStats = _frameStats;
+    memset(&_frameStats, 0, sizeof(RHIFrameStats));
+
+    ++_frameIndex;
+}
+
+void RenderInterface::readFrameQueries() {
+
+}
+
+void RenderInterface::beginGPUPass(const char* name) {
+    if (validate(name != nullptr, "beginGPUPass"))
+        ++_passDepth;
+}
+
+void RenderInterface::endGPUPass() {
+    // Rejects a pass closed without being opened
+    if (validate(_passDepth > 0, "endGPUPass"))
+        --_passDepth;
+}
+
+void RenderInterface::readPassQueries() {
+
+}
+
+bool RenderInterface::gpuMemoryInfo(uint64& usedKB, uint64& totalKB) const {
+    return false;
+}
+
+bool RenderInterface::enableDebugOutput(DebugSeverity minSeverity) {
+    return false;
+}
+
+void RenderInterface::setDebugSeverity(DebugSeverity minSeverity) {
+
+}
+
+bool RenderInterface::checkOpenGLError(const char* call) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#include <ProgramCache.h>
+
+#include <Shader.h>
+
+#include <path.h>
+
+#include <fstream>
+#include <sstream>
+
+using namespace pbr;
+
+// Bump when the file layout or the key computation changes
+static PBR_CONSTEXPR uint32 CACHE_MAGIC   = 0x42524250; // "PBRB"
+static PBR_CONSTEXPR uint32 CACHE_VERSION = 2;
+
+struct CacheHeader {
+    uint32 magic;
+    uint32 version;
+    uint64 driverHash;
+    uint64 key;
+    uint32 format;
+    uint32 size;
+};
+
+// FNV-1a
+static uint64 hashBytes(uint64 hash, const void* data, size_t size) {
+    const uint8* bytes = (const uint8*)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static PBR_CONSTEXPR uint64 FNV_OFFSET = 14695981039346656037ULL;
+
+ProgramCache::ProgramCache() : _driverHash(0), _enabled(false) { }
+
+void ProgramCache::initialize(const std::string& folder, const std::string& driver) {
+    _folder     = folder;
+    _driverHash = hashBytes(FNV_OFFSET, driver.data(), driver.size());
+
+    filesystem::path path(folder);
+    _enabled = path.is_directory() || filesystem::create_directory(path);
+    if (!_enabled)
+        std::cerr << "[WARNING] Could not create the program cache folder " << folder << std::endl;
+}
+
+bool ProgramCache::enabled() const {
+    return _enabled;
+}
+
+uint64 ProgramCache::hashSources(const Shader& shader) {
+    uint64 hash = hashBytes(FNV_OFFSET, &CACHE_VERSION, sizeof(CACHE_VERSION));
+
+    // Source hashes of embedded shaders come from the build, no text is hashed here
+    for (const ShaderSource* source : shader.sources()) {
+        ShaderType type = source->type();
+        uint64 sourceHash = source->hash();
+        hash = hashBytes(hash, &type, sizeof(type));
+        hash = hashBytes(hash, &sourceHash, sizeof(sourceHash));
+    }
+
+    return hash;
+}
+
+std::string ProgramCache::filePath(uint64 key) const {
+    std::ostringstream name;
+    name << _folder << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+    return name.str();
+}
+
+bool ProgramCache::load(uint64 key, uint32& format, vec<uint8>& binary) const {
+    if (!_enabled)
+        return false;
+
+    std::ifstream file(filePath(key), std::ios_base::in | std::ios_base::binary);
+    if (!file)
+        return false; // Not cached yet
+
+    CacheHeader header;
+    if (!file.read((char*)&header, sizeof(CacheHeader)))
+        return false;
+
+    // Written by another version of the engine or another driver
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+        header.driverHash != _driverHash || header.key != key || header.size == 0)
+        return false;
+
+    binary.resize(header.size);
+    if (!file.read((char*)&binary[0], header.size))
+        return false; // Truncated
+
+    format = header.format;
+    return true;
+}
+
+bool ProgramCache::store(uint64 key, uint32 format, const vec<uint8>& binary) const {
+    if (!_enabled || binary.empty())
+        return false;
+
+    std::ofstream file(filePath(key), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!file)
+        return false;
+
+    CacheHeader header;
+    header.magic      = CACHE_MAGIC;
+    header.version    = CACHE_VERSION;
+    header.driverHash = _driverHash;
+    header.key        = key;
+    header.format     = format;
+    header.size       = (uint32)binary.size();
+
+    file.write((const char*)&header, sizeof(CacheHeader));
+    file.write((const char*)&binary[0], binary.size());
+
+    return (bool)file;
+}
@@ -0,0 +1,39 @@
+#ifndef __PBR_PROGRAMCACHE_H__
+#define __PBR_PROGRAMCACHE_H__
+
+#include <PBR.h>
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    class Shader;
+
+    // Linked program binaries kept on disk between runs, one file per program
+    // Entries are keyed by a hash of the shader sources and tagged with the driver that produced them,
+    // entries from another driver or corrupt files are rejected and the program is compiled again
+    class PBR_SHARED ProgramCache {
+    public:
+        ProgramCache();
+
+        // driver identifies the GL implementation (vendor, renderer, version)
+        void initialize(const std::string& folder, const std::string& driver);
+        bool enabled() const;
+
+        static uint64 hashSources(const Shader& shader);
+
+        bool load(uint64 key, uint32& format, vec<uint8>& binary) const;
+        bool store(uint64 key, uint32 format, const vec<uint8>& binary) const;
+
+    private:
+        std::string filePath(uint64 key) const;
+
+        std::string _folder;
+        uint64      _driverHash;
+        bool        _enabled;
+    };
+
+}
+
+#endif
@@ -10,10 +10,21 @@
 #include <Resources.h>
 
 #include <Renderer.h>
+#include <CommandBuffer.h>
+#include <Material.h>
+#include <Profiler.h>
+#include <ProgramCache.h>
+#include <ShaderVariants.h>
 
 using namespace pbr;
 using namespace pbr::math;
 
+// OpenGL backend, PBR_NULL_RHI builds use NullRenderInterface.cpp instead
+#ifndef PBR_NULL_RHI
+
+// Program binaries, relative to the data folder
+const std::string PROGRAM_CACHE_PATH = "ProgramCache/";
+
 const GLenum OGLShaderTypes[] = {
     GL_VERTEX_SHADER,
     GL_FRAGMENT_SHADER,
@@ -24,7 +35,9 @@ const GLenum OGLShaderTypes[] = {
 const GLenum OGLBufferTargets[] = {
     GL_ARRAY_BUFFER,
     GL_ELEMENT_ARRAY_BUFFER,
-    GL_UNIFORM_BUFFER
+    GL_UNIFORM_BUFFER,
+    GL_SHADER_STORAGE_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER
 };
 
 const GLenum OGLAttrTypes[] = {
@@ -127,12 +140,12 @@ const GLenum OGLTexSizedFormats[] = {
     GL_DEPTH_COMPONENT32,
 
     // Compressed IMGFMTs
-    0,
-    0,
-    0,
-    0,
-    0,
-    0
+    GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+    GL_COMPRESSED_RGBA_S3TC_DXT3_EXT,
+    GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+    GL_COMPRESSED_RED_RGTC1,
+    GL_COMPRESSED_RG_RGTC2,
+    GL_COMPRESSED_RGBA_BPTC_UNORM
 };
 
 const GLenum OGLTexPixelFormats[] = {
@@ -208,12 +221,12 @@ const GLenum OGLTexPixelFormats[] = {
     GL_DEPTH_COMPONENT,
 
     // Compressed IMGFMTs
-    0,
-    0,
-    0,
-    0,
-    0,
-    0
+    GL_RGB,
+    GL_RGBA,
+    GL_RGBA,
+    GL_RED,
+    GL_RG,
+    GL_RGBA
 };
 
 const GLenum OGLTexPixelTypes[] = {
@@ -254,56 +267,91 @@ const GLenum OGLTexWrapping[] = {
     GL_CLAMP_TO_BORDER
 };
 
-using namespace pbr;
+// Vertex attributes shared by every geometry
+static BufferLayoutEntry VertexLayoutEntries[] = { 
+    { 0, 3, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, position) },
+    { 1, 3, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, normal) },
+    { 2, 2, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, uv) },
+    { 3, 3, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, tangent) } 
+};
+
+static const BufferLayout VertexLayout = { 4, &VertexLayoutEntries[0] };
 
-RenderInterface::RenderInterface() {
+using namespace pbr;
 
+RenderInterface::RenderInterface() : _currProgram(0), _currProgramId(0), _uniformAlign(256), _storageAlign(256),
+                                     _vertArrays(RES_VERTARRAY), _buffers(RES_BUFFER), _rings(RES_RINGBUFFER),
+                                     _arenas(RES_ARENA), _arenaGeometry(RES_ARENAGEOMETRY), _programs(RES_PROGRAM),
+                                     _textures(RES_TEXTURE), _frameQuery(0), _frameIndex(0), _gpuFrameTime(-1.0f),
+                                     _gpuFrameIndex(-1), _passDepth(0), _passFrameIndex(-1), _parallelCompile(false) {
+    memset(_frameQueries, 0, sizeof(_frameQueries));
+    memset(_frameQueryFrame, 0, sizeof(_frameQueryFrame));
+    memset(_frameQueryPending, 0, sizeof(_frameQueryPending));
+    memset(_passPools, 0, sizeof(_passPools));
+    memset(&_frameStats, 0, sizeof(RHIFrameStats));
+    memset(&_lastFrameStats, 0, sizeof(RHIFrameStats));
+
+    _staging.buffer     = 0;
+    _staging.ptr        = nullptr;
+    _staging.size       = 0;
+    _staging.head       = 0;
+    _staging.persistent = false;
 }
 
 RenderInterface::~RenderInterface() {   
 
 }
 
-RenderInterface& RenderInterface::get() {
-    static RenderInterface _inst;
-    return _inst;
-}
-
 void RenderInterface::initialize() {
-    _programs.push_back({ 0 });
-    _currProgram = 0;
+    // Notifications are mostly driver chatter (buffer placement, ...)
+#ifdef PBR_GL_CHECKS
+    enableDebugOutput(DEBUG_LOW);
+#else
+    enableDebugOutput(DEBUG_MEDIUM);
+#endif
+
+    _currProgram   = 0;
+    _currProgramId = 0;
+
+    // Let the driver compile and link on its own threads, it picks the number of threads
+    _parallelCompile = GLEW_KHR_parallel_shader_compile == GL_TRUE || GLEW_ARB_parallel_shader_compile == GL_TRUE;
+    if (GLEW_KHR_parallel_shader_compile)
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    else if (GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    // Drivers without binary formats (some Mesa versions) always compile from source
+    GLint numBinaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numBinaryFormats);
+    if (numBinaryFormats > 0) {
+        std::string driver = std::string((const char*)glGetString(GL_VENDOR)) + "|" +
+                             (const char*)glGetString(GL_RENDERER) + "|" +
+                             (const char*)glGetString(GL_VERSION);
+        _programCache.initialize(PROGRAM_CACHE_PATH, driver);
+    }
+
+    GLint uniformAlign;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlign);
+    _uniformAlign = uniformAlign;
+
+    if (supportsIndirectDraws()) {
+        GLint storageAlign;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlign);
+        _storageAlign = storageAlign;
+    }
     
     // Load BRDF precomputation
     TexSampler brdfSampler;
     Image brdf;
-    brdf.loadImage("PBR/brdf.img");
+    brdf.mapImage("PBR/brdf.img");
     RRID brdfId = createTexture(brdf, brdfSampler);
     Resource.addTexture("brdf", RHI.getTexture(brdfId));
         
     // Load standard engine shaders
-    ShaderSource fsCommon(FRAGMENT_SHADER, "common.fs");
-
-    // Load unreal shader
-    ShaderSource vsUnreal(VERTEX_SHADER, "unreal.vs");
-    ShaderSource fsUnreal(FRAGMENT_SHADER, "unreal.fs");
-
-    sref<Shader> unrealProg = make_sref<Shader>("unreal");
-    unrealProg->addShader(vsUnreal);
-    unrealProg->addShader(fsUnreal);
-    unrealProg->addShader(fsCommon);
-    unrealProg->link();
-    Resource.addShader("unreal", unrealProg);
-
-    RHI.useProgram(unrealProg->id());
-    RHI.setSampler("irradianceTex", 6);
-    RHI.setSampler("ggxTex",        7);
-    RHI.setSampler("brdfTex",       8);
-    RHI.setBufferBlock("cameraBlock",   CAMERA_BUFFER_IDX);
-    RHI.setBufferBlock("rendererBlock", RENDERER_BUFFER_IDX);
-    RHI.setBufferBlock("lightBlock",    LIGHTS_BUFFER_IDX);
-    RHI.useProgram(0);
+    loadShaderVariants();
 
     // Load environment shader
+    ShaderSource fsCommon(FRAGMENT_SHADER, "common.fs");
     ShaderSource vsSkybox(VERTEX_SHADER,   "skybox.vs");
     ShaderSource fsSkybox(FRAGMENT_SHADER, "skybox.fs");
     sref<Shader> skyProg = make_sref<Shader>("skybox");
@@ -327,6 +375,8 @@ void RenderInterface::initialize() {
 }
 
 RRID RenderInterface::uploadGeometry(const sref<Geometry>& geo) {
+    RHI_CALL();
+
     auto verts   = geo->vertices();
     auto indices = geo->indices();
 
@@ -337,23 +387,20 @@ RRID RenderInterface::uploadGeometry(const sref<Geometry>& geo) {
     glBindVertexArray(vertArray.id);
 
     // Create VBOs for vertex data and indices
-    RRID vboIds[2] = { 0, 0 };
+    RRID vboIds[2] = { -1, -1 };
     vboIds[0] = createBuffer(BUFFER_VERTEX, BufferUsage::STATIC, sizeof(Vertex) * verts.size(), &verts[0]);
+    setBufferLayout(vboIds[0], VertexLayout);
 
-    BufferLayoutEntry entries[] = { { 0, 3, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, position) },
-                                    { 1, 3, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, normal) },
-                                    { 2, 2, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, uv) },
-                                    { 3, 3, ATTRIB_FLOAT, sizeof(Vertex), offsetof(Vertex, tangent) } };
-
-    BufferLayout layout = { 4, &entries[0] };
-    setBufferLayout(vboIds[0], layout);
-
-    if (indices.size() > 0)
+    // The index buffer binding is part of the vertex array state
+    if (indices.size() > 0) {
         vboIds[1] = createBuffer(BUFFER_INDEX, BufferUsage::STATIC, sizeof(uint32) * indices.size(), &indices[0]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffers[vboIds[1]].id);
+    }
 
     // Associate created VBOs with the VAO
     vertArray.buffers.push_back(vboIds[0]);
-    vertArray.buffers.push_back(vboIds[1]);
+    if (vboIds[1] != -1)
+        vertArray.buffers.push_back(vboIds[1]);
 
     vertArray.numVertices = (GLsizei)verts.size();
     vertArray.numIndices  = (GLsizei)indices.size();
@@ -367,48 +414,196 @@ RRID RenderInterface::uploadGeometry(const sref<Geometry>& geo) {
 }
 
 void RenderInterface::drawGeometry(RRID id) {
-    if (id < 0 || id >= _vertArrays.size())
+    RHI_CALL();
+
+    if (!_vertArrays.valid(id))
+        return; // Error
+
+    RHIVertArray& vao = _vertArrays[id];
+    if (vao.id == 0)
+        return; // Error
+
+    ++_frameStats.drawCalls;
+    _frameStats.triangles += (vao.numIndices > 0 ? vao.numIndices : vao.numVertices) / 3;
+
+    glBindVertexArray(vao.id);
+
+    if (vao.numIndices > 0)
+        glDrawElements(GL_TRIANGLES, vao.numIndices, GL_UNSIGNED_INT, 0);
+    else
+        glDrawArrays(GL_TRIANGLES, 0, vao.numVertices);
+
+    glBindVertexArray(0);
+}
+
+void RenderInterface::drawGeometryInstanced(RRID id, uint32 numInstances) {
+    RHI_CALL();
+
+    if (!_vertArrays.valid(id))
         return; // Error
 
     RHIVertArray& vao = _vertArrays[id];
     if (vao.id == 0)
         return; // Error
 
+    ++_frameStats.drawCalls;
+    _frameStats.triangles += (uint64)((vao.numIndices > 0 ? vao.numIndices : vao.numVertices) / 3) * numInstances;
+
     glBindVertexArray(vao.id);
 
-    glDrawArrays(GL_TRIANGLES, 0, vao.numVertices);
+    if (vao.numIndices > 0)
+        glDrawElementsInstanced(GL_TRIANGLES, vao.numIndices, GL_UNSIGNED_INT, 0, numInstances);
+    else
+        glDrawArraysInstanced(GL_TRIANGLES, 0, vao.numVertices, numInstances);
+
+    glBindVertexArray(0);
+}
+
+RRID RenderInterface::createGeometryArena(uint32 maxVertices, uint32 maxIndices, uint32 maxDraws) {
+    RHI_CALL();
+
+    RHIGeometryArena arena;
+    arena.maxVertices = maxVertices;
+    arena.maxIndices  = maxIndices;
+    arena.numVertices = 0;
+    arena.numIndices  = 0;
+
+    arena.vertArray = createVertexArray();
+    glBindVertexArray(_vertArrays[arena.vertArray].id);
+
+    // Storage for every geometry, filled by uploadGeometry
+    arena.vertexBuffer = createBuffer(BUFFER_VERTEX, BufferUsage::STATIC, sizeof(Vertex) * maxVertices, nullptr);
+    setBufferLayout(arena.vertexBuffer, VertexLayout);
+
+    arena.indexBuffer = createBuffer(BUFFER_INDEX, BufferUsage::STATIC, sizeof(uint32) * maxIndices, nullptr);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _buffers[arena.indexBuffer].id);
 
+    // Draw indices 0..maxDraws-1 read once per instance, the command's baseInstance
+    // selects the entry so the shader knows which draw it belongs to
+    vec<uint32> drawIds(maxDraws);
+    for (uint32 i = 0; i < maxDraws; ++i)
+        drawIds[i] = i;
+
+    arena.drawIdBuffer = createBuffer(BUFFER_VERTEX, BufferUsage::STATIC, sizeof(uint32) * maxDraws, &drawIds[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, _buffers[arena.drawIdBuffer].id);
+    glEnableVertexAttribArray(DRAW_ID_ATTRIB);
+    glVertexAttribIPointer(DRAW_ID_ATTRIB, 1, GL_UNSIGNED_INT, sizeof(uint32), 0);
+    glVertexAttribDivisor(DRAW_ID_ATTRIB, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(0);
+
+    RRID resId = _arenas.add(arena);
+
+    return resId;
+}
+
+RRID RenderInterface::uploadGeometry(RRID id, const sref<Geometry>& geo) {
+    RHI_CALL();
+
+    if (!_arenas.valid(id))
+        return -1; // Error
+
+    RHIGeometryArena& arena = _arenas[id];
+
+    auto verts   = geo->vertices();
+    auto indices = geo->indices();
+
+    // Non indexed geometry is drawn with sequential indices
+    if (indices.size() == 0) {
+        indices.resize(verts.size());
+        for (uint32 i = 0; i < verts.size(); ++i)
+            indices[i] = i;
+    }
+
+    if (arena.numVertices + verts.size() > arena.maxVertices ||
+        arena.numIndices + indices.size() > arena.maxIndices)
+        return -1; // Error, arena is full
+
+    RHIArenaGeometry sub;
+    sub.arena      = id;
+    sub.baseVertex = arena.numVertices;
+    sub.firstIndex = arena.numIndices;
+    sub.numIndices = (uint32)indices.size();
+
+    updateBuffer(arena.vertexBuffer, sizeof(Vertex) * sub.baseVertex, sizeof(Vertex) * verts.size(), &verts[0]);
+    updateBuffer(arena.indexBuffer,  sizeof(uint32) * sub.firstIndex, sizeof(uint32) * indices.size(), &indices[0]);
+
+    arena.numVertices += (uint32)verts.size();
+    arena.numIndices  += (uint32)indices.size();
+
+    RRID resId = _arenaGeometry.add(sub);
+
+    geo->setArenaRRID(resId);
+
+    return resId;
+}
+
+void RenderInterface::multiDrawIndirect(RRID arena, RRID ring, size_t offset, uint32 drawCount, uint64 numTriangles) {
+    RHI_CALL();
+
+    if (!_arenas.valid(arena))
+        return; // Error
+
+    if (!_rings.valid(ring))
+        return; // Error
+
+    RHIRingBuffer& cmds = _rings[ring];
+    if (!cmds.persistent)
+        flushRingBuffer(cmds);
+
+    RHIVertArray& vao = _vertArrays[_arenas[arena].vertArray];
+    RHIBuffer buffer  = _buffers[cmds.buffer];
+
+    ++_frameStats.drawCalls;
+    _frameStats.triangles += numTriangles;
+
+    glBindVertexArray(vao.id);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.id);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)offset, drawCount, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     glBindVertexArray(0);
 }
 
+bool RenderInterface::supportsIndirectDraws() const {
+    // The indirect shader is GLSL 4.30 and the draw index comes from baseInstance (GL 4.2),
+    // the extensions alone are not enough on older contexts
+    return GLEW_VERSION_4_3 == GL_TRUE;
+}
+
 RRID RenderInterface::createVertexArray() {
+    RHI_CALL();
+
     RHIVertArray vertArray;
+    vertArray.numIndices  = 0;
+    vertArray.numVertices = 0;
 
     glGenVertexArrays(1, &vertArray.id);
 
-    RRID resId = _vertArrays.size();
-    _vertArrays.push_back(vertArray);
+    RRID resId = _vertArrays.add(vertArray);
 
     return resId;
 }
 
 bool RenderInterface::deleteVertexArray(RRID id) {
-    if (id < 0)
+    RHI_CALL();
+
+    if (!_vertArrays.valid(id))
         return false; // Error
 
-    RHIVertArray vao = _vertArrays[id];
-    if (vao.id != 0) {
+    RHIVertArray& vao = _vertArrays[id];
+    if (vao.id != 0)
         glDeleteVertexArrays(1, &vao.id);
-        vao.id = 0;
-        vao.buffers.clear();
-        vao.numIndices = 0;
-        return true;
-    }
 
-    return false;
+    for (RRID buffer : vao.buffers)
+        deleteBuffer(buffer);
+
+    return _vertArrays.remove(id);
 }
 
 RRID RenderInterface::createBuffer(BufferType type, BufferUsage usage, size_t size, void* data) {
+    RHI_CALL();
+
     RHIBuffer buffer;
     buffer.target = OGLBufferTargets[type];
 
@@ -417,14 +612,19 @@ RRID RenderInterface::createBuffer(BufferType type, BufferUsage usage, size_t si
     glBufferData(buffer.target, size, data, OGLBufferUsage[usage]);
     glBindBuffer(buffer.target, 0);
 
-    RRID resId = _buffers.size();
-    _buffers.push_back(buffer);
+    ++_frameStats.buffersCreated;
+    if (data)
+        _frameStats.bytesUploaded += size;
+
+    RRID resId = _buffers.add(buffer);
 
     return resId;
 }
 
 void RenderInterface::bindBufferBase(RRID id, uint32 index) {
-    if (id < 0 || id >= _buffers.size())
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
         return; // Error
 
     RHIBuffer buffer = _buffers[id];
@@ -434,8 +634,20 @@ void RenderInterface::bindBufferBase(RRID id, uint32 index) {
     glBindBuffer(buffer.target, 0);
 }
 
+void RenderInterface::bindBufferRange(RRID id, uint32 index, size_t offset, size_t size) {
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
+        return; // Error
+
+    RHIBuffer buffer = _buffers[id];
+    glBindBufferRange(buffer.target, index, buffer.id, offset, size);
+}
+
 void RenderInterface::setBufferLayout(RRID id, uint32 idx, AttribType type, uint32 numElems, uint32 stride, size_t offset) {
-    if (id < 0 || id >= _buffers.size())
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
         return; // Error
 
     RHIBuffer buffer = _buffers[id];
@@ -450,7 +662,9 @@ void RenderInterface::setBufferLayout(RRID id, uint32 idx, AttribType type, uint
 }
 
 void RenderInterface::setBufferLayout(RRID id, const BufferLayout& layout) {
-    if (id < 0 || id >= _buffers.size())
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
         return; // Error
 
     RHIBuffer buffer = _buffers[id];
@@ -469,309 +683,788 @@ void RenderInterface::setBufferLayout(RRID id, const BufferLayout& layout) {
     glBindBuffer(buffer.target, 0);
 }
 
+void RenderInterface::setInstanceLayout(RRID vertArray, RRID id, size_t offset, const BufferLayout& layout) {
+    RHI_CALL();
+
+    if (!_vertArrays.valid(vertArray))
+        return; // Error
+
+    if (!_buffers.valid(id))
+        return; // Error
+
+    RHIVertArray& vao = _vertArrays[vertArray];
+    RHIBuffer buffer  = _buffers[id];
+    if (vao.id == 0 || buffer.id == 0)
+        return; // Error
+
+    // Instance attributes advance once per instance and read from any buffer
+    glBindVertexArray(vao.id);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer.id);
+
+    for (uint32 i = 0; i < layout.numEntries; ++i) {
+        const BufferLayoutEntry& entry = layout.entries[i];
+        const void* ptr = (const void*)(offset + entry.offset);
+
+        glEnableVertexAttribArray(entry.index);
+        if (entry.type == ATTRIB_FLOAT)
+            glVertexAttribPointer(entry.index, entry.numElems, GL_FLOAT, GL_FALSE, (GLsizei)entry.stride, ptr);
+        else
+            glVertexAttribIPointer(entry.index, entry.numElems, OGLAttrTypes[entry.type], (GLsizei)entry.stride, ptr);
+        glVertexAttribDivisor(entry.index, 1);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
 bool RenderInterface::updateBuffer(RRID id, size_t size, void* data) {
-    if (id < 0 || id >= _buffers.size())
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
         return false; // Error
 
     RHIBuffer buffer = _buffers[id];
     if (buffer.id == 0)
         return false; // Error
 
+    // Invalidate the old contents so the driver can orphan the storage
+    // instead of waiting for the GPU to finish reading it
     glBindBuffer(buffer.target, buffer.id);
-    GLvoid* p = glMapBuffer(buffer.target, GL_WRITE_ONLY);
+    GLvoid* p = glMapBufferRange(buffer.target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
     memcpy(p, data, size);
     glUnmapBuffer(buffer.target);
     glBindBuffer(buffer.target, 0);
 
+    _frameStats.mapCalls      += 2;
+    _frameStats.bytesUploaded += size;
+
+    return true;
+}
+
+bool RenderInterface::updateBuffer(RRID id, size_t offset, size_t size, const void* data) {
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
+        return false; // Error
+
+    RHIBuffer buffer = _buffers[id];
+    if (buffer.id == 0)
+        return false; // Error
+
+    glBindBuffer(buffer.target, buffer.id);
+    glBufferSubData(buffer.target, offset, size, data);
+    glBindBuffer(buffer.target, 0);
+
+    _frameStats.bytesUploaded += size;
+
     return true;
 }
 
 bool RenderInterface::deleteBuffer(RRID id) {
-    if (id < 0 || id >= _buffers.size())
+    RHI_CALL();
+
+    if (!_buffers.valid(id))
         return false; // Error
 
     RHIBuffer buffer = _buffers[id];
     if (buffer.id != 0) {
+        ++_frameStats.buffersDeleted;
         glDeleteBuffers(1, &buffer.id);
-        buffer.id = 0;
-        return true;
     }
 
-    return false;
+    return _buffers.remove(id);
 }
 
-uint32 RenderInterface::compileShader(const ShaderSource& source) {
-    // Create shader id
-    GLuint id = glCreateShader(OGLShaderTypes[source.type()]);
-    if (id == 0)
-        std::cerr << "Could not create shader: " + source.name();
-
-    // Set shader source and compile
-    const char* c_str = source.source().c_str();
-    glShaderSource(id, 1, &c_str, 0);
-    glCompileShader(id);
+RRID RenderInterface::createRingBuffer(BufferType type, size_t frameSize) {
+    RHI_CALL();
+
+    RHIRingBuffer ring;
+    ring.alignment = (type == BUFFER_SHARED)  ? _uniformAlign :
+                     (type == BUFFER_STORAGE) ? _storageAlign : 16;
+    ring.frameSize = alignSize(frameSize, ring.alignment);
+    ring.head      = 0;
+    ring.flushed   = 0;
+    ring.frame     = 0;
+    ring.ptr       = nullptr;
+    
+    for (uint32 f = 0; f < NUM_RING_FRAMES; ++f)
+        ring.fences[f] = 0;
 
-    // Check if shader compiled
-    GLint result;
-    glGetShaderiv(id, GL_COMPILE_STATUS, &result);
-    if (result == GL_TRUE)
-        return id;
+    RHIBuffer buffer;
+    buffer.id     = 0;
+    buffer.target = OGLBufferTargets[type];
+    ring.buffer   = _buffers.add(buffer);
 
-    // Check shader log for the error and print it
-    GLint logLen;
-    glGetShaderiv(id, GL_INFO_LOG_LENGTH, &logLen);
+    createRingStorage(ring);
 
-    char* log = new char[logLen];
-    glGetShaderInfoLog(id, logLen, &logLen, log);
+    RRID resId = _rings.add(ring);
 
-    std::string message(log);
-    delete[] log;
+    return resId;
+}
 
-    std::cerr << "Shader " << source.name() << " compilation log:\n" << message;
+void RenderInterface::createRingStorage(RHIRingBuffer& ring) {
+    RHIBuffer& buffer = _buffers[ring.buffer];
 
-    // Cleanup the shader
-    glDeleteShader(id);
+    size_t totalSize = ring.frameSize * NUM_RING_FRAMES;
 
-    return id;
-}
+    glGenBuffers(1, &buffer.id);
+    glBindBuffer(buffer.target, buffer.id);
 
-bool RenderInterface::deleteShader(const ShaderSource& source) {
-    uint32 id = source.id();
-    if (id != 0) {
-        glDeleteShader(id);
-        return true;
+    // Keep the buffer mapped for its whole lifetime when immutable storage is available,
+    // otherwise write to a CPU copy and send it with glBufferSubData before it is used
+    ring.persistent = GLEW_ARB_buffer_storage == GL_TRUE;
+    if (ring.persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(buffer.target, totalSize, nullptr, flags);
+        ring.ptr = (uint8*)glMapBufferRange(buffer.target, 0, totalSize, flags);
+        ++_frameStats.mapCalls;
+    } else {
+        glBufferData(buffer.target, totalSize, nullptr, GL_STREAM_DRAW);
+        ring.ptr = new uint8[totalSize];
     }
 
-    return false;
+    glBindBuffer(buffer.target, 0);
+
+    ++_frameStats.buffersCreated;
 }
 
-RRID RenderInterface::linkProgram(const Shader& shader) {
-    // Create program
-    GLuint id = glCreateProgram();
-    if (id == 0) {
-        std::string message = getProgramError(shader);
-        Utils::throwError("Could not create program " + shader.name());
-    }
+void RenderInterface::reserveRingBuffer(RRID id, size_t frameSize) {
+    RHI_CALL();
 
-    // Attach shaders
-    for (GLuint sid : shader.shaders()) {
-        glAttachShader(id, sid);
+    if (!_rings.valid(id))
+        return; // Error
 
-        // Check attachment error
-        checkOpenGLError("Could not attach shader (" + std::to_string(sid) +
-                         ") to program (" + std::to_string(id) + ") " + shader.name() + ".");
-    }
+    RHIRingBuffer& ring = _rings[id];
+    if (frameSize <= ring.frameSize)
+        return;
 
-    glLinkProgram(id);
+    // Grow by half at least, scenes filling up over several frames do not reallocate every time
+    frameSize = std::max(frameSize, ring.frameSize + ring.frameSize / 2);
 
-    GLint res;
-    glGetProgramiv(id, GL_LINK_STATUS, &res);
-    if (res != GL_TRUE) {
-        // Check program log for the error and print it
-        std::string message = getProgramError(shader);
-        Utils::throwError(message);
+    // Every region may still be read by the GPU
+    for (uint32 f = 0; f < NUM_RING_FRAMES; ++f) {
+        GLsync& fence = ring.fences[f];
+        if (fence == 0)
+            continue;
 
-        // Detach shaders
-        for (GLuint sid : shader.shaders())
-            glDetachShader(id, sid);
+        GLenum res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        while (res == GL_TIMEOUT_EXPIRED)
+            res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
 
-        // Delete the program
-        glDeleteProgram(id);
+        glDeleteSync(fence);
+        fence = 0;
+    }
 
-        return false;
+    RHIBuffer& buffer = _buffers[ring.buffer];
+    if (ring.persistent) {
+        glBindBuffer(buffer.target, buffer.id);
+        glUnmapBuffer(buffer.target);
+        glBindBuffer(buffer.target, 0);
+    } else {
+        delete[] ring.ptr;
     }
 
-    // Detach shaders after successful linking
-    for (GLuint sid : shader.shaders())
-        glDetachShader(id, sid);
+    glDeleteBuffers(1, &buffer.id);
+    ++_frameStats.buffersDeleted;
 
-    RRID rrid = _programs.size();
-    _programs.push_back({ id });
+    ring.frameSize = alignSize(frameSize, ring.alignment);
+    ring.head      = 0;
+    ring.flushed   = 0;
+    ring.frame     = 0;
 
-    return rrid;
+    createRingStorage(ring);
 }
 
-std::string RenderInterface::getProgramError(const Shader& shader) {
-    GLint logLen;
-    glGetProgramiv(shader.id(), GL_INFO_LOG_LENGTH, &logLen);
+void RenderInterface::beginRingFrame(RRID id) {
+    RHI_CALL();
 
-    char* log = new char[logLen];
-    glGetProgramInfoLog(shader.id(), logLen, &logLen, log);
+    if (!_rings.valid(id))
+        return; // Error
 
-    std::string strLog(log);
-    delete[] log;
+    RHIRingBuffer& ring = _rings[id];
 
-    return strLog;
-}
+    // Wait until the GPU has finished with the region used NUM_RING_FRAMES frames ago
+    GLsync& fence = ring.fences[ring.frame];
+    if (fence != 0) {
+        GLenum res = glClientWaitSync(fence, 0, 0);
+        while (res == GL_TIMEOUT_EXPIRED)
+            res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
 
-void RenderInterface::useProgram(RRID id) {
-    glUseProgram(_programs[id].id);
-    _currProgram = id;
-}
+        glDeleteSync(fence);
+        fence = 0;
+    }
 
-void RenderInterface::setFloat(const std::string& name, float val) {
-    GLuint id = _programs[_currProgram].id;
-    GLint loc = glGetUniformLocation(id, name.c_str());
-    glUniform1f(loc, val);
+    ring.head    = 0;
+    ring.flushed = 0;
 }
 
-void RenderInterface::setVector3(const std::string& name, const Vec3& vec) {
-    GLuint id = _programs[_currProgram].id;
-    GLint loc = glGetUniformLocation(id, name.c_str());
-    glUniform3fv(loc, 1, (const GLfloat*)&vec);
-}
+void RenderInterface::endRingFrame(RRID id) {
+    RHI_CALL();
 
-void RenderInterface::setVector4(const std::string& name, const Vec4& vec) {
-    GLuint id = _programs[_currProgram].id;
-    GLint loc = glGetUniformLocation(id, name.c_str());
-    glUniform4fv(loc, 1, (const GLfloat*)&vec);
-}
+    if (!_rings.valid(id))
+        return; // Error
 
-void RenderInterface::setMatrix3(const std::string& name, const Mat3& mat) {
-    GLuint id = _programs[_currProgram].id;
-    GLint loc = glGetUniformLocation(id, name.c_str());
-    glUniformMatrix3fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
+    RHIRingBuffer& ring = _rings[id];
+    ring.fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring.frame = (ring.frame + 1) % NUM_RING_FRAMES;
 }
 
-void RenderInterface::setMatrix4(const std::string& name, const Mat4& mat) {
-    GLuint id = _programs[_currProgram].id;
-    GLint loc = glGetUniformLocation(id, name.c_str());
-    glUniformMatrix4fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
-}
+void RenderInterface::bindRingRange(RRID id, uint32 index, size_t offset, size_t size) {
+    RHI_CALL();
 
-void RenderInterface::setSampler(const std::string& name, uint32 id) {
-    GLuint pid = _programs[_currProgram].id;
-    GLint loc  = glGetUniformLocation(pid, name.c_str());
-    glUniform1i(loc, id);
-}
+    if (!_rings.valid(id))
+        return; // Error
 
-void RenderInterface::setFloat(int32 loc, float val) {
-    glUniform1f(loc, val);
-}
+    RHIRingBuffer& ring = _rings[id];
+    if (!ring.persistent)
+        flushRingBuffer(ring);
 
-void RenderInterface::setVector3(int32 loc, const Vec3& vec) {
-    glUniform3fv(loc, 1, (const GLfloat*)&vec);
+    RHIBuffer buffer = _buffers[ring.buffer];
+    glBindBufferRange(buffer.target, index, buffer.id, offset, alignSize(size, 16));
 }
 
-void RenderInterface::setVector4(int32 loc, const Vec4& vec) {
-    glUniform4fv(loc, 1, (const GLfloat*)&vec);
-}
+void RenderInterface::flushRingBuffer(RHIRingBuffer& ring) {
+    if (ring.flushed >= ring.head)
+        return;
 
-void RenderInterface::setMatrix3(int32 loc, const Mat3& mat) {
-    glUniformMatrix3fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
-}
+    size_t start = ring.frame * ring.frameSize + ring.flushed;
+    RHIBuffer buffer = _buffers[ring.buffer];
 
-void RenderInterface::setMatrix4(int32 loc, const Mat4& mat) {
-    glUniformMatrix4fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
+    glBindBuffer(buffer.target, buffer.id);
+    glBufferSubData(buffer.target, start, ring.head - ring.flushed, ring.ptr + start);
+    glBindBuffer(buffer.target, 0);
+
+    ring.flushed = ring.head;
 }
 
-void RenderInterface::setBufferBlock(const std::string& name, uint32 binding) {
-    GLuint id = _programs[_currProgram].id;
-    GLint idx = glGetUniformBlockIndex(id, name.c_str());
+uint32 RenderInterface::submitShader(const ShaderSource& source) {
+    RHI_CALL();
+
+    // Create shader id
+    GLuint id = glCreateShader(OGLShaderTypes[source.type()]);
+    if (id == 0) {
+        std::cerr << "Could not create shader: " + source.name();
+        return 0;
+    }
+
+    // Set shader source and compile, the result is only checked when it is needed
+    const char* c_str = source.source().c_str();
+    glShaderSource(id, 1, &c_str, 0);
+    glCompileShader(id);
+
+    return id;
+}
+
+uint32 RenderInterface::compileShader(const ShaderSource& source) {
+    PROFILE_ZONE("RenderInterface::compileShader");
+    RHI_CALL();
+
+    GLuint id = submitShader(source);
+    if (id == 0)
+        return 0;
+
+    // Check if shader compiled
+    GLint result;
+    glGetShaderiv(id, GL_COMPILE_STATUS, &result);
+    if (result == GL_TRUE)
+        return id;
+
+    std::cerr << "Shader " << source.name() << " compilation log:\n" << getShaderError(id);
+
+    // Cleanup the shader
+    glDeleteShader(id);
+
+    return 0;
+}
+
+bool RenderInterface::deleteShader(const ShaderSource& source) {
+    RHI_CALL();
+
+    uint32 id = source.id();
+    if (id != 0) {
+        glDeleteShader(id);
+        return true;
+    }
+
+    return false;
+}
+
+RRID RenderInterface::linkProgram(const Shader& shader) {
+    PROFILE_ZONE("RenderInterface::linkProgram");
+
+    RRID id = submitProgram(shader);
+    if (id == -1)
+        return -1;
+
+    if (programStatus(id, true) != PROGRAM_READY) {
+        deleteProgram(id);
+        Utils::throwError("Could not link program " + shader.name());
+        return -1;
+    }
+
+    return id;
+}
+
+RRID RenderInterface::submitProgram(const Shader& shader) {
+    PROFILE_ZONE("RenderInterface::submitProgram");
+    RHI_CALL();
+
+    RHIProgram prog;
+    prog.status   = PROGRAM_PENDING;
+    prog.cacheKey = 0;
+    prog.name     = shader.name();
+
+    // A cached binary skips compiling and linking the sources
+    if (_programCache.enabled()) {
+        prog.cacheKey = ProgramCache::hashSources(shader);
+
+        prog.id = loadProgramBinary(prog.cacheKey);
+        if (prog.id != 0) {
+            prog.status = PROGRAM_READY;
+            return _programs.add(prog);
+        }
+    }
+
+    // Create program
+    prog.id = glCreateProgram();
+    if (prog.id == 0) {
+        Utils::throwError("Could not create program " + shader.name());
+        return -1;
+    }
+
+    // Sources shared with other programs are only compiled once
+    for (ShaderSource* source : shader.sources()) {
+        source->submit();
+        glAttachShader(prog.id, source->id());
+        prog.shaders.push_back(source->id());
+    }
+
+    if (_programCache.enabled())
+        glProgramParameteri(prog.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glLinkProgram(prog.id);
+
+    return _programs.add(prog);
+}
+
+ProgramStatus RenderInterface::programStatus(RRID id, bool wait) {
+    RHI_CALL();
+
+    if (!_programs.valid(id))
+        return PROGRAM_FAILED; // Error
+
+    RHIProgram& prog = _programs[id];
+    if (prog.status != PROGRAM_PENDING)
+        return prog.status;
+
+    // Without parallel compiles the link status query below waits for the driver
+    if (!wait && _parallelCompile) {
+        GLint done = GL_FALSE;
+        glGetProgramiv(prog.id, GL_COMPLETION_STATUS_KHR, &done);
+        if (done != GL_TRUE)
+            return PROGRAM_PENDING;
+    }
+
+    finishProgram(prog);
+    return prog.status;
+}
+
+bool RenderInterface::deleteProgram(RRID id) {
+    RHI_CALL();
+
+    if (!_programs.valid(id))
+        return false; // Error
+
+    if (_currProgram == id)
+        useProgram(0);
+
+    RHIProgram& prog = _programs[id];
+    for (GLuint shader : prog.shaders)
+        glDetachShader(prog.id, shader);
+
+    glDeleteProgram(prog.id);
+
+    return _programs.remove(id);
+}
+
+bool RenderInterface::supportsParallelCompile() const {
+    return _parallelCompile;
+}
+
+void RenderInterface::finishProgram(RHIProgram& prog) {
+    PROFILE_ZONE("RenderInterface::finishProgram");
+
+    GLint res;
+    glGetProgramiv(prog.id, GL_LINK_STATUS, &res);
+    prog.status = (res == GL_TRUE) ? PROGRAM_READY : PROGRAM_FAILED;
+
+    if (prog.status == PROGRAM_FAILED) {
+        // Compile errors are only in the logs of the shaders
+        std::string message;
+        for (GLuint shader : prog.shaders) {
+            GLint compiled;
+            glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+            if (compiled != GL_TRUE)
+                message += getShaderError(shader);
+        }
+
+        std::cerr << "[ERROR] " << prog.name << " link log:\n" << message << getProgramError(prog.id) << std::endl;
+    }
+
+    // Detach shaders once linking is over
+    for (GLuint shader : prog.shaders)
+        glDetachShader(prog.id, shader);
+    prog.shaders.clear();
+
+    if (prog.status == PROGRAM_READY && _programCache.enabled())
+        storeProgramBinary(prog.cacheKey, prog.id);
+}
+
+GLuint RenderInterface::loadProgramBinary(uint64 key) {
+    uint32 format;
+    vec<uint8> binary;
+    if (!_programCache.load(key, format, binary))
+        return 0;
+
+    GLuint id = glCreateProgram();
+    glProgramBinary(id, format, &binary[0], (GLsizei)binary.size());
+
+    // Drivers reject binaries they can't use anymore, compile the sources again in that case
+    GLint res;
+    glGetProgramiv(id, GL_LINK_STATUS, &res);
+    if (res != GL_TRUE) {
+        glDeleteProgram(id);
+        return 0;
+    }
+
+    return id;
+}
+
+void RenderInterface::storeProgramBinary(uint64 key, GLuint id) {
+    GLint size = 0;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    GLenum format;
+    vec<uint8> binary(size);
+    glGetProgramBinary(id, size, &size, &format, &binary[0]);
+    binary.resize(size);
+
+    if (!_programCache.store(key, format, binary))
+        std::cerr << "[WARNING] Could not write the program cache entry " << key << std::endl;
+}
+
+std::string RenderInterface::getShaderError(uint32 shader) {
+    GLint logLen;
+    glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLen);
+    if (logLen <= 0)
+        return "";
+
+    char* log = new char[logLen];
+    glGetShaderInfoLog(shader, logLen, &logLen, log);
+
+    std::string strLog(log);
+    delete[] log;
+
+    return strLog;
+}
+
+std::string RenderInterface::getProgramError(uint32 program) {
+    GLint logLen;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLen);
+    if (logLen <= 0)
+        return "";
+
+    char* log = new char[logLen];
+    glGetProgramInfoLog(program, logLen, &logLen, log);
+
+    std::string strLog(log);
+    delete[] log;
+
+    return strLog;
+}
+
+void RenderInterface::useProgram(RRID id) {
+    RHI_CALL();
+
+    // Handle 0 unbinds the current program
+    GLuint pid = 0;
+    if (id != 0) {
+        if (!_programs.valid(id))
+            return; // Error
+
+        pid = _programs[id].id;
+    }
+
+    if (id != _currProgram)
+        ++_frameStats.programSwitches;
+
+    glUseProgram(pid);
+    _currProgram   = id;
+    _currProgramId = pid;
+}
+
+void RenderInterface::setFloat(const std::string& name, float val) {
+    RHI_CALL();
+
+    GLuint id = _currProgramId;
+    GLint loc = glGetUniformLocation(id, name.c_str());
+    glUniform1f(loc, val);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setVector3(const std::string& name, const Vec3& vec) {
+    RHI_CALL();
+
+    GLuint id = _currProgramId;
+    GLint loc = glGetUniformLocation(id, name.c_str());
+    glUniform3fv(loc, 1, (const GLfloat*)&vec);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setVector4(const std::string& name, const Vec4& vec) {
+    RHI_CALL();
+
+    GLuint id = _currProgramId;
+    GLint loc = glGetUniformLocation(id, name.c_str());
+    glUniform4fv(loc, 1, (const GLfloat*)&vec);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setMatrix3(const std::string& name, const Mat3& mat) {
+    RHI_CALL();
+
+    GLuint id = _currProgramId;
+    GLint loc = glGetUniformLocation(id, name.c_str());
+    glUniformMatrix3fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setMatrix4(const std::string& name, const Mat4& mat) {
+    RHI_CALL();
+
+    GLuint id = _currProgramId;
+    GLint loc = glGetUniformLocation(id, name.c_str());
+    glUniformMatrix4fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setSampler(const std::string& name, uint32 id) {
+    RHI_CALL();
+
+    GLuint pid = _currProgramId;
+    GLint loc  = glGetUniformLocation(pid, name.c_str());
+    glUniform1i(loc, id);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setFloat(int32 loc, float val) {
+    RHI_CALL();
+
+    glUniform1f(loc, val);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setVector3(int32 loc, const Vec3& vec) {
+    RHI_CALL();
+
+    glUniform3fv(loc, 1, (const GLfloat*)&vec);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setVector4(int32 loc, const Vec4& vec) {
+    RHI_CALL();
+
+    glUniform4fv(loc, 1, (const GLfloat*)&vec);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setMatrix3(int32 loc, const Mat3& mat) {
+    RHI_CALL();
+
+    glUniformMatrix3fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setMatrix4(int32 loc, const Mat4& mat) {
+    RHI_CALL();
+
+    glUniformMatrix4fv(loc, 1, GL_FALSE, (const GLfloat*)&mat);
+    ++_frameStats.uniformCalls;
+}
+
+void RenderInterface::setBufferBlock(const std::string& name, uint32 binding) {
+    RHI_CALL();
+
+    GLuint id = _currProgramId;
+    GLuint idx = glGetUniformBlockIndex(id, name.c_str());
+    if (idx == GL_INVALID_INDEX)
+        return; // Not used by the program
+
     glUniformBlockBinding(id, idx, binding);
 }
 
 int32 RenderInterface::uniformLocation(RRID id, const std::string& name) {
+    RHI_CALL();
+
+    if (!_programs.valid(id))
+        return -1; // Error
+
     GLuint pid = _programs[id].id;
     return glGetUniformLocation(pid, name.c_str());
 }
  
 uint32 RenderInterface::uniformBlockLocation(RRID id, const std::string& name) {
+    RHI_CALL();
+
+    if (!_programs.valid(id))
+        return GL_INVALID_INDEX; // Error
+
     GLuint pid = _programs[id].id;
     return glGetUniformBlockIndex(pid, name.c_str());
 }
 
-void RenderInterface::checkOpenGLError(const std::string& error) {
-    if (isOpenGLError()) {
-        std::cerr << error << std::endl;
-        std::cin.get();
-        exit(EXIT_FAILURE);
+// Defines a mutable level, a 0 sized level frees its memory
+static void texLevel(GLenum target, ImageType type, ImageFormat fmt, GLenum intFormat, GLenum format, GLenum pType,
+                     uint32 level, uint32 width, uint32 height, uint32 depth) {
+    // Compressed formats only come as 2D images
+    if (isCompressed(fmt)) {
+        GLsizei size = (width == 0 || height == 0) ? 0 : ((width + 3) / 4) * ((height + 3) / 4) * formatToBlockSize(fmt);
+        if (type == IMGTYPE_2D)
+            glCompressedTexImage2D(target, level, intFormat, width, height, 0, size, nullptr);
+        else if (type == IMGTYPE_CUBE)
+            for (uint32 face = 0; face < 6; ++face)
+                glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, intFormat, width, height, 0, size, nullptr);
+        return;
     }
-}
 
-bool RenderInterface::isOpenGLError() {
-    bool isError = false;
-    GLenum errCode;
-    const GLubyte *errString;
-    while ((errCode = glGetError()) != GL_NO_ERROR) {
-        isError = true;
-        errString = gluErrorString(errCode);
-        std::cerr << "OpenGL ERROR [" << errString << "]." << std::endl;
-    }
-    return isError;
+    if (type == IMGTYPE_2D)
+        glTexImage2D(target, level, intFormat, width, height, 0, format, pType, nullptr);
+    else if (type == IMGTYPE_1D)
+        glTexImage1D(target, level, intFormat, width, 0, format, pType, nullptr);
+    else if (type == IMGTYPE_3D)
+        glTexImage3D(target, level, intFormat, width, height, depth, 0, format, pType, nullptr);
+    else if (type == IMGTYPE_CUBE)
+        for (uint32 face = 0; face < 6; ++face)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, intFormat, width, height, 0, format, pType, nullptr);
 }
 
-RRID RenderInterface::createTexture(const Image& img, const TexSampler& sampler) {
-    GLuint id = 0;
-    GLenum target = OGLTexTargets[img.type()];
-
-    RRID resId = _textures.size();
+// Allocates every level up front, immutable when the format has a sized version and texture storage is supported
+static void texStorage(GLenum target, ImageType type, ImageFormat fmt, GLenum sizedFormat, GLenum format, GLenum pType,
+                       uint32 levels, uint32 width, uint32 height, uint32 depth) {
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL,  levels - 1);
 
-    glGenTextures(1, &id);
-    glBindTexture(target, id);
-
-    GLenum pType  = OGLTexPixelTypes[img.compType()];
-    GLenum oglFmt = OGLTexPixelFormats[img.format()];
+    if (sizedFormat != 0 && (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage)) {
+        if (type == IMGTYPE_1D)
+            glTexStorage1D(target, levels, sizedFormat, width);
+        else if (type == IMGTYPE_3D)
+            glTexStorage3D(target, levels, sizedFormat, width, height, depth);
+        else
+            glTexStorage2D(target, levels, sizedFormat, width, height);
+        return;
+    }
 
-    // Upload all levels
-    ImageType type = img.type();
-    for (uint32 lvl = 0; lvl < img.numLevels(); ++lvl) {
-        uint32 w = mipDimension(img.width(), lvl);
-        uint32 h = mipDimension(img.height(), lvl);
-        uint32 d = mipDimension(img.depth(), lvl);
+    GLenum intFormat = sizedFormat != 0 ? sizedFormat : format;
+    for (uint32 lvl = 0; lvl < levels; ++lvl)
+        texLevel(target, type, fmt, intFormat, format, pType, lvl, mipDimension(width, lvl), mipDimension(height, lvl), mipDimension(depth, lvl));
+}
 
-        if (type == IMGTYPE_2D)
-            glTexImage2D(target, lvl, oglFmt, w, h, 0, oglFmt, pType, img.data(lvl));
-        else if (type == IMGTYPE_1D)
-            glTexImage1D(target, lvl, oglFmt, w, 0, oglFmt, pType, img.data(lvl));
-        else if (type == IMGTYPE_3D)
-            glTexImage3D(target, lvl, oglFmt, w, h, d, 0, oglFmt, pType, img.data(lvl));
+// Writes a level of a texture with storage, pixels is an offset when an unpack buffer is bound
+static void texSubImage(const RHITexture& ogltex, uint32 face, uint32 level, const void* pixels) {
+    GLsizei w = mipDimension(ogltex.tex->width(),  level);
+    GLsizei h = mipDimension(ogltex.tex->height(), level);
+    GLsizei d = mipDimension(ogltex.tex->depth(),  level);
+
+    ImageType   type = ogltex.tex->format().imgType;
+    ImageFormat fmt  = ogltex.tex->format().imgFmt;
+    if (isCompressed(fmt)) {
+        GLsizei size = ((w + 3) / 4) * ((h + 3) / 4) * formatToBlockSize(fmt);
+        GLenum  target = (type == IMGTYPE_CUBE) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : ogltex.target;
+        glCompressedTexSubImage2D(target, level, 0, 0, w, h, ogltex.intFormat, size, pixels);
+        return;
     }
 
-    glTexParameteri(target, GL_TEXTURE_WRAP_S,     OGLTexWrapping[sampler.sWrap()]);
-    glTexParameteri(target, GL_TEXTURE_WRAP_T,     OGLTexWrapping[sampler.tWrap()]);
-    glTexParameteri(target, GL_TEXTURE_WRAP_R,     OGLTexWrapping[sampler.rWrap()]);
-    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, OGLTexFilters[sampler.minFilter()]);
-    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, OGLTexFilters[sampler.magFilter()]);
+    if (type == IMGTYPE_2D)
+        glTexSubImage2D(ogltex.target, level, 0, 0, w, h, ogltex.format, ogltex.pType, pixels);
+    else if (type == IMGTYPE_1D)
+        glTexSubImage1D(ogltex.target, level, 0, w, ogltex.format, ogltex.pType, pixels);
+    else if (type == IMGTYPE_3D)
+        glTexSubImage3D(ogltex.target, level, 0, 0, 0, w, h, d, ogltex.format, ogltex.pType, pixels);
+    else if (type == IMGTYPE_CUBE)
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, w, h, ogltex.format, ogltex.pType, pixels);
+}
 
-    // Unbind texture
-    glBindTexture(target, 0);
+bool RenderInterface::supportsCompressedFormat(ImageFormat fmt) const {
+    switch (fmt) {
+        case IMGFMT_DXT1:
+        case IMGFMT_DXT3:
+        case IMGFMT_DXT5:
+            return GLEW_EXT_texture_compression_s3tc == GL_TRUE;
+        case IMGFMT_ATI1N:
+        case IMGFMT_ATI2N:
+            return true; // RGTC is core since 3.0
+        case IMGFMT_BC7:
+            return GLEW_VERSION_4_2 == GL_TRUE || GLEW_ARB_texture_compression_bptc == GL_TRUE;
+        default:
+            return false;
+    }
+}
 
-    TexFormat fmt;
-    fmt.imgFmt  = img.format();
-    fmt.imgType = img.type();
-    fmt.levels  = img.numLevels();
-    fmt.pType   = img.compType();
+RRID RenderInterface::createTexture(const Image& img, const TexSampler& sampler) {
+    RHI_CALL();
 
-    sref<Texture> tex = make_sref<GPUTexture>(resId, img.width(), img.height(), img.depth(), sampler, fmt);
+    RRID resId = createTexture(img.type(), img.format(), img.width(), img.height(), img.depth(), sampler, img.numLevels());
+    if (resId == -1)
+        return -1; // Error
 
-    _textures.push_back({ id, target, oglFmt, oglFmt, pType, tex });
+    uploadImage(resId, 0, img);
+    submitStaging();
 
     return resId;
 }
 
 // Create texture
-RRID RenderInterface::createTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height, uint32 depth, const TexSampler& sampler) {
+RRID RenderInterface::createTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height, uint32 depth,
+                                    const TexSampler& sampler, uint32 numLevels) {
+    RHI_CALL();
+
     GLuint id = 0;
     GLenum target = OGLTexTargets[type];
 
-    RRID resId = _textures.size();
+    RRID resId = _textures.add();
 
-    if (type == IMGTYPE_2D) {
+    if (type == IMGTYPE_2D || type == IMGTYPE_CUBE) {
         depth = 1;
     } else if (type == IMGTYPE_1D) {
         height = depth = 1;
     }
 
-    if (type == IMGTYPE_2D && sampler.numSamples() > 0)
-        target = GL_TEXTURE_2D_MULTISAMPLE;
+    bool multisample = type == IMGTYPE_2D && sampler.numSamples() > 0;
+    if (multisample) {
+        target    = GL_TEXTURE_2D_MULTISAMPLE;
+        numLevels = 1;
+    }
+
+    TexFormat texFmt;
+    texFmt.imgFmt  = fmt;
+    texFmt.imgType = type;
+    texFmt.pType   = formatToImgComp(fmt);
+    texFmt.levels  = numLevels;
+
+    GLenum intFormat = OGLTexSizedFormats[fmt];
+    GLenum format    = OGLTexPixelFormats[fmt];
+    GLenum pType     = OGLTexPixelTypes[texFmt.pType];
 
     glGenTextures(1, &id);
+    ++_frameStats.texturesCreated;
     glBindTexture(target, id);
 
-    GLenum intFormat = OGLTexSizedFormats[fmt];
-    if (type == IMGTYPE_2D && sampler.numSamples() > 0)
+    if (multisample)
         glTexImage2DMultisample(target, sampler.numSamples(), intFormat, width, height, GL_TRUE);
+    else
+        texStorage(target, type, fmt, intFormat, format, pType, numLevels, width, height, depth);
 
     // Set the sampler
     glTexParameteri(target, GL_TEXTURE_WRAP_S,     OGLTexWrapping[sampler.sWrap()]);
@@ -783,48 +1476,56 @@ RRID RenderInterface::createTexture(ImageType type, ImageFormat fmt, uint32 widt
     // Unbind texture
     glBindTexture(target, 0);
 
-    TexFormat texFmt;
-    texFmt.imgFmt  = fmt;
-    texFmt.imgType = type;
-    texFmt.pType   = formatToImgComp(fmt);
-    texFmt.levels  = 1;
-
     sref<Texture> tex = make_sref<GPUTexture>(resId, width, height, depth, sampler, texFmt);
 
-    _textures.push_back({ id, target, intFormat, OGLTexPixelFormats[fmt], OGLTexPixelTypes[texFmt.pType], tex });
+    _textures[resId] = { id, target, intFormat != 0 ? intFormat : format, format, pType, tex };
 
     return resId;
 }
 
 RRID RenderInterface::createCubemap(const Cubemap& cube, const TexSampler& sampler) {
+    RHI_CALL();
+
+    RRID resId = createTexture(IMGTYPE_CUBE, cube.format(), cube.width(), cube.height(), 1, sampler, cube.numLevels());
+    if (resId == -1)
+        return -1; // Error
+
+    for (uint32 side = 0; side < 6; side++)
+        uploadImage(resId, side, *cube.face((CubemapFace)side));
+    submitStaging();
+
+    return resId;
+}
+
+RRID RenderInterface::createStreamedTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height,
+                                            const TexSampler& sampler, uint32 numLevels) {
+    RHI_CALL();
+
+    if (type != IMGTYPE_2D && type != IMGTYPE_CUBE)
+        return -1; // Error
+
     GLuint id = 0;
-    GLenum target = OGLTexTargets[ImageType::IMGTYPE_CUBE];
+    GLenum target = OGLTexTargets[type];
+
+    RRID resId = _textures.add();
 
-    RRID resId = _textures.size();
+    TexFormat texFmt;
+    texFmt.imgFmt  = fmt;
+    texFmt.imgType = type;
+    texFmt.pType   = formatToImgComp(fmt);
+    texFmt.levels  = numLevels;
 
-    GLenum pType  = OGLTexPixelTypes[cube.compType()];
-    GLenum oglFmt = OGLTexPixelFormats[cube.format()];
+    GLenum intFormat = OGLTexSizedFormats[fmt];
+    GLenum format    = OGLTexPixelFormats[fmt];
+    GLenum pType     = OGLTexPixelTypes[texFmt.pType];
 
     glGenTextures(1, &id);
+    ++_frameStats.texturesCreated;
     glBindTexture(target, id);
-    
-    if (cube.numLevels() > 1) {
-        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
-        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL,  4);
-        //glGenerateMipmap(target);
-    }
-    
-    for (uint32 side = 0; side < 6; side++) {
-        const Image* img = cube.face((CubemapFace)side);
 
-        // Upload all levels for the face
-        for (uint32 lvl = 0; lvl < img->numLevels(); ++lvl) {
-            uint32 w = mipDimension(img->width(),  lvl);
-            uint32 h = mipDimension(img->height(), lvl);
-
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + side, lvl, oglFmt, w, h, 0, oglFmt, pType, img->data(lvl));
-        }
-    }
+    // Levels below the base level are left undefined, they do not count for completeness
+    glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, numLevels - 1);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL,  numLevels - 1);
 
     glTexParameteri(target, GL_TEXTURE_WRAP_S,     OGLTexWrapping[sampler.sWrap()]);
     glTexParameteri(target, GL_TEXTURE_WRAP_T,     OGLTexWrapping[sampler.tWrap()]);
@@ -835,32 +1536,103 @@ RRID RenderInterface::createCubemap(const Cubemap& cube, const TexSampler& sampl
     // Unbind texture
     glBindTexture(target, 0);
 
-    TexFormat fmt;
-    fmt.imgFmt  = cube.format();
-    fmt.imgType = IMGTYPE_CUBE;
-    fmt.levels  = cube.numLevels();
-    fmt.pType   = cube.compType();
+    sref<Texture> tex = make_sref<GPUTexture>(resId, width, height, 1, sampler, texFmt);
+
+    _textures[resId] = { id, target, intFormat != 0 ? intFormat : format, format, pType, tex };
+
+    return resId;
+}
+
+void RenderInterface::allocTextureLevel(RRID id, uint32 level) {
+    RHI_CALL();
+
+    if (!_textures.valid(id))
+        return; // Error
+
+    RHITexture ogltex = _textures[id];
+    if (ogltex.id == 0)
+        return; // Error
+
+    const TexFormat& fmt = ogltex.tex->format();
+    glBindTexture(ogltex.target, ogltex.id);
+    texLevel(ogltex.target, fmt.imgType, fmt.imgFmt, ogltex.intFormat, ogltex.format, ogltex.pType, level,
+             mipDimension(ogltex.tex->width(), level), mipDimension(ogltex.tex->height(), level), 1);
+    glBindTexture(ogltex.target, 0);
+}
+
+void RenderInterface::freeTextureLevel(RRID id, uint32 level) {
+    RHI_CALL();
+
+    if (!_textures.valid(id))
+        return; // Error
+
+    RHITexture ogltex = _textures[id];
+    if (ogltex.id == 0)
+        return; // Error
+
+    const TexFormat& fmt = ogltex.tex->format();
+    glBindTexture(ogltex.target, ogltex.id);
+    texLevel(ogltex.target, fmt.imgType, fmt.imgFmt, ogltex.intFormat, ogltex.format, ogltex.pType, level, 0, 0, 0);
+    glBindTexture(ogltex.target, 0);
+}
+
+void RenderInterface::setBaseLevel(RRID id, uint32 level) {
+    RHI_CALL();
 
-    sref<Texture> tex = make_sref<GPUTexture>(resId, cube.width(), cube.height(), 1, sampler, fmt);
+    if (!_textures.valid(id))
+        return; // Error
 
-    _textures.push_back({ id, target, oglFmt, oglFmt, pType, tex });
+    RHITexture ogltex = _textures[id];
+    if (ogltex.id == 0)
+        return; // Error
 
-    return resId;
+    // GL_TEXTURE_MIN_LOD is relative to the base level, the base level alone clamps sampling
+    glBindTexture(ogltex.target, ogltex.id);
+    glTexParameteri(ogltex.target, GL_TEXTURE_BASE_LEVEL, level);
+    glBindTexture(ogltex.target, 0);
 }
 
-sref<Texture> RenderInterface::getTexture(RRID id) {
-    if (id < 0 || id >= _textures.size())
-        return nullptr; // Error
+// Copies the levels into staging memory, faces too large for it are uploaded from client memory
+void RenderInterface::uploadImage(RRID id, uint32 face, const Image& img) {
+    StagingRegion region;
+    bool staged = allocStaging(img.totalSize(), region);
 
-    RHITexture tex = _textures[id];
-    if (tex.id == 0 || tex.tex == nullptr)
-        return nullptr; // Error
+    // Free the memory of the faces already uploaded
+    if (!staged && !_staging.ranges.empty()) {
+        submitStaging();
+        staged = allocStaging(img.totalSize(), region);
+    }
 
-    return tex.tex;
+    if (staged) {
+        memcpy(region.ptr, img.data(), img.totalSize());
+
+        size_t offset = 0;
+        for (uint32 lvl = 0; lvl < img.numLevels(); ++lvl) {
+            uploadTexture(id, face, lvl, region, offset);
+            offset += img.size(lvl);
+        }
+        return;
+    }
+
+    RHITexture ogltex = _textures[id];
+    glBindTexture(ogltex.target, ogltex.id);
+    for (uint32 lvl = 0; lvl < img.numLevels(); ++lvl)
+        texSubImage(ogltex, face, lvl, img.data(lvl));
+    glBindTexture(ogltex.target, 0);
+}
+
+// Compressed levels are read back as blocks
+static void getTexImage(const RHITexture& ogltex, GLenum target, uint32 level, void* pixels) {
+    if (isCompressed(ogltex.tex->format().imgFmt))
+        glGetCompressedTexImage(target, level, pixels);
+    else
+        glGetTexImage(target, level, ogltex.format, ogltex.pType, pixels);
 }
 
 bool RenderInterface::readTexture(RRID id, Image& img) {
-    if (id < 0 || id >= _textures.size())
+    RHI_CALL();
+
+    if (!_textures.valid(id))
         return false; // Error
 
     RHITexture tex = _textures[id];
@@ -875,14 +1647,16 @@ bool RenderInterface::readTexture(RRID id, Image& img) {
 
     glBindTexture(tex.target, tex.id);
     for (uint32 lvl = 0; lvl < fmt.levels; ++lvl)
-        glGetTexImage(tex.target, 0, tex.format, tex.pType, img.data(lvl));
+        getTexImage(tex, tex.target, lvl, img.data(lvl));
     glBindTexture(tex.target, 0);
 
     return true;
 }
 
 bool RenderInterface::readCubemap(RRID id, Cubemap& cube) {
-    if (id < 0 || id >= _textures.size())
+    RHI_CALL();
+
+    if (!_textures.valid(id))
         return false; // Error
 
     RHITexture tex = _textures[id];
@@ -898,14 +1672,16 @@ bool RenderInterface::readCubemap(RRID id, Cubemap& cube) {
     glBindTexture(tex.target, tex.id);
     for (uint32 f = 0; f < 6; ++f)
         for (uint32 lvl = 0; lvl < fmt.levels; ++lvl)
-            glGetTexImage(tex.target, 0, tex.format, tex.pType, cube.data((CubemapFace)f, lvl));
+            getTexImage(tex, GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, lvl, cube.data((CubemapFace)f, lvl));
     glBindTexture(tex.target, 0);
 
     return true;
 }
 
 void RenderInterface::generateMipmaps(RRID id) {
-    if (id < 0 || id >= _textures.size())
+    RHI_CALL();
+
+    if (!_textures.valid(id))
         return; // Error
     
     RHITexture ogltex = _textures[id];
@@ -917,8 +1693,10 @@ void RenderInterface::generateMipmaps(RRID id) {
     glBindTexture(ogltex.target, 0);
 }
 
-void RenderInterface::setTextureData(RRID id, uint32 level, const void* pixels) {
-    if (id < 0 || id >= _textures.size())
+void RenderInterface::setTextureData(RRID id, uint32 level, const void* pixels, uint32 face) {
+    RHI_CALL();
+
+    if (!_textures.valid(id))
         return; // Error
 
     RHITexture ogltex = _textures[id];
@@ -926,55 +1704,696 @@ void RenderInterface::setTextureData(RRID id, uint32 level, const void* pixels)
         return; // Error
 
     glBindTexture(ogltex.target, ogltex.id);
+    texSubImage(ogltex, face, level, pixels);
+    glBindTexture(ogltex.target, 0);
+}
 
-    GLsizei width  = ogltex.tex->width();
-    GLsizei height = ogltex.tex->height();
-    GLsizei depth  = ogltex.tex->depth();
+void RenderInterface::uploadTexture(RRID id, uint32 face, uint32 level, const StagingRegion& region, size_t offset) {
+    RHI_CALL();
 
-    const TexFormat& fmt = ogltex.tex->format();
-    GLenum type = OGLTexPixelTypes[fmt.pType];
-    if (fmt.imgType == IMGTYPE_2D)
-        glTexImage2D(ogltex.target, level, ogltex.intFormat, width, height, 0, ogltex.format, type, pixels);
-    else if (fmt.imgType == IMGTYPE_1D)
-        glTexImage1D(ogltex.target, level, ogltex.intFormat, width, 0, ogltex.format, type, pixels);
-    else if (fmt.imgType == IMGTYPE_3D)
-        glTexImage3D(ogltex.target, level, ogltex.intFormat, width, height, depth, 0, ogltex.format, type, pixels);
+    if (!_textures.valid(id))
+        return; // Error
+
+    RHITexture ogltex = _textures[id];
+    if (ogltex.id == 0 || offset >= region.size)
+        return; // Error
+
+    glBindTexture(ogltex.target, ogltex.id);
+
+    issueStaging(region);
+
+    // With the unpack buffer bound the driver reads the pixels on its own time
+    if (_staging.persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _staging.buffer);
+        texSubImage(ogltex, face, level, (const void*)(region.offset + offset));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        texSubImage(ogltex, face, level, region.ptr + offset);
+    }
 
     glBindTexture(ogltex.target, 0);
 }
 
+void RenderInterface::submitStaging() {
+    RHI_CALL();
+
+    // Uploads from client memory are copied before glTexSubImage returns
+    if (!_staging.persistent) {
+        auto issued = [](const RHIStagingRange& range) { return range.issued; };
+        _staging.ranges.erase(std::remove_if(_staging.ranges.begin(), _staging.ranges.end(), issued), _staging.ranges.end());
+        return;
+    }
+
+    // One fence covers every range issued since the last submit
+    GLsync fence = 0;
+    for (RHIStagingRange& range : _staging.ranges) {
+        if (range.fence != 0 || !range.issued)
+            continue;
+
+        if (fence == 0)
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        range.fence = fence;
+    }
+}
+
+void RenderInterface::createStaging() {
+    _staging.size = STAGING_BUFFER_SIZE;
+    _staging.head = 0;
+
+    // Same scheme as ring buffers, without immutable storage the uploads read client memory directly
+    _staging.persistent = GLEW_ARB_buffer_storage == GL_TRUE;
+    if (_staging.persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &_staging.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _staging.buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _staging.size, nullptr, flags);
+        _staging.ptr = (uint8*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _staging.size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        ++_frameStats.mapCalls;
+        ++_frameStats.buffersCreated;
+    } else {
+        _staging.ptr = new uint8[_staging.size];
+    }
+}
+
+void RenderInterface::retireStaging(bool wait) {
+    while (!_staging.ranges.empty()) {
+        GLsync fence = _staging.ranges.front().fence;
+        if (fence == 0)
+            return; // Uploads not submitted yet
+
+        // Only the oldest fence is waited for, the next ones are polled
+        GLenum res = glClientWaitSync(fence, 0, 0);
+        while (wait && res == GL_TIMEOUT_EXPIRED)
+            res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        if (res == GL_TIMEOUT_EXPIRED)
+            return;
+        wait = false;
+
+        _staging.ranges.pop_front();
+
+        // Ranges submitted together share the fence
+        bool shared = false;
+        for (const RHIStagingRange& range : _staging.ranges)
+            shared = shared || range.fence == fence;
+
+        if (!shared)
+            glDeleteSync(fence);
+    }
+}
+
 bool RenderInterface::deleteTexture(RRID id) {
-    if (id < (int64)_textures.size() && id != -1) {
-        GLuint oglId = _textures[id].id;
-        if (oglId != 0) {
-            glDeleteTextures(1, &oglId);
-            _textures[id].id = 0;
-            return true;
-        }
+    RHI_CALL();
+
+    if (!_textures.valid(id))
+        return false; // Error
+
+    GLuint oglId = _textures[id].id;
+    if (oglId != 0) {
+        ++_frameStats.texturesDeleted;
+        glDeleteTextures(1, &oglId);
     }
 
-    return false;
+    // Frees the slot and drops the RHI reference to the texture object
+    return _textures.remove(id);
 }
 
 void RenderInterface::bindTexture(RRID id) {
-    if (id < 0 || id >= _textures.size())
+    RHI_CALL();
+
+    if (!_textures.valid(id))
         return; // Error
 
     RHITexture ogltex = _textures[id];
     if (ogltex.id == 0)
         return; // Error
 
+    ++_frameStats.textureBinds;
     glBindTexture(ogltex.target, ogltex.id);
 }
 
 void RenderInterface::bindTexture(uint32 slot, RRID id) {
+    RHI_CALL();
+
     glActiveTexture(GL_TEXTURE0 + slot);
     bindTexture(id);
 }
 
 sref<Image> RenderInterface::getImage(int32 x, int32 y, int32 w, int32 h) const {
+    RHI_CALL();
+
     sref<Image> img = make_sref<Image>();
     img->init(IMGFMT_RGB8, w, h, 1, 1);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glReadPixels(x, y, w, h, GL_RGB, GL_UNSIGNED_BYTE, img->data());
     return img;
-}
\ No newline at end of file
+}
+
+/* ===================================================================================
+        Frame timing
+=====================================================================================*/
+void RenderInterface::beginFrame() {
+    RHI_CALL();
+
+    // Created on first use, the constructor runs before there is a context
+    if (_frameQueries[0] == 0) {
+        glGenQueries(NUM_RING_FRAMES, _frameQueries);
+        for (RHIQueryPool& pool : _passPools)
+            glGenQueries(MAX_GPU_PASSES * 2, pool.queries);
+    }
+
+    readFrameQueries();
+    readPassQueries();
+
+    // A query still in flight after NUM_RING_FRAMES frames is dropped instead of waited on
+    _frameQueryPending[_frameQuery] = false;
+    _frameQueryFrame[_frameQuery]   = _frameIndex;
+    glBeginQuery(GL_TIME_ELAPSED, _frameQueries[_frameQuery]);
+
+    RHIQueryPool& pool = _passPools[_frameQuery];
+    pool.numPasses = 0;
+    pool.frame     = _frameIndex;
+    pool.pending   = false;
+    _passDepth     = 0;
+}
+
+void RenderInterface::endFrame() {
+    RHI_CALL();
+
+    glEndQuery(GL_TIME_ELAPSED);
+
+    // Staging memory freed by the uploads the GPU finished
+    retireStaging(false);
+
+    // Work done between frames (loading, streaming) is counted in the next frame
+    _lastFrameStats = _frameStats;
+    memset(&_frameStats, 0, sizeof(RHIFrameStats));
+
+    // Close passes left open so the pool only holds complete pairs
+    while (_passDepth > 0)
+        endGPUPass();
+
+    _frameQueryPending[_frameQuery] = true;
+    _passPools[_frameQuery].pending = _passPools[_frameQuery].numPasses > 0;
+    _frameQuery = (_frameQuery + 1) % NUM_RING_FRAMES;
+    ++_frameIndex;
+}
+
+void RenderInterface::beginGPUPass(const char* name) {
+    RHI_CALL();
+
+    // Nested deeper than the stack, the pass is not timed but its end must not close the enclosing one
+    if (_passDepth >= MAX_GPU_PASSES) {
+        ++_passDepth;
+        return;
+    }
+
+    RHIQueryPool& pool = _passPools[_frameQuery];
+
+    // Out of queries, the pass is not timed but still has to be closed
+    if (pool.numPasses >= MAX_GPU_PASSES || _frameQueries[0] == 0) {
+        _passStack[_passDepth++] = -1;
+        return;
+    }
+
+    uint32 pass = pool.numPasses++;
+    pool.names[pass] = name;
+    glQueryCounter(pool.queries[pass * 2], GL_TIMESTAMP);
+    pool.lastQuery = pool.queries[pass * 2];
+
+    _passStack[_passDepth++] = (int32)pass;
+}
+
+void RenderInterface::endGPUPass() {
+    RHI_CALL();
+
+    if (_passDepth == 0)
+        return; // Error
+
+    if (--_passDepth >= MAX_GPU_PASSES)
+        return;
+
+    int32 pass = _passStack[_passDepth];
+    if (pass < 0)
+        return;
+
+    RHIQueryPool& pool = _passPools[_frameQuery];
+    glQueryCounter(pool.queries[pass * 2 + 1], GL_TIMESTAMP);
+    pool.lastQuery = pool.queries[pass * 2 + 1];
+}
+
+void RenderInterface::readPassQueries() {
+    // Same order as the frame queries, stop at the first pool not ready
+    for (uint32 q = 0; q < NUM_RING_FRAMES; ++q) {
+        RHIQueryPool& pool = _passPools[(_frameQuery + q) % NUM_RING_FRAMES];
+        if (!pool.pending)
+            continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(pool.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE)
+            break;
+
+        _passTimings.resize(pool.numPasses);
+        for (uint32 p = 0; p < pool.numPasses; ++p) {
+            GLuint64 begin, end;
+            glGetQueryObjectui64v(pool.queries[p * 2],     GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(pool.queries[p * 2 + 1], GL_QUERY_RESULT, &end);
+
+            _passTimings[p].name = pool.names[p];
+            _passTimings[p].time = (float)((double)(end - begin) / 1000000.0);
+        }
+
+        _passFrameIndex = pool.frame;
+        pool.pending = false;
+    }
+}
+
+void RenderInterface::readFrameQueries() {
+    // Oldest query first, queries complete in order so stop at the first one not ready
+    for (uint32 q = 0; q < NUM_RING_FRAMES; ++q) {
+        uint32 idx = (_frameQuery + q) % NUM_RING_FRAMES;
+        if (!_frameQueryPending[idx])
+            continue;
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(_frameQueries[idx], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available == GL_FALSE)
+            break;
+
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(_frameQueries[idx], GL_QUERY_RESULT, &elapsed);
+
+        _gpuFrameTime  = (float)((double)elapsed / 1000000.0);
+        _gpuFrameIndex = _frameQueryFrame[idx];
+        _frameQueryPending[idx] = false;
+    }
+}
+
+bool RenderInterface::gpuMemoryInfo(uint64& usedKB, uint64& totalKB) const {
+    if (GLEW_NVX_gpu_memory_info == GL_FALSE)
+        return false;
+
+    GLint total, available;
+    glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+    glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+
+    totalKB = (uint64)total;
+    usedKB  = (uint64)(total - available);
+    return true;
+}
+
+/* ===================================================================================
+        Debug output
+=====================================================================================*/
+static const char* glErrorName(GLenum error) {
+    switch (error) {
+    case GL_INVALID_ENUM:                  return "GL_INVALID_ENUM";
+    case GL_INVALID_VALUE:                 return "GL_INVALID_VALUE";
+    case GL_INVALID_OPERATION:             return "GL_INVALID_OPERATION";
+    case GL_INVALID_FRAMEBUFFER_OPERATION: return "GL_INVALID_FRAMEBUFFER_OPERATION";
+    case GL_OUT_OF_MEMORY:                 return "GL_OUT_OF_MEMORY";
+    default:                               return "Unknown error";
+    }
+}
+
+static const char* debugSourceName(GLenum source) {
+    switch (source) {
+    case GL_DEBUG_SOURCE_API:             return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "Window system";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY:     return "Third party";
+    case GL_DEBUG_SOURCE_APPLICATION:     return "Application";
+    default:                              return "Other";
+    }
+}
+
+static const char* debugTypeName(GLenum type) {
+    switch (type) {
+    case GL_DEBUG_TYPE_ERROR:               return "error";
+    case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+    case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behavior";
+    case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+    case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+    default:                                return "message";
+    }
+}
+
+static const char* debugSeverityName(GLenum severity) {
+    switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH:   return "HIGH";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
+    case GL_DEBUG_SEVERITY_LOW:    return "LOW";
+    default:                       return "INFO";
+    }
+}
+
+static void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                     GLsizei length, const GLchar* message, const void* userParam) {
+    std::ostream& out = type == GL_DEBUG_TYPE_ERROR ? std::cerr : std::cout;
+
+    out << "[GL " << debugSeverityName(severity) << "] " << debugSourceName(source) << " "
+        << debugTypeName(type) << " " << id;
+
+    // Only known with synchronous output, the message is then sent from inside the RHI call
+    const char* call = RHICallScope::current();
+    if (call)
+        out << " in " << call;
+
+    out << ": " << message << std::endl;
+}
+
+bool RenderInterface::enableDebugOutput(DebugSeverity minSeverity) {
+    if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug)
+        return false;
+
+    glEnable(GL_DEBUG_OUTPUT);
+#ifdef PBR_GL_CHECKS
+    // Messages are reported by the thread and call that caused them, at the cost of driver parallelism
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+    glDebugMessageCallback(debugCallback, nullptr);
+
+    setDebugSeverity(minSeverity);
+    return true;
+}
+
+void RenderInterface::setDebugSeverity(DebugSeverity minSeverity) {
+    if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug)
+        return;
+
+    const GLenum severities[] = {
+        GL_DEBUG_SEVERITY_NOTIFICATION,
+        GL_DEBUG_SEVERITY_LOW,
+        GL_DEBUG_SEVERITY_MEDIUM,
+        GL_DEBUG_SEVERITY_HIGH
+    };
+
+    for (int32 s = DEBUG_NOTIFICATION; s <= DEBUG_HIGH; ++s)
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severities[s], 0, nullptr, s >= minSeverity);
+}
+
+bool RenderInterface::checkOpenGLError(const char* call) {
+    bool isError = false;
+    GLenum errCode;
+    while ((errCode = glGetError()) != GL_NO_ERROR) {
+        isError = true;
+        std::cerr << "OpenGL ERROR [" << glErrorName(errCode) << "] in " << call << "." << std::endl;
+    }
+    return isError;
+}
+
+#endif
+
+/* ===================================================================================
+        Backend independent
+=====================================================================================*/
+// Innermost RHI call of the thread, only GL calls made from it are attributed to it
+static thread_local const char* currentCall = nullptr;
+
+RHICallScope::RHICallScope(const char* call) : _call(call), _prev(currentCall) {
+    // Errors left by GL code outside of the RHI (GUI, windowing) are not blamed on this call
+    if (!_prev)
+        RenderInterface::get().checkOpenGLError("GL code outside of the RHI");
+
+    currentCall = call;
+}
+
+RHICallScope::~RHICallScope() {
+    RenderInterface::get().checkOpenGLError(_call);
+    currentCall = _prev;
+}
+
+const char* RHICallScope::current() {
+    return currentCall;
+}
+
+RenderInterface& RenderInterface::get() {
+    static RenderInterface _inst;
+    return _inst;
+}
+
+void RenderInterface::loadShaderVariants() {
+    // Same bit order as MaterialFeature
+    const vec<std::string> features = { "HAS_DIFFUSE_TEX", "HAS_NORMAL_MAP", "HAS_METALLIC_TEX", "HAS_ROUGH_TEX" };
+
+    // Blocks a program doesn't declare are skipped (objectBlock in instanced and indirect programs)
+    auto setup = [this](RRID prog) {
+        useProgram(prog);
+        setSampler("irradianceTex", 6);
+        setSampler("ggxTex",        7);
+        setSampler("brdfTex",       8);
+        setBufferBlock("cameraBlock",   CAMERA_BUFFER_IDX);
+        setBufferBlock("rendererBlock", RENDERER_BUFFER_IDX);
+        setBufferBlock("lightBlock",    LIGHTS_BUFFER_IDX);
+        setBufferBlock("objectBlock",   OBJECT_BUFFER_IDX);
+        setBufferBlock("materialBlock", MATERIAL_BUFFER_IDX);
+        useProgram(0);
+    };
+
+    // Unreal shader, its instanced variant and the multi-draw indirect one (needs GL 4.3)
+    vec<std::string> names = { "unreal", "unreal_instanced" };
+    if (supportsIndirectDraws())
+        names.push_back("unreal_indirect");
+
+    // Generic programs of all families are submitted before waiting on any, so the driver links them in parallel
+    vec<sref<ShaderVariants>> families;
+    for (const std::string& name : names) {
+        vec<ShaderStage> stages = { { VERTEX_SHADER,   name + ".vs", false },
+                                    { FRAGMENT_SHADER, "unreal.fs",  true  },
+                                    { FRAGMENT_SHADER, "common.fs",  false } };
+
+        families.push_back(make_sref<ShaderVariants>(name, stages, features, setup));
+    }
+
+    for (const sref<ShaderVariants>& variants : families) {
+        variants->finish();
+        Resource.addShaderVariants(variants->name(), variants);
+        Resource.addShader(variants->name(), variants->generic());
+    }
+}
+
+sref<Texture> RenderInterface::getTexture(RRID id) {
+    if (!_textures.valid(id))
+        return nullptr; // Error
+
+    RHITexture tex = _textures[id];
+    if (tex.id == 0 || tex.tex == nullptr)
+        return nullptr; // Error
+
+    return tex.tex;
+}
+
+bool RenderInterface::arenaDrawCommand(RRID id, DrawIndirectCommand& cmd) const {
+    if (!_arenaGeometry.valid(id))
+        return false; // Error
+
+    const RHIArenaGeometry& sub = _arenaGeometry[id];
+
+    cmd.count         = sub.numIndices;
+    cmd.instanceCount = 1;
+    cmd.firstIndex    = sub.firstIndex;
+    cmd.baseVertex    = (int32)sub.baseVertex;
+    cmd.baseInstance  = 0;
+
+    return true;
+}
+
+RRID RenderInterface::ringStorage(RRID id) const {
+    if (!_rings.valid(id))
+        return -1; // Error
+
+    return _rings[id].buffer;
+}
+
+size_t RenderInterface::uniformAlignment() const {
+    return _uniformAlign;
+}
+
+int64 RenderInterface::frameIndex() const {
+    return _frameIndex;
+}
+
+float RenderInterface::gpuFrameTime() const {
+    return _gpuFrameTime;
+}
+
+int64 RenderInterface::gpuFrameIndex() const {
+    return _gpuFrameIndex;
+}
+
+const RHIFrameStats& RenderInterface::frameStats() const {
+    return _lastFrameStats;
+}
+
+const vec<GPUPassTiming>& RenderInterface::gpuPassTimings() const {
+    return _passTimings;
+}
+
+int64 RenderInterface::gpuPassFrameIndex() const {
+    return _passFrameIndex;
+}
+
+uint8* RenderInterface::allocRingBuffer(RRID id, size_t size, size_t& offset) {
+    if (!_rings.valid(id))
+        return nullptr; // Error
+
+    RHIRingBuffer& ring = _rings[id];
+
+    size_t start = alignSize(ring.head, ring.alignment);
+    size_t end   = start + alignSize(size, 16);
+    if (end > ring.frameSize)
+        return nullptr; // Error, frame region is full
+
+    ring.head = end;
+    offset    = ring.frame * ring.frameSize + start;
+
+    _frameStats.bytesUploaded += size;
+
+    return ring.ptr + offset;
+}
+
+size_t RenderInterface::ringBlockSize(RRID id, size_t size) const {
+    if (!_rings.valid(id))
+        return 0; // Error
+
+    // Allocations are padded to 16 bytes and start aligned
+    return alignSize(alignSize(size, 16), _rings[id].alignment);
+}
+
+bool RenderInterface::writeRingBuffer(RRID id, size_t size, const void* data, size_t& offset) {
+    uint8* ptr = allocRingBuffer(id, size, offset);
+    if (ptr == nullptr)
+        return false; // Error
+
+    memcpy(ptr, data, size);
+    return true;
+}
+
+bool RenderInterface::allocStaging(size_t size, StagingRegion& region) {
+    if (_staging.ptr == nullptr)
+        createStaging();
+
+    size = alignSize(size, STAGING_ALIGNMENT);
+    if (size == 0 || size > _staging.size)
+        return false; // Error, never fits
+
+    retireStaging(false);
+
+    size_t begin;
+    while (!findStaging(size, begin)) {
+        // Ranges waiting for their uploads cannot be recycled
+        if (_staging.ranges.empty() || _staging.ranges.front().fence == 0)
+            return false;
+
+        retireStaging(true);
+    }
+
+    _staging.head = begin + size;
+    _staging.ranges.push_back({ begin, begin + size, 0, false });
+
+    region.ptr    = _staging.ptr + begin;
+    region.offset = begin;
+    region.size   = size;
+
+    _frameStats.bytesUploaded += size;
+
+    return true;
+}
+
+void RenderInterface::issueStaging(const StagingRegion& region) {
+    // Recent regions are at the back
+    for (auto it = _staging.ranges.rbegin(); it != _staging.ranges.rend(); ++it) {
+        if (it->begin == region.offset) {
+            it->issued = true;
+            return;
+        }
+    }
+}
+
+bool RenderInterface::findStaging(size_t size, size_t& begin) const {
+    if (_staging.ranges.empty()) {
+        begin = 0;
+        return true;
+    }
+
+    // Oldest range still in use, head == tail means the ring is full
+    size_t tail = _staging.ranges.front().begin;
+    size_t head = _staging.head;
+
+    if (head > tail) {
+        if (head + size <= _staging.size) {
+            begin = head;
+            return true;
+        }
+
+        // Wrap around
+        begin = 0;
+        return size <= tail;
+    }
+
+    begin = head;
+    return head < tail && head + size <= tail;
+}
+
+void RenderInterface::execute(const CommandBuffer& cmds) {
+    const uint8* ptr = cmds.data();
+    const uint8* end = ptr + cmds.size();
+
+    // Skip program changes recorded back to back with the same program
+    RRID program = -1;
+
+    while (ptr < end) {
+        const CommandHeader* header = (const CommandHeader*)ptr;
+
+        switch (header->type) {
+        case CMD_USE_PROGRAM: {
+            const CmdUseProgram* cmd = (const CmdUseProgram*)ptr;
+            if (cmd->program != program)
+                useProgram(cmd->program);
+            program = cmd->program;
+            break;
+        }
+        case CMD_BIND_RING_RANGE: {
+            const CmdBindRingRange* cmd = (const CmdBindRingRange*)ptr;
+            bindRingRange(cmd->ring, cmd->index, (size_t)cmd->offset, (size_t)cmd->size);
+            break;
+        }
+        case CMD_BIND_BUFFER_RANGE: {
+            const CmdBindBufferRange* cmd = (const CmdBindBufferRange*)ptr;
+            bindBufferRange(cmd->buffer, cmd->index, (size_t)cmd->offset, (size_t)cmd->size);
+            break;
+        }
+        case CMD_BIND_TEXTURE: {
+            const CmdBindTexture* cmd = (const CmdBindTexture*)ptr;
+            bindTexture(cmd->slot, cmd->texture);
+            break;
+        }
+        case CMD_BIND_MATERIAL: {
+            const CmdBindMaterial* cmd = (const CmdBindMaterial*)ptr;
+            cmd->material->uploadData();
+            break;
+        }
+        case CMD_DRAW_GEOMETRY: {
+            const CmdDrawGeometry* cmd = (const CmdDrawGeometry*)ptr;
+            drawGeometry(cmd->geometry);
+            break;
+        }
+        case CMD_DRAW_INSTANCED: {
+            const CmdDrawGeometry* cmd = (const CmdDrawGeometry*)ptr;
+            drawGeometryInstanced(cmd->geometry, cmd->numInstances);
+            break;
+        }
+        case CMD_INSTANCE_LAYOUT: {
+            const CmdInstanceLayout* cmd = (const CmdInstanceLayout*)ptr;
+            setInstanceLayout(cmd->vertArray, cmd->buffer, (size_t)cmd->offset, *cmd->layout);
+            break;
+        }
+        default:
+            return; // Error, corrupt command buffer
+        }
+
+        ptr += header->size;
+    }
+}
@@ -3,19 +3,32 @@
 
 #include <GL/glew.h>
 
+#include <deque>
+
 #include <PBR.h>
 #include <PBRMath.h>
 #include <Shader.h>
 #include <Image.h>
+#include <ResourcePool.h>
+#include <ProgramCache.h>
 
 // Macro to syntax sugar the singleton getter
 #define RHI RenderInterface::get()
 
+// With PBR_GL_CHECKS, glGetError is polled when leaving each RHI call and GL messages name that call,
+// otherwise only the debug output callback is kept, which never stalls the driver
+#ifdef PBR_GL_CHECKS
+#define RHI_CALL() pbr::RHICallScope _rhiCallScope(__FUNCTION__)
+#else
+#define RHI_CALL()
+#endif
+
 using namespace pbr::math;
 
 namespace pbr {
 
     class Geometry;
+    class CommandBuffer;
     class TexSampler;
     class Texture;
 
@@ -31,11 +44,15 @@ namespace pbr {
         GLuint      id;
         GLsizei     numIndices;
         GLsizei     numVertices;
-        vec<GLuint> buffers;
+        vec<RRID>   buffers;     // Owned, deleted with the vertex array
     };
     
     struct RHIProgram {
-        GLuint id;
+        GLuint        id;
+        ProgramStatus status;
+        uint64        cacheKey;  // Binary cache entry, written once the link succeeds
+        vec<GLuint>   shaders;   // Attached until the link is over
+        std::string   name;
     };
 
     struct RHITexture {
@@ -52,10 +69,94 @@ namespace pbr {
         GLenum target;
     };
 
+    // Geometry sub-allocated from shared vertex and index buffers
+    struct RHIGeometryArena {
+        RRID   vertArray;
+        RRID   vertexBuffer;
+        RRID   indexBuffer;
+        RRID   drawIdBuffer;
+        uint32 maxVertices;
+        uint32 maxIndices;
+        uint32 numVertices;
+        uint32 numIndices;
+    };
+
+    struct RHIArenaGeometry {
+        RRID   arena;
+        uint32 baseVertex;
+        uint32 firstIndex;
+        uint32 numIndices;
+    };
+
+    // Layout defined by glMultiDrawElementsIndirect
+    struct DrawIndirectCommand {
+        uint32 count;
+        uint32 instanceCount;
+        uint32 firstIndex;
+        int32  baseVertex;
+        uint32 baseInstance;
+    };
+
+    // Attribute holding the draw index of indirect draws (instanced, offset by baseInstance)
+    static PBR_CONSTEXPR uint32 DRAW_ID_ATTRIB = 12;
+
+    // Number of frames a ring buffer can have in flight
+    static PBR_CONSTEXPR uint32 NUM_RING_FRAMES = 3;
+
+    struct RHIRingBuffer {
+        RRID        buffer;
+        size_t      frameSize;
+        size_t      alignment;
+        size_t      head;       // Write position inside the current frame region
+        size_t      flushed;    // Bytes already sent to the GPU (non persistent mode)
+        uint32      frame;
+        uint8*      ptr;        // Persistent mapping or CPU shadow storage
+        bool        persistent;
+        GLsync      fences[NUM_RING_FRAMES];
+    };
+
+    // Memory texture data is copied into before the GL thread uploads it
+    static PBR_CONSTEXPR size_t STAGING_BUFFER_SIZE = 32 * 1024 * 1024;
+    static PBR_CONSTEXPR size_t STAGING_ALIGNMENT   = 256;
+
+    // Staging memory handed out by allocStaging, ptr can be written from any thread
+    struct StagingRegion {
+        uint8* ptr;
+        size_t offset;  // Inside the staging buffer
+        size_t size;
+    };
+
+    struct RHIStagingRange {
+        size_t begin;
+        size_t end;
+        GLsync fence;   // Uploads reading the range, 0 until they are submitted
+        bool   issued;  // Uploads were issued, the range can be submitted
+    };
+
+    // Staging memory used as a ring, ranges are recycled in allocation order once their fence signaled
+    struct RHIStaging {
+        GLuint  buffer;
+        uint8*  ptr;        // Persistent mapping or CPU storage
+        size_t  size;
+        size_t  head;
+        bool    persistent;
+        std::deque<RHIStagingRange> ranges;
+    };
+
     enum BufferType {
-        BUFFER_VERTEX = 0,
-        BUFFER_INDEX  = 1,
-        BUFFER_SHARED = 2
+        BUFFER_VERTEX   = 0,
+        BUFFER_INDEX    = 1,
+        BUFFER_SHARED   = 2,
+        BUFFER_STORAGE  = 3,
+        BUFFER_INDIRECT = 4
+    };
+
+    // Ordered, messages below the filter severity are dropped
+    enum DebugSeverity {
+        DEBUG_NOTIFICATION = 0,
+        DEBUG_LOW          = 1,
+        DEBUG_MEDIUM       = 2,
+        DEBUG_HIGH         = 3
     };
 
     enum BufferUsage {
@@ -84,6 +185,58 @@ namespace pbr {
         BufferLayoutEntry* entries;
     };
 
+    // Maximum number of GPU passes timed in a frame
+    static PBR_CONSTEXPR uint32 MAX_GPU_PASSES = 16;
+
+    // Timestamp queries of the passes of one frame
+    struct RHIQueryPool {
+        GLuint      queries[MAX_GPU_PASSES * 2];    // Begin and end timestamp of each pass
+        const char* names[MAX_GPU_PASSES];
+        uint32      numPasses;
+        int64       frame;      // frameIndex() of the frame the passes belong to
+        GLuint      lastQuery;  // Written last, results arrive in order so it is ready last
+        bool        pending;
+    };
+
+    struct GPUPassTiming {
+        const char* name;
+        float       time;   // ms
+    };
+
+    // Per-frame statistics, everything since the previous endFrame
+    struct RHIFrameStats {
+        uint32 drawCalls;
+        uint64 triangles;
+        uint32 programSwitches;
+        uint32 textureBinds;
+        uint32 uniformCalls;
+        uint64 bytesUploaded;       // Buffer data written by the CPU, ring and staging allocations included
+        uint32 mapCalls;            // Map and unmap calls
+        uint32 texturesCreated;
+        uint32 texturesDeleted;
+        uint32 buffersCreated;
+        uint32 buffersDeleted;
+    };
+
+#ifdef PBR_NULL_RHI
+    // Calls seen by the null backend since the last reset
+    struct NullRHICounters {
+        uint64 calls;
+        uint64 draws;
+        uint64 programBinds;
+        uint64 textureBinds;
+        uint64 bufferBinds;
+        uint64 bufferUpdates;
+        uint64 uniformSets;
+        uint64 resources;
+        uint64 invalidCalls;    // Calls rejected by argument validation
+    };
+#endif
+
+    inline size_t alignSize(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
     class RenderInterface {
     public:
         ~RenderInterface();
@@ -97,17 +250,37 @@ namespace pbr {
         =====================================================================================*/
         RRID createTexture(const Image& img, const TexSampler& sampler);
         RRID createTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height,
-                                    uint32 depth, const TexSampler& sampler);
+                                    uint32 depth, const TexSampler& sampler, uint32 numLevels = 1);
         RRID createCubemap(const Cubemap& cube, const TexSampler& sampler);
 
         sref<Texture> getTexture(RRID id);
         bool readTexture(RRID id, Image& img);
         bool readCubemap(RRID id, Cubemap& cube);
 
+        // Block compressed formats the driver can sample, uploads of other compressed formats fail
+        bool supportsCompressedFormat(ImageFormat fmt) const;
+
         void generateMipmaps(RRID id);
-        void setTextureData(RRID id, uint32 level, const void* pixels);
+        void setTextureData(RRID id, uint32 level, const void* pixels, uint32 face = 0);
         bool deleteTexture(RRID id);
 
+        // Staging memory for texture data, false when it does not fit next to the uploads not submitted yet
+        // The memory can be filled from any thread, allocations and uploads stay on the GL thread
+        bool allocStaging(size_t size, StagingRegion& region);
+        // Level of a texture (face of a cubemap) read from staging memory, offset is relative to the region
+        void uploadTexture(RRID id, uint32 face, uint32 level, const StagingRegion& region, size_t offset);
+        // Fences the uploads issued so far, their staging memory is reused once the GPU is done with them
+        // Regions still being filled stay reserved until their uploads are issued and submitted
+        void submitStaging();
+
+        // Streamed textures keep mutable storage so levels can be allocated and freed one at a time
+        // Sampling is clamped to the resident levels with GL_TEXTURE_BASE_LEVEL, no level is resident at first
+        RRID createStreamedTexture(ImageType type, ImageFormat fmt, uint32 width, uint32 height,
+                                   const TexSampler& sampler, uint32 numLevels);
+        void allocTextureLevel(RRID id, uint32 level);
+        void freeTextureLevel (RRID id, uint32 level);
+        void setBaseLevel     (RRID id, uint32 level);
+
         void bindTexture(RRID id);
         void bindTexture(uint32 slot, RRID id);
 
@@ -118,7 +291,17 @@ namespace pbr {
         bool   deleteShader (const ShaderSource& source);
         RRID   linkProgram  (const Shader& shader);
 
-        std::string getProgramError(const Shader& shader);
+        // Asynchronous versions, compiling and linking go on in the driver until the status is polled
+        // With KHR_parallel_shader_compile polling never blocks, without it the first poll waits for the link
+        uint32        submitShader (const ShaderSource& source);
+        RRID          submitProgram(const Shader& shader);
+        ProgramStatus programStatus(RRID id, bool wait = false);
+        bool          deleteProgram(RRID id);
+
+        bool supportsParallelCompile() const;
+
+        std::string getShaderError(uint32 shader);
+        std::string getProgramError(uint32 program);
 
         void useProgram(RRID id);
 
@@ -144,8 +327,21 @@ namespace pbr {
                 Geometry
         =====================================================================================*/
         void drawGeometry(RRID id);
+        void drawGeometryInstanced(RRID id, uint32 numInstances);
         RRID uploadGeometry(const sref<Geometry>& geo);
 
+        /* ===================================================================================
+                Geometry arenas
+        =====================================================================================*/
+        RRID createGeometryArena(uint32 maxVertices, uint32 maxIndices, uint32 maxDraws);
+        RRID uploadGeometry(RRID arena, const sref<Geometry>& geo);
+        bool arenaDrawCommand(RRID id, DrawIndirectCommand& cmd) const;
+        // Ring memory is write only, numTriangles is counted by the caller while writing the commands
+        void multiDrawIndirect(RRID arena, RRID ring, size_t offset, uint32 drawCount, uint64 numTriangles);
+
+        // Needs a GL 4.3 context
+        bool supportsIndirectDraws() const;
+
         /* ===================================================================================
                  Buffers
         =====================================================================================*/
@@ -154,26 +350,162 @@ namespace pbr {
 
         RRID createBuffer(BufferType type, BufferUsage usage, size_t size, void* data);
         void bindBufferBase(RRID buffer, uint32 index);
+        // Offset must be a multiple of uniformAlignment()
+        void bindBufferRange(RRID buffer, uint32 index, size_t offset, size_t size);
         void setBufferLayout(RRID id, uint32 idx, AttribType type, uint32 numElems, uint32 stride, size_t offset);
         void setBufferLayout(RRID id, const BufferLayout& layout);
+        void setInstanceLayout(RRID vertArray, RRID buffer, size_t offset, const BufferLayout& layout);
         bool updateBuffer(RRID id, size_t size, void* data);
+        bool updateBuffer(RRID id, size_t offset, size_t size, const void* data);
         bool deleteBuffer(RRID id);
 
-        bool isOpenGLError();
-        void checkOpenGLError(const std::string& error);
+        /* ===================================================================================
+                 Ring buffers
+        =====================================================================================*/
+        RRID   createRingBuffer(BufferType type, size_t frameSize);
+        // Grows the frame regions to hold at least frameSize bytes, waits for the GPU to release the old storage
+        // Only between frames, ranges handed out before are invalidated
+        void   reserveRingBuffer(RRID id, size_t frameSize);
+        // Bytes an allocation of size takes in a frame region, alignment included
+        size_t ringBlockSize(RRID id, size_t size) const;
+        void   beginRingFrame(RRID id);
+        void   endRingFrame(RRID id);
+        uint8* allocRingBuffer(RRID id, size_t size, size_t& offset);
+        bool   writeRingBuffer(RRID id, size_t size, const void* data, size_t& offset);
+        void   bindRingRange(RRID id, uint32 index, size_t offset, size_t size);
+        RRID   ringStorage(RRID id) const;
+
+        size_t uniformAlignment() const;
+
+        /* ===================================================================================
+                 Command buffers
+        =====================================================================================*/
+        void execute(const CommandBuffer& cmds);
+
+        /* ===================================================================================
+                 Frame timing
+        =====================================================================================*/
+        // Brackets a frame with a GPU timer query, results are read back frames later without stalling
+        void beginFrame();
+        void endFrame();
+
+        // Index of the frame being recorded, counted by endFrame
+        int64 frameIndex() const;
+
+        // GPU time in ms of the newest frame with a result, negative until one is available
+        // Results arrive frames late, gpuFrameIndex() is the frame the time belongs to, -1 before the first one
+        float gpuFrameTime()  const;
+        int64 gpuFrameIndex() const;
+
+        // Statistics of the last finished frame
+        const RHIFrameStats& frameStats() const;
+
+        // Video memory in KB, false when the driver does not report it
+        bool gpuMemoryInfo(uint64& usedKB, uint64& totalKB) const;
+
+        // Named passes inside a frame, timed with GL_TIMESTAMP queries and read back like the frame timer
+        // Passes can nest, names must outlive the frame (string literals)
+        void beginGPUPass(const char* name);
+        void endGPUPass();
+
+        // Pass timings of the newest frame with results, gpuPassFrameIndex() is that frame or -1
+        const vec<GPUPassTiming>& gpuPassTimings() const;
+        int64 gpuPassFrameIndex() const;
+
+        /* ===================================================================================
+                 Debug output
+        =====================================================================================*/
+        // Installs the KHR_debug callback, false when the context does not support it
+        bool enableDebugOutput(DebugSeverity minSeverity);
+        void setDebugSeverity(DebugSeverity minSeverity);
+
+        // Reports pending GL errors for the given call, true if there were any
+        bool checkOpenGLError(const char* call);
 
         sref<Image> getImage(int32 x, int32 y, int32 w, int32 h) const;
+
+#ifdef PBR_NULL_RHI
+        const NullRHICounters& counters() const;
+        void resetCounters();
+#endif
+
     private:
         RenderInterface();
 
-        RRID _currProgram;
-
-        vec<RHIVertArray> _vertArrays;
-        vec<RHIBuffer>    _buffers;
-        vec<RHIProgram>   _programs;
-        vec<RHITexture>   _textures;
+        void flushRingBuffer(RHIRingBuffer& ring);
+        void createRingStorage(RHIRingBuffer& ring);
+        void createStaging();
+        void retireStaging(bool wait);
+        bool findStaging(size_t size, size_t& begin) const;
+        void issueStaging(const StagingRegion& region);
+        void uploadImage(RRID id, uint32 face, const Image& img);
+        void finishProgram(RHIProgram& prog);
+        void loadShaderVariants();
+        void readFrameQueries();
+        void readPassQueries();
+
+        GLuint loadProgramBinary(uint64 key);
+        void   storeProgramBinary(uint64 key, GLuint id);
+
+        RRID   _currProgram;
+        GLuint _currProgramId;
+        size_t _uniformAlign;
+        size_t _storageAlign;
+
+        ResourcePool<RHIVertArray>     _vertArrays;
+        ResourcePool<RHIBuffer>        _buffers;
+        ResourcePool<RHIRingBuffer>    _rings;
+        ResourcePool<RHIGeometryArena> _arenas;
+        ResourcePool<RHIArenaGeometry> _arenaGeometry;
+        ResourcePool<RHIProgram>       _programs;
+        ResourcePool<RHITexture>       _textures;
+
+        RHIStaging _staging;
+
+        // Frame timer queries, one per frame in flight
+        GLuint _frameQueries[NUM_RING_FRAMES];
+        bool   _frameQueryPending[NUM_RING_FRAMES];
+        int64  _frameQueryFrame[NUM_RING_FRAMES];
+        uint32 _frameQuery;
+        int64  _frameIndex;
+        float  _gpuFrameTime;
+        int64  _gpuFrameIndex;
+
+        // Pass timestamp queries, one pool per frame in flight
+        RHIQueryPool _passPools[NUM_RING_FRAMES];
+        int32  _passStack[MAX_GPU_PASSES];
+        uint32 _passDepth;      // Open passes, can exceed the stack
+        vec<GPUPassTiming> _passTimings;
+        int64  _passFrameIndex;
+
+        RHIFrameStats _frameStats;
+        RHIFrameStats _lastFrameStats;
+
+        ProgramCache _programCache;
+        bool         _parallelCompile;
     };  
 
+    // Names the RHI call being executed for error reports, see RHI_CALL
+    class RHICallScope {
+    public:
+        RHICallScope(const char* call);
+        ~RHICallScope();
+
+        // Innermost RHI call on this thread, null outside of RHI calls
+        static const char* current();
+
+    private:
+        const char* _call;
+        const char* _prev;
+    };
+
+    // Times the enclosing scope as a GPU pass
+    class GPUPassScope {
+    public:
+        GPUPassScope(const char* name) { RenderInterface::get().beginGPUPass(name); }
+        ~GPUPassScope() { RenderInterface::get().endGPUPass(); }
+    };
+
 }
 
 #endif
\ No newline at end of file
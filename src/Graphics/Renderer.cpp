@@ -5,12 +5,56 @@
 #include <Shape.h>
 #include <Scene.h>
 #include <Skybox.h>
+#include <Material.h>
 
 #include <RenderInterface.h>
+#include <Resources.h>
+#include <Geometry.h>
+#include <ThreadPool.h>
+#include <Profiler.h>
+#include <ShaderVariants.h>
+#include <TextureStreamer.h>
 
 using namespace pbr;
 
-Renderer::Renderer() : _gamma(2.4f), _exposure(3.0f), _toneParams{ 0.15f, 0.5f, 0.1f, 0.2f, 0.02f, 0.3f, 11.2f }, _drawSkybox(true) { }
+// Instance attributes, matrices take one attribute location per column
+static BufferLayoutEntry instanceEntries[] = {
+    { 4,  4, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, modelMatrix) },
+    { 5,  4, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, modelMatrix) + sizeof(Vec4) },
+    { 6,  4, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, modelMatrix) + sizeof(Vec4) * 2 },
+    { 7,  4, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, modelMatrix) + sizeof(Vec4) * 3 },
+    { 8,  3, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, normalMatrix) },
+    { 9,  3, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, normalMatrix) + sizeof(Vec3) },
+    { 10, 3, ATTRIB_FLOAT, sizeof(InstanceData), offsetof(InstanceData, normalMatrix) + sizeof(Vec3) * 2 },
+    { 11, 1, ATTRIB_UINT,  sizeof(InstanceData), offsetof(InstanceData, materialIdx) } };
+
+static const BufferLayout instanceLayout = { 8, &instanceEntries[0] };
+
+// Page of the material buffer a draw reads, and the index of its block in that page
+static uint32 materialPage(const Material* mat) {
+    return mat ? mat->index() / MAX_MATERIALS : 0;
+}
+
+static uint32 materialIdx(const Material* mat) {
+    return mat ? mat->index() % MAX_MATERIALS : DEFAULT_MATERIAL_SLOT;
+}
+
+// Plain grey dielectric, in the first slot of every page
+static MaterialData defaultMaterialData() {
+    MaterialData data = {};
+    data.diffuse   = Vec4(0.5f, 0.5f, 0.5f, 1.0f);
+    data.specular  = Vec4(0.04f, 0.04f, 0.04f, 1.0f);
+    data.metallic  = 0.0f;
+    data.roughness = 0.5f;
+    return data;
+}
+
+
+Renderer::Renderer() : _gamma(2.4f), _exposure(3.0f), _toneParams{ 0.15f, 0.5f, 0.1f, 0.2f, 0.02f, 0.3f, 11.2f },
+                       _drawSkybox(true), _instancing(true), _indirect(false), _threadedRecording(false), _viewHeight(1080.0f),
+                       _frame(nullptr), _materialBuffer(-1), _materialPages(0), _materialPageSize(0), _materialPage(~0u),
+                       _variants(nullptr), _variantGeneration(0), _instancedVariants(nullptr),
+                       _arena(-1), _drawRing(-1), _indirectVariants(nullptr) { }
 
 void Renderer::setGamma(float gamma) {
     _gamma = gamma;
@@ -36,10 +80,53 @@ const float* Renderer::toneParams() const {
     return &_toneParams[0];
 }
 
+RendererParams Renderer::params() const {
+    RendererParams params;
+    params.gamma    = _gamma;
+    params.exposure = _exposure;
+    memcpy(params.toneParams, _toneParams, sizeof(float) * 7);
+
+    params.drawSkybox        = _drawSkybox;
+    params.instancing        = _instancing;
+    params.indirect          = _indirect;
+    params.threadedRecording = _threadedRecording;
+    params.viewHeight        = _viewHeight;
+
+    return params;
+}
+
+void Renderer::setParams(const RendererParams& params) {
+    _gamma    = params.gamma;
+    _exposure = params.exposure;
+    memcpy(_toneParams, params.toneParams, sizeof(float) * 7);
+
+    setSkyboxDraw(params.drawSkybox);
+    setInstancing(params.instancing);
+    setIndirectDraws(params.indirect);
+    setThreadedRecording(params.threadedRecording);
+    setViewHeight(params.viewHeight);
+}
+
 void Renderer::setSkyboxDraw(bool state) {
     _drawSkybox = state;
 }
 
+void Renderer::setInstancing(bool state) {
+    _instancing = state;
+}
+
+void Renderer::setIndirectDraws(bool state) {
+    _indirect = state && RHI.supportsIndirectDraws();
+}
+
+void Renderer::setThreadedRecording(bool state) {
+    _threadedRecording = state;
+}
+
+void Renderer::setViewHeight(float height) {
+    _viewHeight = height;
+}
+
 void Renderer::uploadLightsBuffer(const Scene& scene) {
     const vec<sref<Light>>& lights = scene.lights();
 
@@ -49,23 +136,57 @@ void Renderer::uploadLightsBuffer(const Scene& scene) {
 
     // Copy light data to buffer
     // Only send NUM_LIGHTS at maximum
-    uint32 numLights = min(NUM_LIGHTS, lights.size());
-    for (uint32 l = 0; l < numLights; ++l)
-        lights[l]->toData(data[l]);
+    if (_frame) {
+        uint32 numLights = min(NUM_LIGHTS, _frame->lights.size());
+        for (uint32 l = 0; l < numLights; ++l)
+            data[l] = _frame->lights[l];
+    } else {
+        uint32 numLights = min(NUM_LIGHTS, lights.size());
+        for (uint32 l = 0; l < numLights; ++l)
+            lights[l]->toData(data[l]);
+    }
     
     // Upload the buffer to the GPU
-    RHI.updateBuffer(_lightsBuffer, sizeof(LightData) * NUM_LIGHTS, &data);
+    size_t offset;
+    if (RHI.writeRingBuffer(_ringBuffer, sizeof(LightData) * NUM_LIGHTS, &data, offset))
+        RHI.bindRingRange(_ringBuffer, LIGHTS_BUFFER_IDX, offset, sizeof(LightData) * NUM_LIGHTS);
 }
 
-void Renderer::uploadCameraBuffer(const Camera& camera) {
-    CameraData data;
-    data.viewMatrix     = camera.viewMatrix();
-    data.projMatrix     = camera.projMatrix();
-    data.viewPos        = camera.position();
-    data.viewProjMatrix = camera.viewProjMatrix();
-
+void Renderer::uploadCameraBuffer(const CameraData& data) {
     // Upload the buffer to the GPU
-    RHI.updateBuffer(_cameraBuffer, sizeof(CameraData), &data);
+    size_t offset;
+    if (RHI.writeRingBuffer(_ringBuffer, sizeof(CameraData), &data, offset))
+        RHI.bindRingRange(_ringBuffer, CAMERA_BUFFER_IDX, offset, sizeof(CameraData));
+}
+
+// Rings are sized for the worst case of the scene before the frame starts,
+// every shape takes an object block and an instance or indirect draw slot at most
+void Renderer::reserveRings(const Scene& scene) {
+    size_t numShapes = scene.shapes().size();
+
+    size_t constants = RHI.ringBlockSize(_ringBuffer, sizeof(RendererBuffer)) +
+                       RHI.ringBlockSize(_ringBuffer, sizeof(LightData) * NUM_LIGHTS) +
+                       RHI.ringBlockSize(_ringBuffer, sizeof(CameraData));
+
+    // recordShapes takes the blocks in one allocation, one more block covers its alignment
+    size_t objects = (numShapes + 1) * RHI.ringBlockSize(_ringBuffer, sizeof(ObjectBuffer));
+    RHI.reserveRingBuffer(_ringBuffer, constants + objects);
+
+    RHI.reserveRingBuffer(_instanceRing, numShapes * RHI.ringBlockSize(_instanceRing, sizeof(InstanceData)));
+
+    if (!_indirect)
+        return;
+
+    // Create the arena on first use, geometry is copied into it lazily
+    if (_arena == -1) {
+        _arena    = RHI.createGeometryArena(ARENA_MAX_VERTICES, ARENA_MAX_INDICES, MAX_INDIRECT_DRAWS);
+        _drawRing = RHI.createRingBuffer(BUFFER_STORAGE, RING_FRAME_SIZE);
+    }
+
+    size_t numDraws = std::min(numShapes, (size_t)MAX_INDIRECT_DRAWS);
+    RHI.reserveRingBuffer(_drawRing, RHI.ringBlockSize(_drawRing, sizeof(TransformData) * numDraws) +
+                                     RHI.ringBlockSize(_drawRing, sizeof(DrawData) * numDraws) +
+                                     RHI.ringBlockSize(_drawRing, sizeof(DrawIndirectCommand) * numDraws));
 }
 
 void Renderer::uploadRendererBuffer() {
@@ -83,46 +204,603 @@ void Renderer::uploadRendererBuffer() {
     data.W = _toneParams[6];
 
     // Upload the buffer to the GPU
-    RHI.updateBuffer(_rendererBuffer, sizeof(RendererBuffer), &data);
+    size_t offset;
+    if (RHI.writeRingBuffer(_ringBuffer, sizeof(RendererBuffer), &data, offset))
+        RHI.bindRingRange(_ringBuffer, RENDERER_BUFFER_IDX, offset, sizeof(RendererBuffer));
+}
+
+void Renderer::uploadMaterialBuffer(const Scene& scene) {
+    // Programs are picked again when the features of a material change, or for all of them
+    // once a variant finished building since materials waiting for it still use the generic program
+    bool variantsReady = _variants->generation() != _variantGeneration;
+    _variantGeneration = _variants->generation();
+
+    // Materials created since the last frame may need more pages
+    uint32 pages = (Material::numSlots() + MAX_MATERIALS - 1) / MAX_MATERIALS;
+    if (pages > _materialPages)
+        growMaterialBuffer(std::max(pages, _materialPages * 2));
+
+    const vec<sref<Shape>>& shapes = scene.shapes();
+    for (uint32 s = 0; s < shapes.size(); ++s) {
+        Material* mat = shapes[s]->material().get();
+        if (mat == nullptr)
+            continue;
+
+        uint32 features = mat->features();
+        if (variantsReady || mat->needsVariantProgram(features))
+            mat->setVariantProgram(_variants->program(features), features);
+
+        if (!mat->isDirty())
+            continue;
+
+        MaterialData& data = _materialData[mat->index()];
+        data = MaterialData();
+        mat->toData(data);
+
+        size_t offset = _materialPageSize * materialPage(mat) + sizeof(MaterialData) * materialIdx(mat);
+        RHI.updateBuffer(_materialBuffer, offset, sizeof(MaterialData), &data);
+        mat->clearDirty();
+    }
+}
+
+// Buffer objects cannot be resized, a larger one is created and every slot written again
+void Renderer::growMaterialBuffer(uint32 pages) {
+    if (_materialBuffer != -1)
+        RHI.deleteBuffer(_materialBuffer);
+
+    _materialData.resize(pages * MAX_MATERIALS);
+    for (uint32 p = _materialPages; p < pages; ++p)
+        _materialData[p * MAX_MATERIALS + DEFAULT_MATERIAL_SLOT] = defaultMaterialData();
+
+    _materialBuffer = RHI.createBuffer(BUFFER_SHARED, DYNAMIC, _materialPageSize * pages, 0);
+    for (uint32 p = 0; p < pages; ++p)
+        RHI.updateBuffer(_materialBuffer, _materialPageSize * p, sizeof(MaterialData) * MAX_MATERIALS,
+                         &_materialData[p * MAX_MATERIALS]);
+
+    _materialPages = pages;
+    _materialPage  = ~0u;
+}
+
+void Renderer::bindMaterialPage(uint32 page) {
+    if (page == _materialPage)
+        return;
+
+    RHI.bindBufferRange(_materialBuffer, MATERIAL_BUFFER_IDX, _materialPageSize * page, sizeof(MaterialData) * MAX_MATERIALS);
+    _materialPage = page;
+}
+
+void Renderer::requestTextures(const Scene& scene, const CameraData& camera) {
+    if (Streamer.empty())
+        return;
+
+    // Projected diameter in pixels of a unit radius at unit distance
+    float pixelScale = camera.projMatrix.m[1][1] * _viewHeight;
+
+    const vec<sref<Shape>>& shapes = scene.shapes();
+    for (uint32 s = 0; s < shapes.size(); ++s) {
+        const Material* mat = shapes[s]->material().get();
+        if (mat == nullptr || mat->features() == 0)
+            continue; // No textures
+
+        BSphere sphere = transform(modelMatrix(shapes, s), shapes[s]->bSphere());
+        float dist = std::max(distance(sphere.center(), camera.viewPos), sphere.radius());
+
+        mat->requestTextures(sphere.radius() * pixelScale / dist);
+    }
+}
+
+// Sort draws so shapes sharing geometry and material are contiguous
+// Keys are gathered once, comparing through the shapes would chase pointers on every comparison
+void Renderer::sortDraws(const vec<sref<Shape>>& shapes) {
+    uint32 numShapes = (uint32)shapes.size();
+
+    _drawKeys.resize(numShapes);
+    for (uint32 s = 0; s < numShapes; ++s) {
+        _drawKeys[s].geometry = (uintptr_t)shapes[s]->geometry().get();
+        _drawKeys[s].material = (uintptr_t)shapes[s]->material().get();
+        _drawKeys[s].shape    = s;
+    }
+
+    std::sort(_drawKeys.begin(), _drawKeys.end());
+
+    _drawOrder.resize(numShapes);
+    for (uint32 d = 0; d < numShapes; ++d)
+        _drawOrder[d] = _drawKeys[d].shape;
+}
+
+// End of the batch of sorted draws starting at first
+uint32 Renderer::batchEnd(uint32 first) const {
+    uint32 numDraws = (uint32)_drawKeys.size();
+
+    const DrawKey& key = _drawKeys[first];
+
+    uint32 last = first + 1;
+    while (last < numDraws && _drawKeys[last].geometry == key.geometry && _drawKeys[last].material == key.material)
+        ++last;
+
+    return last;
+}
+
+bool Renderer::drawsInstanced(const Shape& shape, uint32 count) const {
+    return _instancing && count >= MIN_INSTANCES && shape._prog == -1 && shape.material();
 }
 
 void Renderer::drawShapes(const Scene& scene) {
-    // Iterate renderables
     const vec<sref<Shape>>& shapes = scene.shapes();
-    for (uint32 s = 0; s < shapes.size(); ++s)
-        shapes[s]->draw();
+    uint32 numShapes = (uint32)shapes.size();
+
+    sortDraws(shapes);
+
+    // Iterate renderables, one draw call per batch of identical shapes
+    uint32 first = 0;
+    while (first < numShapes) {
+        uint32 last = batchEnd(first);
+
+        if (drawsInstanced(*shapes[_drawOrder[first]], last - first)) {
+            drawInstanced(shapes, first, last - first);
+        } else {
+            for (uint32 s = first; s < last; ++s)
+                drawShape(shapes, _drawOrder[s]);
+        }
+
+        first = last;
+    }
+}
+
+void Renderer::drawShape(const vec<sref<Shape>>& shapes, uint32 s) {
+    Shape& shape = *shapes[s];
+
+    ObjectBuffer data;
+    data.modelMatrix  = modelMatrix(shapes, s);
+    data.normalMatrix = Mat4(normalMatrix(shapes, s));
+    data.materialIdx  = materialIdx(shape.material().get());
+
+    size_t offset;
+    if (!RHI.writeRingBuffer(_ringBuffer, sizeof(ObjectBuffer), &data, offset)) {
+        // Cannot happen once reserveRings sized the ring for the scene
+        std::cerr << "[ERROR] Constant ring buffer full, shape " << s << " not drawn" << std::endl;
+        return;
+    }
+
+    RHI.bindRingRange(_ringBuffer, OBJECT_BUFFER_IDX, offset, sizeof(ObjectBuffer));
+
+    if (shape.material())
+        bindMaterialPage(materialPage(shape.material().get()));
+
+    shape.draw();
+}
+
+void Renderer::drawInstanced(const vec<sref<Shape>>& shapes, uint32 first, uint32 count) {
+    size_t offset;
+    uint8* ptr = RHI.allocRingBuffer(_instanceRing, sizeof(InstanceData) * count, offset);
+    if (ptr == nullptr) {
+        // Out of instance memory, fallback to individual draws
+        for (uint32 s = first; s < first + count; ++s)
+            drawShape(shapes, _drawOrder[s]);
+        return;
+    }
+
+    // Pack instance transforms
+    InstanceData* data = (InstanceData*)ptr;
+    for (uint32 i = 0; i < count; ++i) {
+        uint32 s = _drawOrder[first + i];
+        const Shape& shape = *shapes[s];
+        data[i].modelMatrix  = modelMatrix(shapes, s);
+        data[i].normalMatrix = normalMatrix(shapes, s);
+        data[i].materialIdx  = materialIdx(shape.material().get());
+    }
+
+    // Draws of a batch share their material
+    const Shape& shape = *shapes[_drawOrder[first]];
+    RRID geoId = shape.geometry()->rrid();
+
+    bindMaterialPage(materialPage(shape.material().get()));
+
+    RHI.useProgram(_instancedVariants->program(shape.material()->features()));
+    shape.material()->uploadData();
+
+    RHI.setInstanceLayout(geoId, RHI.ringStorage(_instanceRing), offset, instanceLayout);
+    RHI.drawGeometryInstanced(geoId, count);
+
+    RHI.useProgram(0);
+}
+
+void Renderer::drawShapesIndirect(const Scene& scene) {
+    const vec<sref<Shape>>& shapes = scene.shapes();
+    uint32 numShapes = (uint32)shapes.size();
+
+    // Shapes with their own program or geometry that does not fit the arena are drawn directly
+    _drawOrder.clear();
+    for (uint32 s = 0; s < numShapes; ++s) {
+        Shape& shape = *shapes[s];
+        if (shape._prog != -1 || !shape.material() || _drawOrder.size() >= MAX_INDIRECT_DRAWS) {
+            drawShape(shapes, s);
+            continue;
+        }
+
+        const sref<Geometry>& geo = shape.geometry();
+        if (geo->arenaRRID() == -1 && RHI.uploadGeometry(_arena, geo) == -1) {
+            drawShape(shapes, s);
+            continue;
+        }
+
+        _drawOrder.push_back(s);
+    }
+
+    uint32 numDraws = (uint32)_drawOrder.size();
+    if (numDraws == 0)
+        return;
+
+    // Draws can only share a call when they use the same program, material page and textures
+    // Each material is matched to a batch once, draws are then sorted on the index of their batch
+    _batches.clear();
+    _batchOfSlot.assign(_materialPages * MAX_MATERIALS, -1);
+    _batchIdx.resize(numShapes);
+    for (uint32 s : _drawOrder) {
+        const Material* mat = shapes[s]->material().get();
+
+        int32& batch = _batchOfSlot[mat->index()];
+        if (batch == -1) {
+            IndirectBatch key = { _indirectVariants->program(mat->features()), materialPage(mat), mat->textureSet() };
+
+            auto it = std::find(_batches.begin(), _batches.end(), key);
+            batch = (int32)(it - _batches.begin());
+            if (it == _batches.end())
+                _batches.push_back(key);
+        }
+
+        _batchIdx[s] = (uint32)batch;
+    }
+
+    // Batches using the same program stay together
+    std::stable_sort(_drawOrder.begin(), _drawOrder.end(), [this](uint32 a, uint32 b) {
+        RRID progA = _batches[_batchIdx[a]].program;
+        RRID progB = _batches[_batchIdx[b]].program;
+        return progA != progB ? progA < progB : _batchIdx[a] < _batchIdx[b];
+    });
+
+    size_t transformOffset, drawOffset, cmdOffset;
+    auto transforms = (TransformData*)RHI.allocRingBuffer(_drawRing, sizeof(TransformData) * numDraws, transformOffset);
+    auto draws      = (DrawData*)RHI.allocRingBuffer(_drawRing, sizeof(DrawData) * numDraws, drawOffset);
+    auto cmds       = (DrawIndirectCommand*)RHI.allocRingBuffer(_drawRing, sizeof(DrawIndirectCommand) * numDraws, cmdOffset);
+    if (transforms == nullptr || draws == nullptr || cmds == nullptr) {
+        // Out of draw memory, fallback to individual draws
+        for (uint32 d = 0; d < numDraws; ++d)
+            drawShape(shapes, _drawOrder[d]);
+        return;
+    }
+
+    // Fill per-draw data, baseInstance carries the draw index to the shader
+    // The ring is only written, commands are built on the stack and triangles counted on the way
+    _drawTriangles.resize(numDraws + 1);
+    _drawTriangles[0] = 0;
+    for (uint32 d = 0; d < numDraws; ++d) {
+        const Shape& shape = *shapes[_drawOrder[d]];
+
+        transforms[d].modelMatrix  = modelMatrix(shapes, _drawOrder[d]);
+        transforms[d].normalMatrix = Mat4(normalMatrix(shapes, _drawOrder[d]));
+
+        draws[d].transformIdx = d;
+        draws[d].materialIdx  = materialIdx(shape.material().get());
+
+        DrawIndirectCommand cmd = {};
+        RHI.arenaDrawCommand(shape.geometry()->arenaRRID(), cmd);
+        cmd.baseInstance = d;
+        cmds[d] = cmd;
+
+        _drawTriangles[d + 1] = _drawTriangles[d] + (uint64)(cmd.count / 3) * cmd.instanceCount;
+    }
+
+    RHI.bindRingRange(_drawRing, TRANSFORM_STORAGE_IDX, transformOffset, sizeof(TransformData) * numDraws);
+    RHI.bindRingRange(_drawRing, DRAW_STORAGE_IDX, drawOffset, sizeof(DrawData) * numDraws);
+
+    // One multi-draw call per program, material page and texture set
+    RRID program = -1;
+    uint32 first = 0;
+    while (first < numDraws) {
+        uint32 batch = _batchIdx[_drawOrder[first]];
+
+        uint32 last = first + 1;
+        while (last < numDraws && _batchIdx[_drawOrder[last]] == batch)
+            ++last;
+
+        if (_batches[batch].program != program)
+            RHI.useProgram(_batches[batch].program);
+        program = _batches[batch].program;
+
+        bindMaterialPage(_batches[batch].page);
+        shapes[_drawOrder[first]]->material()->uploadData();
+        RHI.multiDrawIndirect(_arena, _drawRing, cmdOffset + sizeof(DrawIndirectCommand) * first, last - first,
+                              _drawTriangles[last] - _drawTriangles[first]);
+
+        first = last;
+    }
+
+    RHI.useProgram(0);
+}
+
+void Renderer::recordShapes(const Scene& scene) {
+    const vec<sref<Shape>>& shapes = scene.shapes();
+    uint32 numShapes = (uint32)shapes.size();
+    if (numShapes == 0)
+        return;
+
+    // Reserve one object block per shape up front, workers fill disjoint slots
+    size_t stride = alignSize(sizeof(ObjectBuffer), RHI.uniformAlignment());
+    size_t base;
+    uint8* ptr = RHI.allocRingBuffer(_ringBuffer, stride * numShapes, base);
+    if (ptr == nullptr) {
+        // Out of constant memory, fallback to individual draws
+        for (uint32 s = 0; s < numShapes; ++s)
+            drawShape(shapes, s);
+        return;
+    }
+
+    sortDraws(shapes);
+
+    // Instance data of a draw goes to the slot of its position in the draw order
+    size_t instanceBase = 0;
+    uint8* instancePtr  = nullptr;
+    if (_instancing)
+        instancePtr = RHI.allocRingBuffer(_instanceRing, sizeof(InstanceData) * numShapes, instanceBase);
+    RRID instanceBuffer = RHI.ringStorage(_instanceRing);
+
+    // Programs are resolved here, variants are not thread safe
+    // Instanced batches are recorded whole, the others are split so chunks can be balanced
+    _recordBatches.clear();
+    uint32 first = 0;
+    while (first < numShapes) {
+        uint32 last = batchEnd(first);
+        const Shape& shape = *shapes[_drawOrder[first]];
+
+        if (instancePtr != nullptr && drawsInstanced(shape, last - first)) {
+            RecordBatch batch = { first, last - first, _instancedVariants->program(shape.material()->features()) };
+            _recordBatches.push_back(batch);
+        } else {
+            for (uint32 b = first; b < last; b += MIN_RECORD_CHUNK) {
+                RecordBatch batch = { b, std::min(MIN_RECORD_CHUNK, last - b), -1 };
+                _recordBatches.push_back(batch);
+            }
+        }
+
+        first = last;
+    }
+
+    uint32 numBatches = (uint32)_recordBatches.size();
+    uint32 numChunks  = (numShapes + MIN_RECORD_CHUNK - 1) / MIN_RECORD_CHUNK;
+    numChunks = std::min(numChunks, (uint32)_cmdBuffers.size());
+    uint32 chunkSize = (numShapes + numChunks - 1) / numChunks;
+
+    // Chunks of whole batches holding about chunkSize draws
+    _recordChunks.assign(1, 0);
+    uint32 chunkDraws = 0;
+    for (uint32 b = 0; b < numBatches; ++b) {
+        chunkDraws += _recordBatches[b].count;
+        if (chunkDraws >= chunkSize && b + 1 < numBatches) {
+            _recordChunks.push_back(b + 1);
+            chunkDraws = 0;
+        }
+    }
+    _recordChunks.push_back(numBatches);
+    numChunks = (uint32)_recordChunks.size() - 1;
+
+    // Pack transforms and record draws off the GL thread
+    Workers.parallelFor(numChunks, [&](uint32 c) {
+        PROFILE_ZONE("Record shapes");
+
+        CommandBuffer& cmds = _cmdBuffers[c];
+        cmds.reset();
+
+        // Chunks are replayed after one another, each one binds its first material page
+        uint32 page = ~0u;
+        auto bindPage = [&](const Material* mat) {
+            if (mat == nullptr || materialPage(mat) == page)
+                return;
+
+            page = materialPage(mat);
+            cmds.bindBufferRange(_materialBuffer, MATERIAL_BUFFER_IDX, _materialPageSize * page,
+                                 sizeof(MaterialData) * MAX_MATERIALS);
+        };
+
+        for (uint32 b = _recordChunks[c]; b < _recordChunks[c + 1]; ++b) {
+            const RecordBatch& batch = _recordBatches[b];
+
+            if (batch.program != -1) {
+                InstanceData* data = (InstanceData*)instancePtr + batch.first;
+                for (uint32 i = 0; i < batch.count; ++i) {
+                    uint32 s = _drawOrder[batch.first + i];
+                    data[i].modelMatrix  = modelMatrix(shapes, s);
+                    data[i].normalMatrix = normalMatrix(shapes, s);
+                    data[i].materialIdx  = materialIdx(shapes[s]->material().get());
+                }
+
+                const Shape& shape = *shapes[_drawOrder[batch.first]];
+                RRID geoId = shape.geometry()->rrid();
+
+                bindPage(shape.material().get());
+                cmds.useProgram(batch.program);
+                cmds.bindMaterial(shape.material().get());
+                cmds.setInstanceLayout(geoId, instanceBuffer, instanceBase + sizeof(InstanceData) * batch.first, instanceLayout);
+                cmds.drawGeometryInstanced(geoId, batch.count);
+                continue;
+            }
+
+            for (uint32 d = batch.first; d < batch.first + batch.count; ++d) {
+                uint32 s = _drawOrder[d];
+                const Shape& shape = *shapes[s];
+                const Material* mat = shape.material().get();
+
+                ObjectBuffer* data = (ObjectBuffer*)(ptr + stride * s);
+                data->modelMatrix  = modelMatrix(shapes, s);
+                data->normalMatrix = Mat4(normalMatrix(shapes, s));
+                data->materialIdx  = materialIdx(mat);
+
+                cmds.bindRingRange(_ringBuffer, OBJECT_BUFFER_IDX, base + stride * s, sizeof(ObjectBuffer));
+                bindPage(mat);
+
+                // Same program selection as Mesh::draw
+                RRID prog = (shape._prog != -1) ? shape._prog : (mat ? mat->program() : -1);
+                if (prog != -1)
+                    cmds.useProgram(prog);
+
+                if (mat)
+                    cmds.bindMaterial(mat);
+
+                cmds.drawGeometry(shape.geometry()->rrid());
+            }
+        }
+
+        cmds.useProgram(0);
+    });
+
+    // Replay in recording order on the GL thread
+    PROFILE_ZONE("Execute commands");
+    for (uint32 c = 0; c < numChunks; ++c)
+        RHI.execute(_cmdBuffers[c]);
+    _materialPage = ~0u;
 }
 
 void Renderer::drawSkybox(const Scene& scene) {
     if (scene.hasSkybox()) {
         const Skybox& sky = scene.skybox();
+
+        // The sky covers the screen
+        Streamer.request(sky.cubeTex(), _viewHeight);
         sky.draw();
     }
 }
 
 void Renderer::prepare() {
-    // Create shared buffers in the GPU
-    _lightsBuffer   = RHI.createBuffer(BUFFER_SHARED, DYNAMIC, sizeof(LightData) * NUM_LIGHTS, 0);
-    _cameraBuffer   = RHI.createBuffer(BUFFER_SHARED, DYNAMIC, sizeof(CameraData), 0);
-    _rendererBuffer = RHI.createBuffer(BUFFER_SHARED, DYNAMIC, sizeof(RendererBuffer), 0);
+    // Create the constant ring buffer in the GPU
+    // Sections of it are bound to the known buffer indices every frame
+    _ringBuffer   = RHI.createRingBuffer(BUFFER_SHARED, RING_FRAME_SIZE);
+    _instanceRing = RHI.createRingBuffer(BUFFER_VERTEX, RING_FRAME_SIZE);
+
+    _variants          = Resource.getShaderVariants("unreal");
+    _instancedVariants = Resource.getShaderVariants("unreal_instanced");
+
+    if (RHI.supportsIndirectDraws())
+        _indirectVariants = Resource.getShaderVariants("unreal_indirect");
+
+    _cmdBuffers.resize(Workers.numThreads());
+
+    // Create the shared material buffer, its pages are bound as uniform ranges
+    _materialPageSize = alignSize(sizeof(MaterialData) * MAX_MATERIALS, RHI.uniformAlignment());
+    growMaterialBuffer(1);
+    bindMaterialPage(0);
+}
+
+void Renderer::captureFrame(const Scene& scene, const Camera& camera, const RendererParams& params, FrameSnapshot& frame) {
+    frame.camera.viewMatrix     = camera.viewMatrix();
+    frame.camera.projMatrix     = camera.projMatrix();
+    frame.camera.viewPos        = camera.position();
+    frame.camera.viewProjMatrix = camera.viewProjMatrix();
+
+    const vec<sref<Shape>>& shapes = scene.shapes();
+    frame.modelMatrices.resize(shapes.size());
+    frame.normalMatrices.resize(shapes.size());
+    for (uint32 s = 0; s < shapes.size(); ++s) {
+        frame.modelMatrices[s]  = shapes[s]->objToWorld();
+        frame.normalMatrices[s] = shapes[s]->normalMatrix();
+    }
+
+    const vec<sref<Light>>& lights = scene.lights();
+    frame.lights.resize(lights.size());
+    for (uint32 l = 0; l < lights.size(); ++l)
+        lights[l]->toData(frame.lights[l]);
+
+    frame.params = params;
+}
+
+Mat4 Renderer::modelMatrix(const vec<sref<Shape>>& shapes, uint32 s) const {
+    if (_frame && s < _frame->modelMatrices.size())
+        return _frame->modelMatrices[s];
+
+    return shapes[s]->objToWorld();
+}
+
+Mat3 Renderer::normalMatrix(const vec<sref<Shape>>& shapes, uint32 s) const {
+    if (_frame && s < _frame->normalMatrices.size())
+        return _frame->normalMatrices[s];
 
-    // Bind buffers to known indices
-    RHI.bindBufferBase(_cameraBuffer,   CAMERA_BUFFER_IDX);
-    RHI.bindBufferBase(_lightsBuffer,   LIGHTS_BUFFER_IDX);
-    RHI.bindBufferBase(_rendererBuffer, RENDERER_BUFFER_IDX);
+    return shapes[s]->normalMatrix();
 }
 
 void Renderer::render(const Scene& scene, const Camera& camera) {
+    CameraData data;
+    data.viewMatrix     = camera.viewMatrix();
+    data.projMatrix     = camera.projMatrix();
+    data.viewPos        = camera.position();
+    data.viewProjMatrix = camera.viewProjMatrix();
+
+    _frame = nullptr;
+    renderScene(scene, data);
+}
+
+void Renderer::render(const Scene& scene, const FrameSnapshot& frame) {
+    setParams(frame.params);
+
+    // Transforms and lights are read from the snapshot instead of the scene
+    _frame = &frame;
+    renderScene(scene, frame.camera);
+    _frame = nullptr;
+}
+
+void Renderer::renderScene(const Scene& scene, const CameraData& camera) {
+    PROFILE_ZONE("Renderer::render");
+
+    reserveRings(scene);
+
+    RHI.beginRingFrame(_ringBuffer);
+    RHI.beginRingFrame(_instanceRing);
+
+    if (_drawRing != -1)
+        RHI.beginRingFrame(_drawRing);
+
     // Upload constant buffers to the GPU
-    uploadRendererBuffer();
-    uploadLightsBuffer(scene);
-    uploadCameraBuffer(camera);
+    {
+        PROFILE_ZONE("Uploads");
+        GPUPassScope pass("Uploads");
+        uploadRendererBuffer();
+        uploadLightsBuffer(scene);
+        uploadCameraBuffer(camera);
+        uploadMaterialBuffer(scene);
+        requestTextures(scene, camera);
+    }
 
     // Draw scene objects
-    drawShapes(scene);
+    {
+        PROFILE_ZONE("Shapes");
+        GPUPassScope pass("Shapes");
+        if (_indirect)
+            drawShapesIndirect(scene);
+        else if (_threadedRecording)
+            recordShapes(scene);
+        else
+            drawShapes(scene);
+    }
 
     // Draw skybox
-    if (_drawSkybox)
+    if (_drawSkybox) {
+        PROFILE_ZONE("Skybox");
+        GPUPassScope pass("Skybox");
         drawSkybox(scene);
+    }
+
+    RHI.endRingFrame(_ringBuffer);
+    RHI.endRingFrame(_instanceRing);
+
+    if (_drawRing != -1)
+        RHI.endRingFrame(_drawRing);
+
+    // Variants requested this frame are linked in the background and used once ready
+    _variants->update();
+    _instancedVariants->update();
+
+    if (_indirectVariants)
+        _indirectVariants->update();
+
+    // Levels requested this frame are streamed in over the next ones
+    Streamer.update();
 }
 
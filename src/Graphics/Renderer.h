@@ -2,13 +2,38 @@
 #define __PBR_RENDERER_H__
 
 #include <PBR.h>
+#include <PBRMath.h>
+#include <CommandBuffer.h>
+#include <Camera.h>
+#include <Light.h>
+#include <Material.h>
+
+using namespace pbr::math;
 
 namespace pbr {
 
     class Scene;
-    class Camera;
+    class Shape;
+    class ShaderVariants;
+
+    template<class T>
+    using vec = std::vector<T>;
 
     static PBR_CONSTEXPR uint32 NUM_LIGHTS = 4;
+
+    // Initial size of the per-frame regions of the ring buffers, they grow to fit the scene
+    static PBR_CONSTEXPR size_t RING_FRAME_SIZE = 4 * 1024 * 1024;
+
+    // Minimum number of shapes sharing geometry and material to draw them instanced
+    static PBR_CONSTEXPR uint32 MIN_INSTANCES = 2;
+
+    // Capacity of the geometry arena used by indirect draws
+    static PBR_CONSTEXPR uint32 ARENA_MAX_VERTICES = 2 * 1024 * 1024;
+    static PBR_CONSTEXPR uint32 ARENA_MAX_INDICES  = 4 * 1024 * 1024;
+    static PBR_CONSTEXPR uint32 MAX_INDIRECT_DRAWS = 64 * 1024;
+
+    // Minimum number of shapes recorded by each worker thread
+    static PBR_CONSTEXPR uint32 MIN_RECORD_CHUNK = 64;
     
     enum ToneOperator {
         SIMPLE,
@@ -19,7 +44,14 @@ namespace pbr {
     enum BufferIndices : uint32 {
         CAMERA_BUFFER_IDX   = 0,
         LIGHTS_BUFFER_IDX   = 1,
-        RENDERER_BUFFER_IDX = 2
+        RENDERER_BUFFER_IDX = 2,
+        OBJECT_BUFFER_IDX   = 3,
+        MATERIAL_BUFFER_IDX = 4
+    };
+
+    enum StorageIndices : uint32 {
+        TRANSFORM_STORAGE_IDX = 0,
+        DRAW_STORAGE_IDX      = 1
     };
 
     // Buffer for shaders with renderer information
@@ -30,13 +62,72 @@ namespace pbr {
         // Uncharted tone curve control parameters
         float A, B, C, D, E, F, W;
     };
+
+    // Buffer for shaders with per-draw information
+    // Normal matrix is stored as a mat4 to follow std140 layout
+    struct ObjectBuffer {
+        Mat4  modelMatrix;
+        Mat4  normalMatrix;
+        int32 materialIdx;
+        int32 aux[3];
+    };
+
+    // Per-instance data of instanced draws, read as vertex attributes
+    struct InstanceData {
+        Mat4   modelMatrix;
+        Mat3   normalMatrix;
+        uint32 materialIdx;
+    };
+
+    // Per-draw data of indirect draws, read from shader storage buffers
+    // CARE: data follows std430 layout, do not change
+    struct TransformData {
+        Mat4 modelMatrix;
+        Mat4 normalMatrix;
+    };
+
+    struct DrawData {
+        uint32 transformIdx;
+        uint32 materialIdx;
+    };
     
+    // Renderer settings, also carried by frame snapshots
+    struct RendererParams {
+        float gamma;
+        float exposure;
+        float toneParams[7];
+
+        bool drawSkybox;
+        bool instancing;
+        bool indirect;
+        bool threadedRecording;
+
+        float viewHeight;   // Pixels, screen sizes for texture streaming
+    };
+
+    // Immutable copy of everything the renderer reads from the scene in a frame
+    // Produced by the update thread in pipelined mode, consumed by the render thread
+    struct FrameSnapshot {
+        CameraData     camera;
+        vec<Mat4>      modelMatrices;   // Same order as Scene::shapes
+        vec<Mat3>      normalMatrices;
+        vec<LightData> lights;
+        RendererParams params;
+    };
+
     class PBR_SHARED Renderer {
     public:
         Renderer();
 
         void prepare();
         void render(const Scene& scene, const Camera& camera);
+        void render(const Scene& scene, const FrameSnapshot& frame);
+
+        static void captureFrame(const Scene& scene, const Camera& camera, 
+                                 const RendererParams& params, FrameSnapshot& frame);
+
+        RendererParams params() const;
+        void setParams(const RendererParams& params);
 
         float gamma() const;
         void setGamma(float gamma);
@@ -48,12 +139,35 @@ namespace pbr {
         void setToneParams(float toneParams[7]);
 
         void setSkyboxDraw(bool state);
+        void setInstancing(bool state);
+        void setIndirectDraws(bool state);
+        // Draws are recorded by the worker threads and replayed, batches are instanced as with setInstancing
+        void setThreadedRecording(bool state);
+        void setViewHeight(float height);
 
     private:
+        void renderScene(const Scene& scene, const CameraData& camera);
+
+        // Shape transforms, from the current snapshot when there is one
+        Mat4 modelMatrix (const vec<sref<Shape>>& shapes, uint32 s) const;
+        Mat3 normalMatrix(const vec<sref<Shape>>& shapes, uint32 s) const;
+
+        void reserveRings(const Scene& scene);
         void uploadRendererBuffer();
         void uploadLightsBuffer(const Scene& scene);
-        void uploadCameraBuffer(const Camera& camera);
+        void uploadCameraBuffer(const CameraData& camera);
+        void uploadMaterialBuffer(const Scene& scene);
+        void growMaterialBuffer(uint32 pages);
+        void bindMaterialPage(uint32 page);
+        void requestTextures(const Scene& scene, const CameraData& camera);
+        void sortDraws(const vec<sref<Shape>>& shapes);
+        uint32 batchEnd(uint32 first) const;
+        bool drawsInstanced(const Shape& shape, uint32 count) const;
         void drawShapes(const Scene& scene);
+        void drawShape(const vec<sref<Shape>>& shapes, uint32 s);
+        void drawInstanced(const vec<sref<Shape>>& shapes, uint32 first, uint32 count);
+        void drawShapesIndirect(const Scene& scene);
+        void recordShapes(const Scene& scene);
         void drawSkybox(const Scene& scene);
 
         float _gamma;
@@ -62,10 +176,80 @@ namespace pbr {
         ToneOperator _tone;
 
         bool _drawSkybox;
+        bool _instancing;
+        bool _indirect;
+        bool _threadedRecording;
+        float _viewHeight;
+
+        // Snapshot being rendered, null when rendering straight from the scene
+        const FrameSnapshot* _frame;
         
-        RRID _lightsBuffer;
-        RRID _cameraBuffer;
-        RRID _rendererBuffer;
+        // Ring buffer holding all constant data of a frame
+        RRID _ringBuffer;
+
+        // Material blocks, only rewritten when a material changes
+        // Grows a page of MAX_MATERIALS slots at a time, draws see the page of their material
+        RRID              _materialBuffer;
+        uint32            _materialPages;
+        size_t            _materialPageSize;   // Bytes between pages, aligned for range binds
+        uint32            _materialPage;       // Page bound to MATERIAL_BUFFER_IDX, ~0u when unknown
+        vec<MaterialData> _materialData;       // Every slot, uploaded again when the buffer grows
+
+        // Material programs, specialized per material features
+        ShaderVariants* _variants;
+        uint32          _variantGeneration;   // Generation of _variants when programs were last picked
+
+        // Sort key of a draw, the shape index keeps the order of equal draws
+        struct DrawKey {
+            uintptr_t geometry;
+            uintptr_t material;
+            uint32    shape;
+
+            bool operator<(const DrawKey& other) const {
+                if (geometry != other.geometry)
+                    return geometry < other.geometry;
+                if (material != other.material)
+                    return material < other.material;
+                return shape < other.shape;
+            }
+        };
+
+        // Instancing
+        RRID _instanceRing;
+        ShaderVariants* _instancedVariants;
+        vec<uint32>  _drawOrder;
+        vec<DrawKey> _drawKeys;     // Same order as _drawOrder
+
+        // Multi-draw indirect, geometry arena and ring with per-draw data and commands
+        RRID _arena;
+        RRID _drawRing;
+        ShaderVariants* _indirectVariants;
+        struct IndirectBatch {
+            RRID       program;
+            uint32     page;       // Page of the material buffer
+            TextureSet textures;
+
+            bool operator==(const IndirectBatch& other) const {
+                return program == other.program && page == other.page && textures == other.textures;
+            }
+        };
+
+        vec<IndirectBatch> _batches;       // Batches of this frame
+        vec<uint32>        _batchIdx;      // Batch of each shape
+        vec<int32>         _batchOfSlot;   // Batch of each material slot
+        vec<uint64>        _drawTriangles; // Triangles of the draws before each draw
+
+        // Run of sorted draws recorded by one worker, drawn instanced unless program is -1
+        struct RecordBatch {
+            uint32 first;
+            uint32 count;
+            RRID   program;
+        };
+
+        // One command buffer per recording thread, replayed in order
+        vec<CommandBuffer> _cmdBuffers;
+        vec<RecordBatch>   _recordBatches;
+        vec<uint32>        _recordChunks;   // First batch of each chunk, then the number of batches
     };
 
 }
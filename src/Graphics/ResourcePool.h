@@ -0,0 +1,154 @@
+#ifndef __PBR_RESOURCEPOOL_H__
+#define __PBR_RESOURCEPOOL_H__
+
+#include <PBR.h>
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    // Kind of resource a handle refers to, stored in the handle so handles of different kinds can't be mixed up
+    enum ResourceKind : uint32 {
+        RES_VERTARRAY     = 1,
+        RES_BUFFER        = 2,
+        RES_RINGBUFFER    = 3,
+        RES_ARENA         = 4,
+        RES_ARENAGEOMETRY = 5,
+        RES_PROGRAM       = 6,
+        RES_TEXTURE       = 7
+    };
+
+    // Handle layout: | kind (8 bits) | generation (24 bits) | slot index (32 bits) |
+    // Valid handles are always positive, -1 is still the invalid handle
+    static PBR_CONSTEXPR uint32 HANDLE_GENERATION_MASK = 0xFFFFFF;
+
+    inline RRID makeHandle(uint32 kind, uint32 generation, uint32 index) {
+        return (RRID)(((uint64)kind << 56) | ((uint64)(generation & HANDLE_GENERATION_MASK) << 32) | index);
+    }
+
+    inline uint32 handleKind(RRID id) {
+        return (uint32)((uint64)id >> 56);
+    }
+
+    inline uint32 handleGeneration(RRID id) {
+        return (uint32)((uint64)id >> 32) & HANDLE_GENERATION_MASK;
+    }
+
+    inline uint32 handleIndex(RRID id) {
+        return (uint32)((uint64)id & 0xFFFFFFFF);
+    }
+
+    // Slots for one kind of resource, deleted slots go to a free list and are reused in O(1)
+    // A slot's generation changes when it is freed, so handles to deleted resources are detected as stale
+    template<class T>
+    class ResourcePool {
+    public:
+        explicit ResourcePool(ResourceKind kind) : _kind(kind), _numAlive(0) { }
+
+        RRID add(const T& res = T()) {
+            uint32 index;
+            if (!_free.empty()) {
+                index = _free.back();
+                _free.pop_back();
+            } else {
+                index = (uint32)_slots.size();
+                _slots.push_back({ T(), 1, false });
+            }
+
+            Slot& slot = _slots[index];
+            slot.res   = res;
+            slot.alive = true;
+            ++_numAlive;
+
+            return makeHandle(_kind, slot.generation, index);
+        }
+
+        bool remove(RRID id) {
+            if (!valid(id))
+                return false; // Error
+
+            uint32 index = handleIndex(id);
+            Slot& slot = _slots[index];
+
+            // Drop what the resource holds (shared references, vectors) now rather than on reuse
+            slot.res   = T();
+            slot.alive = false;
+
+            // Generation 0 is never handed out
+            slot.generation = (slot.generation + 1) & HANDLE_GENERATION_MASK;
+            if (slot.generation == 0)
+                slot.generation = 1;
+
+            _free.push_back(index);
+            --_numAlive;
+
+            return true;
+        }
+
+        bool valid(RRID id) const {
+            if (id < 0 || handleKind(id) != _kind)
+                return false;
+
+            uint32 index = handleIndex(id);
+            if (index >= _slots.size())
+                return false;
+
+            const Slot& slot = _slots[index];
+            if (!slot.alive || slot.generation != handleGeneration(id)) {
+#ifdef PBR_GL_CHECKS
+                std::cerr << "[RHI] Stale handle to slot " << index << " (kind " << _kind << ")" << std::endl;
+#endif
+                return false;
+            }
+
+            return true;
+        }
+
+        // Null for invalid or stale handles
+        T* get(RRID id) {
+            return valid(id) ? &_slots[handleIndex(id)].res : nullptr;
+        }
+
+        // Unchecked, for handles already validated or owned by the RHI itself
+        T& operator[](RRID id) {
+            return _slots[handleIndex(id)].res;
+        }
+
+        const T& operator[](RRID id) const {
+            return _slots[handleIndex(id)].res;
+        }
+
+        template<class F>
+        void forEach(F func) {
+            for (Slot& slot : _slots)
+                if (slot.alive)
+                    func(slot.res);
+        }
+
+        // Live resources
+        uint32 size() const {
+            return _numAlive;
+        }
+
+        // Live and free slots, memory stays bounded by the peak number of live resources
+        uint32 capacity() const {
+            return (uint32)_slots.size();
+        }
+
+    private:
+        struct Slot {
+            T      res;
+            uint32 generation;
+            bool   alive;
+        };
+
+        vec<Slot>    _slots;
+        vec<uint32>  _free;
+        ResourceKind _kind;
+        uint32       _numAlive;
+    };
+
+}
+
+#endif
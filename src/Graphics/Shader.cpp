@@ -1,23 +1,88 @@
 #include <Shader.h>
 
 #include <RenderInterface.h>
+#include <EmbeddedShaders.h>
 #include <Utils.h>
 
+#include <sstream>
+
 using namespace pbr;
 
 const std::string SHADER_PATH = "Shaders/";
 
-ShaderSource::ShaderSource(ShaderType type, const std::string& filePath) {
+static PBR_CONSTEXPR uint32 MAX_INCLUDE_DEPTH = 16;
+
+static bool fileOverride = false;
+
+// FNV-1a, same hash as the embedded sources
+static uint64 hashText(uint64 hash, const std::string& text) {
+    for (char c : text) {
+        hash ^= (uint8)c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Reads a shader with its #include "file" lines replaced by the included files, like tools/embed_shaders.py
+static bool readShaderFile(const std::string& name, std::string& out, uint32 depth) {
+    std::string text;
+    if (depth > MAX_INCLUDE_DEPTH || !Utils::readFile(SHADER_PATH + name, std::ios_base::in, text))
+        return false; // Error
+
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        size_t first = line.find_first_not_of(" \t");
+        size_t start = line.find('"');
+        size_t end   = line.rfind('"');
+
+        if (first != std::string::npos && line.compare(first, 8, "#include") == 0 && start < end) {
+            if (!readShaderFile(line.substr(start + 1, end - start - 1), out, depth + 1))
+                return false;
+        } else {
+            out += line + "\n";
+        }
+    }
+
+    return true;
+}
+
+void ShaderSource::setFileOverride(bool state) {
+    fileOverride = state;
+}
+
+ShaderSource::ShaderSource(ShaderType type, const std::string& filePath, const vec<std::string>& defines) {
     _id = 0;
     _type = type;
     _name = filePath;
 
-    std::string path = SHADER_PATH + filePath;
-    if (!Utils::readFile(path, std::ios_base::in, _source))
-        std::cerr << path;
-
-    if (!compile())
-        std::cerr << "Couldn't compile shader: " << path;
+    // Compiled when a program using it is linked, never when all of them come from the program cache
+    // Files replace the embedded sources in override mode, shaders can then be edited without rebuilding
+    const EmbeddedShader* embedded = findEmbeddedShader(filePath);
+    if ((fileOverride || embedded == nullptr) && readShaderFile(filePath, _source, 0)) {
+        _hash = hashText(14695981039346656037ULL, _source);
+    } else if (embedded != nullptr) {
+        _source = embedded->source;
+        _hash   = embedded->hash;
+    } else {
+        _hash = 0;
+        std::cerr << "[ERROR] Shader " << filePath << " is neither embedded nor in " << SHADER_PATH << std::endl;
+    }
+
+    if (defines.empty())
+        return;
+
+    // #version has to stay first, #line keeps compile errors pointing at the file lines
+    std::string block;
+    for (const std::string& define : defines)
+        block += "#define " + define + "\n";
+    block += "#line 2\n";
+
+    size_t pos = _source.find("#version");
+    pos = (pos == std::string::npos) ? 0 : _source.find('\n', pos) + 1;
+    _source.insert(pos, block);
+
+    _hash = hashText(_hash, block);
 }
 
 ShaderSource::~ShaderSource() {
@@ -37,15 +102,30 @@ const std::string& ShaderSource::source() const {
     return _source;
 }
 
+uint64 ShaderSource::hash() const {
+    return _hash;
+}
+
 ShaderType ShaderSource::type() const {
     return _type;
 }
 
 bool ShaderSource::compile() {
     if (_id != 0)
-        return false;
+        return true;
 
     _id = RHI.compileShader(*this);
+    if (_id == 0)
+        std::cerr << "Couldn't compile shader: " << SHADER_PATH + _name;
+
+    return _id != 0;
+}
+
+bool ShaderSource::submit() {
+    if (_id != 0)
+        return true;
+
+    _id = RHI.submitShader(*this);
     return _id != 0;
 }
 
@@ -53,26 +133,44 @@ Shader::Shader(const std::string& name) : _id(0), _name(name) {
 
 }
 
-uint32 Shader::id() const {
+RRID Shader::id() const {
     return _id;
 }
 
-bool Shader::addShader(const ShaderSource& source) {
-    _shaders.push_back(source.id());
+bool Shader::addShader(ShaderSource& source) {
+    _sources.push_back(&source);
     return true;
 }
 
 bool Shader::link() {
     _id = RHI.linkProgram(*this);
-    return true;
+    return _id > 0;
+}
+
+bool Shader::submit() {
+    _id = RHI.submitProgram(*this);
+    return _id > 0;
+}
+
+ProgramStatus Shader::status(bool wait) {
+    if (_id <= 0)
+        return PROGRAM_FAILED;
+
+    ProgramStatus status = RHI.programStatus(_id, wait);
+    if (status == PROGRAM_FAILED) {
+        RHI.deleteProgram(_id);
+        _id = -1;
+    }
+
+    return status;
 }
 
 const std::string& Shader::name() const {
     return _name;
 }
 
-const vec<uint32>& Shader::shaders() const {
-    return _shaders;
+const vec<ShaderSource*>& Shader::sources() const {
+    return _sources;
 }
 
 void Shader::registerUniform(const std::string& name) {
@@ -15,9 +15,16 @@ namespace pbr {
         COMPUTE_SHADER  = 3
     };
 
+    enum ProgramStatus {
+        PROGRAM_PENDING = 0,
+        PROGRAM_READY   = 1,
+        PROGRAM_FAILED  = 2
+    };
+
     class PBR_SHARED ShaderSource {
     public:
-        ShaderSource(ShaderType type, const std::string& filePath);
+        // Each define is added as "#define NAME" after the #version line
+        ShaderSource(ShaderType type, const std::string& filePath, const vec<std::string>& defines = vec<std::string>());
         ~ShaderSource();
 
         uint32     id()   const;
@@ -26,12 +33,23 @@ namespace pbr {
         const std::string& name()   const;
         const std::string& source() const;       
 
+        // Content hash, computed at build time for embedded sources
+        uint64 hash() const;
+
+        // Read sources from Shaders/ instead of the ones embedded in the binary, for shader development
+        static void setFileOverride(bool state);
+
+        // Waits for the compile result
         bool compile();
 
+        // Starts compiling, errors show up when a program using the source is linked
+        bool submit();
+
     private:
         uint32      _id;
         std::string _name;
         std::string _source;
+        uint64      _hash;
         ShaderType  _type;
     };
 
@@ -39,20 +57,27 @@ namespace pbr {
     public:
         Shader(const std::string& name);
 
-        uint32 id() const;
-        bool addShader(const ShaderSource& source);
+        RRID id() const;
+
+        // Sources have to outlive the call to link, or the end of a submitted link
+        bool addShader(ShaderSource& source);
         bool link();
 
-        const std::string& name()    const;
-        const vec<uint32>& shaders() const;
+        // Starts linking in the background, poll status until the program is no longer pending
+        // Failed programs are deleted and their id goes back to -1
+        bool submit();
+        ProgramStatus status(bool wait = false);
+
+        const std::string&         name()    const;
+        const vec<ShaderSource*>&  sources() const;
 
         void registerUniform(const std::string& name);
         void registerUniformBlock(const std::string& name);
 
     private:
-        uint32      _id;
+        RRID        _id;
         std::string _name;
-        vec<uint32> _shaders;
+        vec<ShaderSource*> _sources;
         vec<int32>  _uniforms;
         vec<uint32> _uniformBlocks;
     };
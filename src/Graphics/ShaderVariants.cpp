@@ -0,0 +1,142 @@
+#include <ShaderVariants.h>
+
+#include <RenderInterface.h>
+#include <Profiler.h>
+#include <Utils.h>
+
+using namespace pbr;
+
+ShaderVariants::ShaderVariants(const std::string& name, const vec<ShaderStage>& stages,
+                               const vec<std::string>& featureDefines, const SetupFunc& setup)
+    : _name(name), _stages(stages), _featureDefines(featureDefines), _setup(setup), _genericReady(false), _generation(0) {
+
+    for (const ShaderStage& stage : _stages)
+        if (!stage.specialized)
+            _shared.push_back(make_sref<ShaderSource>(stage.type, stage.file));
+
+    uint32 numVariants = 1u << (uint32)_featureDefines.size();
+    _variants.resize(numVariants);
+    _requested.resize(numVariants, false);
+
+    _generic = submit(0, false);
+}
+
+const std::string& ShaderVariants::name() const {
+    return _name;
+}
+
+const sref<Shader>& ShaderVariants::generic() const {
+    return _generic.prog;
+}
+
+RRID ShaderVariants::program(uint32 features) {
+    features &= (uint32)_variants.size() - 1;
+
+    if (_variants[features])
+        return _variants[features]->id();
+
+    // Variants that failed to build stay requested and keep using the generic program
+    if (!_requested[features]) {
+        _requested[features] = true;
+        _queued.push_back(features);
+    }
+
+    return _generic.prog->id();
+}
+
+void ShaderVariants::update() {
+    if (_queued.empty() && _building.empty())
+        return;
+
+    PROFILE_ZONE("ShaderVariants::update");
+
+    // Without parallel compiles the driver may do all the work when a program is submitted
+    // or first polled, one variant at a time keeps it to a single program per frame
+    bool parallel = RHI.supportsParallelCompile();
+
+    uint32 numSubmit = parallel ? (uint32)_queued.size() : (_building.empty() ? 1 : 0);
+    numSubmit = std::min(numSubmit, (uint32)_queued.size());
+
+    for (uint32 q = 0; q < numSubmit; ++q)
+        _building.push_back(submit(_queued[q], true));
+    _queued.erase(_queued.begin(), _queued.begin() + numSubmit);
+
+    // Poll in submission order, a program stays pending until the driver is done with it
+    for (auto it = _building.begin(); it != _building.end();) {
+        ProgramStatus status = it->prog->status();
+        if (status == PROGRAM_PENDING) {
+            ++it;
+            continue;
+        }
+
+        complete(*it, status);
+        it = _building.erase(it);
+    }
+}
+
+void ShaderVariants::finish() {
+    PROFILE_ZONE("ShaderVariants::finish");
+
+    if (!_genericReady) {
+        if (_generic.prog->status(true) != PROGRAM_READY)
+            Utils::throwError("Could not link program " + _name);
+
+        if (_setup)
+            _setup(_generic.prog->id());
+
+        _generic.sources.clear();
+        _genericReady = true;
+    }
+
+    for (const Build& build : _building)
+        complete(build, build.prog->status(true));
+    _building.clear();
+}
+
+bool ShaderVariants::hasPending() const {
+    return !_queued.empty() || !_building.empty();
+}
+
+ShaderVariants::Build ShaderVariants::submit(uint32 features, bool specialized) {
+    vec<std::string> defines;
+    if (specialized) {
+        defines.push_back("SPECIALIZED");
+        for (uint32 f = 0; f < _featureDefines.size(); ++f)
+            if (features & (1u << f))
+                defines.push_back(_featureDefines[f]);
+    }
+
+    Build build;
+    build.features = features;
+
+    uint32 shared = 0;
+    for (const ShaderStage& stage : _stages) {
+        if (stage.specialized)
+            build.sources.push_back(make_sref<ShaderSource>(stage.type, stage.file, defines));
+        else
+            build.sources.push_back(_shared[shared++]);
+    }
+
+    build.prog = make_sref<Shader>(_name);
+    for (const sref<ShaderSource>& source : build.sources)
+        build.prog->addShader(*source);
+
+    build.prog->submit();
+
+    return build;
+}
+
+void ShaderVariants::complete(const Build& build, ProgramStatus status) {
+    if (status != PROGRAM_READY)
+        return; // Error, the link log was already printed
+
+    if (_setup)
+        _setup(build.prog->id());
+
+    _variants[build.features] = build.prog;
+    ++_generation;
+}
+
+uint32 ShaderVariants::generation() const {
+    return _generation;
+}
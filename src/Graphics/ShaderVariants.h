@@ -0,0 +1,83 @@
+#ifndef __PBR_SHADERVARIANTS_H__
+#define __PBR_SHADERVARIANTS_H__
+
+#include <PBR.h>
+#include <Shader.h>
+
+#include <functional>
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    struct ShaderStage {
+        ShaderType  type;
+        std::string file;
+        bool        specialized; // Compiled again for each variant, with its feature defines
+    };
+
+    // Family of programs built from the same sources, one per combination of features
+    // The generic program picks features at runtime and is linked up front,
+    // specialized programs are compiled with SPECIALIZED and one define per feature the first time they are requested
+    // Variants are linked in the background, draws use the generic program until theirs is ready
+    class PBR_SHARED ShaderVariants {
+    public:
+        // Sampler units and block bindings of a newly linked program
+        typedef std::function<void(RRID)> SetupFunc;
+
+        // featureDefines[i] is defined for variants with bit i set in their feature mask
+        // The generic program is only submitted, call finish before drawing with it
+        ShaderVariants(const std::string& name, const vec<ShaderStage>& stages,
+                       const vec<std::string>& featureDefines, const SetupFunc& setup);
+
+        const std::string& name() const;
+
+        const sref<Shader>& generic() const;
+
+        // Specialized program when it is ready, the generic one until then
+        // Missing variants are queued and submitted by the next update
+        RRID program(uint32 features);
+
+        // Submits queued variants and picks up the ones the driver finished, once per frame
+        void update();
+
+        // Waits for every program in flight
+        void finish();
+
+        bool hasPending() const;
+
+        // Changes every time a variant becomes ready, programs picked before may be the generic one
+        uint32 generation() const;
+
+    private:
+        struct Build {
+            uint32       features;
+            sref<Shader> prog;
+            vec<sref<ShaderSource>> sources;  // Kept alive until the link is over
+        };
+
+        Build submit(uint32 features, bool specialized);
+        void  complete(const Build& build, ProgramStatus status);
+
+        std::string       _name;
+        vec<ShaderStage>  _stages;
+        vec<std::string>  _featureDefines;
+        SetupFunc         _setup;
+
+        // Sources of the stages shared by every variant, compiled once
+        vec<sref<ShaderSource>> _shared;
+
+        Build             _generic;
+        bool              _genericReady;
+
+        vec<sref<Shader>> _variants;  // Indexed by feature mask, null until ready
+        vec<bool>         _requested;
+        vec<uint32>       _queued;
+        vec<Build>        _building;
+        uint32            _generation;
+    };
+
+}
+
+#endif
@@ -0,0 +1,334 @@
+#include <TextureStreamer.h>
+
+#include <Texture.h>
+#include <ThreadPool.h>
+#include <Profiler.h>
+
+using namespace pbr;
+
+static const void* levelData(const sref<Image>& img, const sref<Cubemap>& cube, uint32 face, uint32 level) {
+    if (cube)
+        return cube->data((CubemapFace)face, level);
+
+    return img->data(level);
+}
+
+// Faces are laid out one after the other
+static void copyLevel(const sref<Image>& img, const sref<Cubemap>& cube, uint32 level, uint8* dst) {
+    if (!cube) {
+        memcpy(dst, img->data(level), img->size(level));
+        return;
+    }
+
+    uint32 faceSize = cube->size(CUBE_X_POS, level);
+    for (uint32 f = 0; f < 6; ++f)
+        memcpy(dst + f * faceSize, cube->data((CubemapFace)f, level), faceSize);
+}
+
+TextureStreamer::TextureStreamer() : _pendingCopies(make_sref<PendingCopies>()),
+                                     _budget(DEFAULT_TEXTURE_BUDGET), _resident(0), _frame(0) {
+    _pendingCopies->count = 0;
+}
+
+TextureStreamer& TextureStreamer::get() {
+    static TextureStreamer _inst;
+    return _inst;
+}
+
+bool TextureStreamer::streamable(const Image& img) {
+    return img.numLevels() > 1 && (uint32)std::max(img.width(), img.height()) > STREAM_MIN_SIZE;
+}
+
+bool TextureStreamer::streamable(const Cubemap& cube) {
+    return cube.numLevels() > 1 && (uint32)std::max(cube.width(), cube.height()) > STREAM_MIN_SIZE;
+}
+
+RRID TextureStreamer::addTexture(const sref<Image>& img, const TexSampler& sampler) {
+    Entry entry;
+    entry.img       = img;
+    entry.numLevels = img->numLevels();
+
+    return add(entry, IMGTYPE_2D, img->format(), img->width(), img->height(), sampler);
+}
+
+RRID TextureStreamer::addCubemap(const sref<Cubemap>& cube, const TexSampler& sampler) {
+    Entry entry;
+    entry.cube      = cube;
+    entry.numLevels = cube->numLevels();
+
+    return add(entry, IMGTYPE_CUBE, cube->format(), cube->width(), cube->height(), sampler);
+}
+
+RRID TextureStreamer::add(Entry& entry, ImageType type, ImageFormat fmt, uint32 width, uint32 height, const TexSampler& sampler) {
+    entry.size    = std::max(width, height);
+    entry.minBase = entry.numLevels - 1;
+    for (uint32 lvl = 0; lvl < entry.numLevels; ++lvl) {
+        if (mipDimension(entry.size, lvl) <= STREAM_MIN_SIZE) {
+            entry.minBase = lvl;
+            break;
+        }
+    }
+
+    entry.tex = RHI.createStreamedTexture(type, fmt, width, height, sampler, entry.numLevels);
+    if (entry.tex == -1)
+        return -1; // Error
+
+    entry.base     = entry.numLevels;
+    entry.wanted   = entry.minBase;
+    entry.pixels   = 0.0f;
+    entry.lastUsed = _frame;
+    entry.loading  = false;
+
+    // Small levels are uploaded right away, the texture is never sampled without them
+    // Room is made for them like for any other level, they are uploaded even if none could be made
+    size_t smallSize = 0;
+    for (uint32 lvl = entry.minBase; lvl < entry.numLevels; ++lvl)
+        smallSize += levelSize(entry, lvl);
+    makeRoom(smallSize);
+
+    for (uint32 lvl = entry.numLevels; lvl-- > entry.minBase;) {
+        Load load;
+        load.entry  = (uint32)_entries.size();
+        load.level  = lvl;
+        load.region = { nullptr, 0, 0 };
+
+        upload(entry, load);
+        _resident += levelSize(entry, lvl);
+    }
+
+    uint32 slot = handleIndex(entry.tex);
+    if (slot >= _entryOf.size())
+        _entryOf.resize(slot + 1, -1);
+    _entryOf[slot] = (int32)_entries.size();
+
+    _entries.push_back(entry);
+
+    return entry.tex;
+}
+
+bool TextureStreamer::removeTexture(RRID id) {
+    uint32 slot = handleIndex(id);
+    if (slot >= _entryOf.size() || _entryOf[slot] < 0 || _entries[_entryOf[slot]].tex != id)
+        return false; // Not streamed
+
+    // Loads refer to entries by index, they are done before any entry moves
+    waitCopies();
+    finishLoads();
+
+    uint32 index = (uint32)_entryOf[slot];
+    for (uint32 lvl = _entries[index].base; lvl < _entries[index].numLevels; ++lvl)
+        _resident -= levelSize(_entries[index], lvl);
+
+    // The last entry takes its place
+    _entryOf[slot] = -1;
+    if (index + 1 < _entries.size()) {
+        _entries[index] = _entries.back();
+        _entryOf[handleIndex(_entries[index].tex)] = (int32)index;
+    }
+    _entries.pop_back();
+
+    return true;
+}
+
+void TextureStreamer::request(RRID id, float pixels) {
+    uint32 slot = handleIndex(id);
+    if (slot >= _entryOf.size() || _entryOf[slot] < 0)
+        return; // Not streamed
+
+    Entry& entry = _entries[_entryOf[slot]];
+    if (entry.tex != id)
+        return; // Slot reused by another texture
+
+    entry.pixels   = std::max(entry.pixels, pixels);
+    entry.lastUsed = _frame;
+}
+
+void TextureStreamer::update() {
+    if (_entries.empty())
+        return;
+
+    PROFILE_ZONE("TextureStreamer::update");
+
+    // One texel per pixel, textures not requested this frame only need their small levels
+    for (Entry& entry : _entries) {
+        entry.wanted = entry.minBase;
+        if (entry.lastUsed == _frame && entry.pixels > 0.0f) {
+            float level = std::floor(std::log2(entry.size / entry.pixels));
+            entry.wanted = (uint32)std::max(0.0f, std::min(level, (float)entry.minBase));
+        }
+        entry.pixels = 0.0f;
+    }
+
+    if (finishLoads()) {
+        // Also applies a smaller budget
+        makeRoom(0);
+        startLoads();
+    }
+
+    ++_frame;
+}
+
+bool TextureStreamer::empty() const {
+    return _entries.empty();
+}
+
+void TextureStreamer::setBudget(size_t bytes) {
+    _budget = bytes;
+}
+
+size_t TextureStreamer::budget() const {
+    return _budget;
+}
+
+size_t TextureStreamer::residentBytes() const {
+    return _resident;
+}
+
+size_t TextureStreamer::levelSize(const Entry& entry, uint32 level) const {
+    if (entry.cube)
+        return (size_t)entry.cube->size(CUBE_X_POS, level) * 6;
+
+    return entry.img->size(level);
+}
+
+void TextureStreamer::upload(Entry& entry, const Load& load) {
+    uint32 numFaces = entry.cube ? 6 : 1;
+    size_t faceSize = levelSize(entry, load.level) / numFaces;
+
+    RHI.allocTextureLevel(entry.tex, load.level);
+    for (uint32 f = 0; f < numFaces; ++f) {
+        if (load.region.ptr != nullptr)
+            RHI.uploadTexture(entry.tex, f, load.level, load.region, f * faceSize);
+        else
+            RHI.setTextureData(entry.tex, load.level, levelData(entry.img, entry.cube, f, load.level), f);
+    }
+    RHI.setBaseLevel(entry.tex, load.level);
+
+    entry.base    = load.level;
+    entry.loading = false;
+}
+
+bool TextureStreamer::finishLoads() {
+    if (_loads.empty())
+        return true;
+
+    {
+        std::lock_guard<std::mutex> lock(_pendingCopies->mutex);
+        if (_pendingCopies->count > 0)
+            return false; // Workers still copying
+    }
+
+    for (const Load& load : _loads)
+        upload(_entries[load.entry], load);
+
+    RHI.submitStaging();
+    _loads.clear();
+
+    return true;
+}
+
+void TextureStreamer::waitCopies() {
+    std::unique_lock<std::mutex> lock(_pendingCopies->mutex);
+    _pendingCopies->done.wait(lock, [this]() { return _pendingCopies->count == 0; });
+}
+
+void TextureStreamer::startLoads() {
+    vec<uint32> order;
+    for (uint32 e = 0; e < _entries.size(); ++e)
+        if (_entries[e].wanted < _entries[e].base && !_entries[e].loading)
+            order.push_back(e);
+
+    if (order.empty())
+        return;
+
+    // Textures missing the most levels first, one level per texture at a time
+    std::stable_sort(order.begin(), order.end(), [this](uint32 a, uint32 b) {
+        return _entries[a].base - _entries[a].wanted > _entries[b].base - _entries[b].wanted;
+    });
+
+    size_t copied = 0;
+    for (uint32 e : order) {
+        Entry& entry = _entries[e];
+
+        Load load;
+        load.entry  = e;
+        load.level  = entry.base - 1;
+        load.region = { nullptr, 0, 0 };
+
+        size_t size = levelSize(entry, load.level);
+        if (copied > 0 && copied + size > STREAM_UPLOAD_PER_FRAME)
+            break;
+
+        if (!makeRoom(size))
+            break; // Everything resident is in use
+
+        if (size <= STAGING_BUFFER_SIZE && !RHI.allocStaging(size, load.region))
+            break; // Staging memory still in use
+
+        entry.loading = true;
+        _resident += size;
+        copied    += size;
+        _loads.push_back(load);
+    }
+
+    // Copies run on the workers, the uploads are issued by the first update that finds them done
+    // Levels uploaded from the image are not copied
+    uint32 numCopies = 0;
+    for (const Load& load : _loads)
+        if (load.region.ptr != nullptr)
+            ++numCopies;
+
+    {
+        std::lock_guard<std::mutex> lock(_pendingCopies->mutex);
+        _pendingCopies->count = numCopies;
+    }
+
+    for (const Load& load : _loads) {
+        const Entry& entry = _entries[load.entry];
+        sref<PendingCopies> pending = _pendingCopies;
+
+        if (load.region.ptr == nullptr)
+            continue;
+
+        sref<Image>   img   = entry.img;
+        sref<Cubemap> cube  = entry.cube;
+        uint32        level = load.level;
+        uint8*        dst   = load.region.ptr;
+
+        Workers.submit([img, cube, level, dst, pending]() {
+            copyLevel(img, cube, level, dst);
+
+            std::lock_guard<std::mutex> lock(pending->mutex);
+            if (--pending->count == 0)
+                pending->done.notify_all();
+        });
+    }
+}
+
+bool TextureStreamer::makeRoom(size_t size) {
+    while (_resident + size > _budget) {
+        // Least recently used texture holding levels it does not need
+        int32 victim = -1;
+        for (uint32 e = 0; e < _entries.size(); ++e) {
+            const Entry& entry = _entries[e];
+            if (entry.loading || entry.base >= entry.wanted)
+                continue;
+
+            if (victim == -1 || entry.lastUsed < _entries[victim].lastUsed)
+                victim = (int32)e;
+        }
+
+        if (victim == -1)
+            return false;
+
+        // Stop sampling the level before freeing it
+        Entry& entry = _entries[victim];
+        RHI.setBaseLevel(entry.tex, entry.base + 1);
+        RHI.freeTextureLevel(entry.tex, entry.base);
+
+        _resident -= levelSize(entry, entry.base);
+        ++entry.base;
+    }
+
+    return true;
+}
@@ -0,0 +1,116 @@
+#ifndef __PBR_TEXTURESTREAMER_H__
+#define __PBR_TEXTURESTREAMER_H__
+
+#include <PBR.h>
+#include <Image.h>
+#include <RenderInterface.h>
+
+#include <condition_variable>
+#include <mutex>
+
+// Macro to syntax sugar the singleton getter
+#define Streamer TextureStreamer::get()
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    class TexSampler;
+
+    // GPU memory for the resident levels of streamed textures
+    static PBR_CONSTEXPR size_t DEFAULT_TEXTURE_BUDGET = 512 * 1024 * 1024;
+
+    // Levels up to this size are loaded with the texture and never evicted
+    // They count against the budget, the budget is only exceeded when nothing else can be evicted for them
+    static PBR_CONSTEXPR uint32 STREAM_MIN_SIZE = 128;
+
+    // Level data copied to staging memory per frame, keeps streaming from causing long frames
+    static PBR_CONSTEXPR size_t STREAM_UPLOAD_PER_FRAME = 8 * 1024 * 1024;
+
+    // Streams texture levels in and out of GPU memory
+    // Textures start with their small levels resident, the renderer requests higher levels from the screen size
+    // of the shapes using them. Missing levels are copied to staging memory on the worker threads and uploaded
+    // by the next update, within the memory budget. Over budget, levels no longer needed are evicted from the
+    // least recently used textures first.
+    // The decoded or mapped image stays in system memory and provides the levels, everything runs on the render thread
+    class PBR_SHARED TextureStreamer {
+    public:
+        static TextureStreamer& get();
+
+        // Worth streaming, it has levels above STREAM_MIN_SIZE
+        static bool streamable(const Image& img);
+        static bool streamable(const Cubemap& cube);
+
+        RRID addTexture(const sref<Image>& img, const TexSampler& sampler);
+        RRID addCubemap(const sref<Cubemap>& cube, const TexSampler& sampler);
+        // Stops streaming the texture, the caller deletes it. Waits for the copies in flight
+        bool removeTexture(RRID id);
+
+        // Size in pixels the texture covers on screen this frame, the largest request wins
+        void request(RRID id, float pixels);
+
+        // Once per frame, after every request
+        void update();
+
+        bool empty() const;
+
+        void   setBudget(size_t bytes);
+        size_t budget() const;
+        size_t residentBytes() const;
+
+    private:
+        TextureStreamer();
+
+        struct Entry {
+            RRID          tex;
+            sref<Image>   img;
+            sref<Cubemap> cube;
+            uint32        numLevels;
+            uint32        size;       // Largest dimension of level 0
+            uint32        base;       // Highest resolution level resident
+            uint32        minBase;    // Levels from here on are always resident
+            uint32        wanted;
+            float         pixels;
+            uint64        lastUsed;   // Frame of the last request
+            bool          loading;
+        };
+
+        struct Load {
+            uint32        entry;
+            uint32        level;
+            StagingRegion region;   // Null for levels too large for staging memory, uploaded from the image
+        };
+
+        RRID   add(Entry& entry, ImageType type, ImageFormat fmt, uint32 width, uint32 height, const TexSampler& sampler);
+        size_t levelSize(const Entry& entry, uint32 level) const;
+        void   upload(Entry& entry, const Load& load);
+
+        bool finishLoads();
+        // Blocks until the workers are done with the copies in flight
+        void waitCopies();
+        void startLoads();
+        bool makeRoom(size_t size);
+
+        vec<Entry>  _entries;
+        vec<int32>  _entryOf;   // Entry of each texture slot, -1 when not streamed
+
+        // Copies still running, shared with the worker tasks
+        struct PendingCopies {
+            std::mutex              mutex;
+            std::condition_variable done;
+            uint32                  count;
+        };
+
+        // Levels being copied to staging memory, uploaded once every copy is done
+        vec<Load>           _loads;
+        sref<PendingCopies> _pendingCopies;
+
+        size_t _budget;
+        size_t _resident;
+        uint64 _frame;
+    };
+
+}
+
+#endif
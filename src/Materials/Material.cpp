@@ -1,13 +1,80 @@
 #include <Material.h>
 
 #include <RenderInterface.h>
+#include <Resources.h>
+
+#include <mutex>
 
 using namespace pbr;
 
+// Slots are handed out in order and reused once freed
+static std::mutex          slotMutex;
+static std::vector<uint32> freeSlots;
+static uint32              nextSlot = DEFAULT_MATERIAL_SLOT + 1;
+
+static uint32 acquireSlot() {
+    std::lock_guard<std::mutex> lock(slotMutex);
+    if (!freeSlots.empty()) {
+        uint32 slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // The first slot of every page holds the default material
+    if (nextSlot % MAX_MATERIALS == DEFAULT_MATERIAL_SLOT)
+        ++nextSlot;
+
+    return nextSlot++;
+}
+
+static void releaseSlot(uint32 slot) {
+    std::lock_guard<std::mutex> lock(slotMutex);
+    freeSlots.push_back(slot);
+}
+
+Material::Material() : _prog(0), _progFeatures(~0u), _index(acquireSlot()), _dirty(true) { }
+
+uint32 Material::numSlots() {
+    std::lock_guard<std::mutex> lock(slotMutex);
+    return nextSlot;
+}
+
+Material::~Material() {
+    releaseSlot(_index);
+
+    for (RRID id : _heldTextures)
+        Resource.releaseTexture(id);
+}
+
 void Material::use() const {
     RHI.useProgram(_prog);
 }
 
 RRID Material::program() const {
     return _prog;
-}
\ No newline at end of file
+}
+
+void Material::setVariantProgram(RRID prog, uint32 features) {
+    _prog         = prog;
+    _progFeatures = features;
+}
+
+bool Material::needsVariantProgram(uint32 features) const {
+    return features != _progFeatures;
+}
+
+uint32 Material::index() const {
+    return _index;
+}
+
+bool Material::isDirty() const {
+    return _dirty;
+}
+
+void Material::clearDirty() {
+    _dirty = false;
+}
+
+void Material::holdTexture(RRID id) {
+    _heldTextures.push_back(id);
+}
@@ -2,23 +2,106 @@
 #define __PBR_MATERIAL_H__
 
 #include <PBR.h>
+#include <PBRMath.h>
 
 #include <Skybox.h>
 
+using namespace pbr::math;
+
 namespace pbr {
 
+    // Material data for shader blocks
+    // CARE: data follows std140 layout, do not change
+    struct MaterialData {
+        Vec4  diffuse;    // Negative when sampled from a texture
+        Vec4  specular;
+        float metallic;   // Negative when sampled from a texture
+        float roughness;  // Negative when sampled from a texture
+        float aux[2];
+    }; // 48 Bytes
+
+    // Slots in one page of the shared material buffer, matches MAX_MATERIALS in unreal.fs
+    // The buffer grows a page at a time, shaders see the page of the draw and index it with slot % MAX_MATERIALS
+    static PBR_CONSTEXPR uint32 MAX_MATERIALS = 256;
+
+    // Slot of every page holding a neutral material, for draws without a material
+    static PBR_CONSTEXPR uint32 DEFAULT_MATERIAL_SLOT = 0;
+
+    // Features a material program is specialized for, each one enables a define in unreal.fs
+    enum MaterialFeature : uint32 {
+        FEATURE_DIFFUSE_TEX  = 1 << 0,  // HAS_DIFFUSE_TEX
+        FEATURE_NORMAL_MAP   = 1 << 1,  // HAS_NORMAL_MAP
+        FEATURE_METALLIC_TEX = 1 << 2,  // HAS_METALLIC_TEX
+        FEATURE_ROUGH_TEX    = 1 << 3   // HAS_ROUGH_TEX
+    };
+
+    // Textures bound by a material, unused entries are -1
+    static PBR_CONSTEXPR uint32 MAX_MATERIAL_TEXTURES = 8;
+
+    struct TextureSet {
+        RRID textures[MAX_MATERIAL_TEXTURES];
+
+        bool operator==(const TextureSet& other) const {
+            return std::equal(textures, textures + MAX_MATERIAL_TEXTURES, other.textures);
+        }
+
+        bool operator<(const TextureSet& other) const {
+            return std::lexicographical_compare(textures, textures + MAX_MATERIAL_TEXTURES,
+                                                other.textures, other.textures + MAX_MATERIAL_TEXTURES);
+        }
+    };
+
     class PBR_SHARED Material {
     public:
-        Material() { }
+        Material();
+        virtual ~Material();
+
+        // Materials own their slot
+        Material(const Material&) = delete;
+        Material& operator=(const Material&) = delete;
 
         void use() const;
         RRID program() const;
 
+        // Program the renderer picked for features
+        void setVariantProgram(RRID prog, uint32 features);
+        // True when the program was not picked for these features yet
+        bool needsVariantProgram(uint32 features) const;
+
+        // Slot of the material in the shared material buffer, slots of destroyed materials are reused
+        uint32 index() const;
+        // Slots handed out so far, the material buffer holds at least this many
+        static uint32 numSlots();
+
+        // Dirty materials need their block rewritten in the material buffer
+        bool isDirty() const;
+        void clearDirty();
+
         virtual void update(const Skybox& skybox) = 0;
         virtual void uploadData() const = 0;
+        virtual void toData(MaterialData& data) const = 0;
+
+        // Materials with the same set bind the same textures
+        // and can share a multi-draw call
+        virtual TextureSet textureSet() const = 0;
+
+        // Cached texture the material took a reference on, released through Resources when it is destroyed
+        // Materials holding textures must be destroyed on the GL thread
+        void holdTexture(RRID id);
+
+        // Mask of MaterialFeature used by the material
+        virtual uint32 features() const = 0;
+
+        // Screen size in pixels of a shape using the material, streams in the levels its textures need
+        virtual void requestTextures(float pixels) const = 0;
 
     protected:
-        RRID _prog;
+        RRID   _prog;
+        uint32 _progFeatures;   // Features _prog was picked for, ~0u before the first pick
+        uint32 _index;
+        bool   _dirty;
+
+        std::vector<RRID> _heldTextures;
     };
 
 }
@@ -1,5 +1,7 @@
 #include <PBRMaterial.h>
 
+#include <TextureStreamer.h>
+
 using namespace pbr;
 
 PBRMaterial::PBRMaterial() : _metallic(1.0f), _roughness(0.0f), _f0(0.04f) {
@@ -12,6 +14,9 @@ PBRMaterial::PBRMaterial() : _metallic(1.0f), _roughness(0.0f), _f0(0.04f) {
     _metallicTex = -1;
     _roughTex    = -1;
 
+    _irradianceTex = -1;
+    _ggxTex        = -1;
+
     _diffuse   = Color(-1);
     _metallic  = -1;
     _roughness = -1;
@@ -24,11 +29,8 @@ void PBRMaterial::update(const Skybox& skybox) {
 
 void PBRMaterial::uploadData() const {
     //RHI.useProgram(_prog);
-    
-    RHI.setFloat("metallic", _metallic);
-    RHI.setFloat("roughness", _roughness);
-    RHI.setVector3("spec", Vec3(_f0.r, _f0.g, _f0.b));
-    RHI.setVector3("diffuse", Vec3(_diffuse.r, _diffuse.g, _diffuse.b));
+
+    // Constant parameters live in the material buffer (see toData)
 
     // Set diffuse texture
     if (_diffuseTex != -1) {
@@ -51,11 +53,16 @@ void PBRMaterial::uploadData() const {
         RHI.setSampler("roughTex", 4);
     }
 
-    RHI.bindTexture(6, _irradianceTex);
-    RHI.setSampler("irradianceTex", 6);
+    // Environment maps are only set once the material is updated with a skybox
+    if (_irradianceTex != -1) {
+        RHI.bindTexture(6, _irradianceTex);
+        RHI.setSampler("irradianceTex", 6);
+    }
 
-    RHI.bindTexture(7, _ggxTex);
-    RHI.setSampler("ggxTex", 7);
+    if (_ggxTex != -1) {
+        RHI.bindTexture(7, _ggxTex);
+        RHI.setSampler("ggxTex", 7);
+    }
     
     RHI.bindTexture(8, _brdfTex);
     RHI.setSampler("brdfTex", 8);
@@ -63,6 +70,43 @@ void PBRMaterial::uploadData() const {
     //RHI.useProgram(0);
 }
 
+void PBRMaterial::toData(MaterialData& data) const {
+    data.diffuse   = Vec4(_diffuse.r, _diffuse.g, _diffuse.b, 1.0f);
+    data.specular  = Vec4(_f0.r, _f0.g, _f0.b, 1.0f);
+    data.metallic  = _metallic;
+    data.roughness = _roughness;
+}
+
+TextureSet PBRMaterial::textureSet() const {
+    TextureSet set = { { _diffuseTex, _normalTex, _metallicTex, _roughTex,
+                         _irradianceTex, _ggxTex, _brdfTex, -1 } };
+    return set;
+}
+
+uint32 PBRMaterial::features() const {
+    uint32 features = 0;
+
+    // Same conditions the generic program checks at runtime
+    if (_diffuse.r < 0.0f)
+        features |= FEATURE_DIFFUSE_TEX;
+    if (_normalTex != -1)
+        features |= FEATURE_NORMAL_MAP;
+    if (_metallic < 0.0f)
+        features |= FEATURE_METALLIC_TEX;
+    if (_roughness < 0.0f)
+        features |= FEATURE_ROUGH_TEX;
+
+    return features;
+}
+
+void PBRMaterial::requestTextures(float pixels) const {
+    const RRID texs[] = { _diffuseTex, _normalTex, _metallicTex, _roughTex };
+
+    for (RRID tex : texs)
+        if (tex != -1)
+            Streamer.request(tex, pixels);
+}
+
 void PBRMaterial::setIrradianceTex(RRID id) {
     _irradianceTex = id;
 }
@@ -81,6 +125,7 @@ void PBRMaterial::setDiffuse(RRID diffTex) {
 
 void PBRMaterial::setDiffuse(const Color& diffuse) {
     _diffuse = diffuse;
+    _dirty = true;
 }
 
 void PBRMaterial::setNormal(RRID normalTex) {
@@ -89,6 +134,7 @@ void PBRMaterial::setNormal(RRID normalTex) {
 
 void PBRMaterial::setSpecular(const Color& spec) {
     _f0 = spec;
+    _dirty = true;
 }
 
 void PBRMaterial::setMetallic(RRID metalTex) {
@@ -97,6 +143,7 @@ void PBRMaterial::setMetallic(RRID metalTex) {
 
 void PBRMaterial::setMetallic(float metallic) {
     _metallic = metallic;
+    _dirty = true;
 }
 
 void PBRMaterial::setRoughness(RRID roughTex) {
@@ -105,6 +152,7 @@ void PBRMaterial::setRoughness(RRID roughTex) {
 
 void PBRMaterial::setRoughness(float roughness) {
     _roughness = roughness;
+    _dirty = true;
 }
 
 float PBRMaterial::metallic() const {
@@ -19,6 +19,10 @@ namespace pbr {
 
         void update(const Skybox& skybox);
         void uploadData() const;
+        void toData(MaterialData& data) const;
+        TextureSet textureSet() const;
+        uint32 features() const;
+        void requestTextures(float pixels) const;
 
         void setDiffuse(RRID diffTex);
         void setDiffuse(const Color& diffuse);
@@ -32,6 +32,11 @@
 #define PBR_GNUC
 #endif
 
+// SSE2 is always there on x64, 32-bit builds need /arch:SSE2 (or -msse2)
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PBR_SSE2
+#endif
+
 #if defined(_MSC_VER) && _MSC_VER == 1800
 #define PBR_MSVC2013
 #endif
@@ -61,6 +66,11 @@
 #define PBR_SHARED  
 #endif
 
+// Debug builds check for GL errors after every RHI call, see RHI_CALL
+#if defined(_DEBUG) && !defined(PBR_GL_CHECKS)
+#define PBR_GL_CHECKS
+#endif
+
 #define make_sref std::make_shared
 
 namespace pbr {
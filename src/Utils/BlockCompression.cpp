@@ -0,0 +1,455 @@
+#include <BlockCompression.h>
+
+#include <cstring>
+
+#ifdef PBR_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace pbr;
+
+// Pixels of a block split by channel, the index search reads 4 pixels of a channel at once
+struct BlockPixels {
+    float ch[4][16];
+};
+
+// Position of each index between the first and the second endpoint
+static const float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const float BC4_WEIGHTS[8] = { 0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f };
+static const uint32 BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static void loadBlock(const uint8* rgba, BlockPixels& block) {
+    for (uint32 p = 0; p < 16; ++p)
+        for (uint32 c = 0; c < 4; ++c)
+            block.ch[c][p] = rgba[4 * p + c];
+}
+
+static float clampEndpoint(float val) {
+    return std::max(0.0f, std::min(val, 255.0f));
+}
+
+// Closest palette entry of every pixel, returns the squared error of the block
+static float fitIndices(const BlockPixels& block, const float palette[][4], uint32 numEntries,
+                        uint32 numChannels, uint8* indices) {
+#ifdef PBR_SSE2
+    __m128 total = _mm_setzero_ps();
+    for (uint32 p = 0; p < 16; p += 4) {
+        __m128 pixels[4];
+        for (uint32 c = 0; c < numChannels; ++c)
+            pixels[c] = _mm_loadu_ps(&block.ch[c][p]);
+
+        __m128  best    = _mm_set1_ps(std::numeric_limits<float>::max());
+        __m128i bestIdx = _mm_setzero_si128();
+        for (uint32 e = 0; e < numEntries; ++e) {
+            __m128 dist = _mm_setzero_ps();
+            for (uint32 c = 0; c < numChannels; ++c) {
+                __m128 diff = _mm_sub_ps(pixels[c], _mm_set1_ps(palette[e][c]));
+                dist = _mm_add_ps(dist, _mm_mul_ps(diff, diff));
+            }
+
+            __m128i closer = _mm_castps_si128(_mm_cmplt_ps(dist, best));
+            best    = _mm_min_ps(dist, best);
+            bestIdx = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(e)), _mm_andnot_si128(closer, bestIdx));
+        }
+
+        int32 idx[4];
+        _mm_storeu_si128((__m128i*)idx, bestIdx);
+        for (uint32 i = 0; i < 4; ++i)
+            indices[p + i] = (uint8)idx[i];
+
+        total = _mm_add_ps(total, best);
+    }
+
+    float sums[4];
+    _mm_storeu_ps(sums, total);
+    return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+    float total = 0.0f;
+    for (uint32 p = 0; p < 16; ++p) {
+        float best = std::numeric_limits<float>::max();
+        for (uint32 e = 0; e < numEntries; ++e) {
+            float dist = 0.0f;
+            for (uint32 c = 0; c < numChannels; ++c) {
+                float diff = block.ch[c][p] - palette[e][c];
+                dist += diff * diff;
+            }
+
+            if (dist < best) {
+                best = dist;
+                indices[p] = (uint8)e;
+            }
+        }
+        total += best;
+    }
+    return total;
+#endif
+}
+
+// Extremes of the pixels along their principal axis, found by power iteration on the covariance
+static void principalEndpoints(const BlockPixels& block, uint32 numChannels, float e0[4], float e1[4]) {
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (uint32 c = 0; c < numChannels; ++c) {
+        float minVal = block.ch[c][0];
+        float maxVal = block.ch[c][0];
+        for (uint32 p = 0; p < 16; ++p) {
+            mean[c] += block.ch[c][p];
+            minVal = std::min(minVal, block.ch[c][p]);
+            maxVal = std::max(maxVal, block.ch[c][p]);
+        }
+        mean[c] /= 16.0f;
+        axis[c]  = maxVal - minVal;
+    }
+
+    float cov[4][4] = { };
+    for (uint32 p = 0; p < 16; ++p)
+        for (uint32 i = 0; i < numChannels; ++i)
+            for (uint32 j = i; j < numChannels; ++j)
+                cov[i][j] += (block.ch[i][p] - mean[i]) * (block.ch[j][p] - mean[j]);
+
+    for (uint32 i = 0; i < numChannels; ++i)
+        for (uint32 j = 0; j < i; ++j)
+            cov[i][j] = cov[j][i];
+
+    // Starts from the bounding box diagonal, a few iterations are enough for 16 pixels
+    for (uint32 it = 0; it < 8; ++it) {
+        float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float norm = 0.0f;
+        for (uint32 i = 0; i < numChannels; ++i) {
+            for (uint32 j = 0; j < numChannels; ++j)
+                next[i] += cov[i][j] * axis[j];
+            norm = std::max(norm, std::abs(next[i]));
+        }
+
+        if (norm < 1e-6f)
+            break;
+
+        for (uint32 i = 0; i < numChannels; ++i)
+            axis[i] = next[i] / norm;
+    }
+
+    float len = 0.0f;
+    for (uint32 c = 0; c < numChannels; ++c)
+        len += axis[c] * axis[c];
+
+    float minT = 0.0f;
+    float maxT = 0.0f;
+    if (len > 1e-12f) {
+        len = std::sqrt(len);
+        for (uint32 c = 0; c < numChannels; ++c)
+            axis[c] /= len;
+
+        minT = std::numeric_limits<float>::max();
+        maxT = -minT;
+        for (uint32 p = 0; p < 16; ++p) {
+            float t = 0.0f;
+            for (uint32 c = 0; c < numChannels; ++c)
+                t += (block.ch[c][p] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+    }
+
+    for (uint32 c = 0; c < 4; ++c) {
+        e0[c] = clampEndpoint(mean[c] + axis[c] * maxT);
+        e1[c] = clampEndpoint(mean[c] + axis[c] * minT);
+    }
+}
+
+// Endpoints minimizing the squared error for the indices found, false when they are degenerate
+static bool refineEndpoints(const BlockPixels& block, uint32 numChannels, const uint8* indices,
+                            const float* weights, float e0[4], float e1[4]) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    float bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (uint32 p = 0; p < 16; ++p) {
+        float b = weights[indices[p]];
+        float a = 1.0f - b;
+
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (uint32 c = 0; c < numChannels; ++c) {
+            ax[c] += a * block.ch[c][p];
+            bx[c] += b * block.ch[c][p];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f)
+        return false;
+
+    for (uint32 c = 0; c < numChannels; ++c) {
+        e0[c] = clampEndpoint((bb * ax[c] - ab * bx[c]) / det);
+        e1[c] = clampEndpoint((aa * bx[c] - ab * ax[c]) / det);
+    }
+
+    return true;
+}
+
+/* ==============================================================================
+        BC1
+ ============================================================================== */
+static uint16 toRGB565(const float color[4]) {
+    uint32 r = (uint32)(color[0] * 31.0f / 255.0f + 0.5f);
+    uint32 g = (uint32)(color[1] * 63.0f / 255.0f + 0.5f);
+    uint32 b = (uint32)(color[2] * 31.0f / 255.0f + 0.5f);
+    return (uint16)((r << 11) | (g << 5) | b);
+}
+
+static void fromRGB565(uint16 color, float out[4]) {
+    uint32 r = (color >> 11) & 31;
+    uint32 g = (color >> 5)  & 63;
+    uint32 b =  color        & 31;
+    out[0] = (float)((r << 3) | (r >> 2));
+    out[1] = (float)((g << 2) | (g >> 4));
+    out[2] = (float)((b << 3) | (b >> 2));
+    out[3] = 255.0f;
+}
+
+// The first endpoint is kept greater, equal endpoints leave a single color
+static float fitBC1(const BlockPixels& block, const float e0[4], const float e1[4],
+                    uint16& c0, uint16& c1, uint8* indices) {
+    c0 = toRGB565(e0);
+    c1 = toRGB565(e1);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    float palette[4][4];
+    fromRGB565(c0, palette[0]);
+    fromRGB565(c1, palette[1]);
+    for (uint32 c = 0; c < 3; ++c) {
+        palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+        palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+    }
+
+    return fitIndices(block, palette, c0 == c1 ? 1 : 4, 3, indices);
+}
+
+static void encodeColor(const BlockPixels& block, uint8* out) {
+    float e0[4], e1[4];
+    principalEndpoints(block, 3, e0, e1);
+
+    uint16 c0, c1;
+    uint8  indices[16];
+    float  error = fitBC1(block, e0, e1, c0, c1, indices);
+
+    // Fit may have swapped the endpoints, the weights follow the quantized order
+    float r0[4], r1[4];
+    fromRGB565(c0, r0);
+    fromRGB565(c1, r1);
+
+    uint16 rc0, rc1;
+    uint8  refined[16];
+    if (c0 != c1 && refineEndpoints(block, 3, indices, BC1_WEIGHTS, r0, r1) &&
+        fitBC1(block, r0, r1, rc0, rc1, refined) < error) {
+        c0 = rc0;
+        c1 = rc1;
+        memcpy(indices, refined, 16);
+    }
+
+    uint32 bits = 0;
+    for (uint32 p = 0; p < 16; ++p)
+        bits |= (uint32)indices[p] << (2 * p);
+
+    out[0] = (uint8)(c0 & 0xFF);
+    out[1] = (uint8)(c0 >> 8);
+    out[2] = (uint8)(c1 & 0xFF);
+    out[3] = (uint8)(c1 >> 8);
+    for (uint32 i = 0; i < 4; ++i)
+        out[4 + i] = (uint8)(bits >> (8 * i));
+}
+
+void pbr::encodeBC1(const uint8* rgba, uint8* block) {
+    BlockPixels pixels;
+    loadBlock(rgba, pixels);
+    encodeColor(pixels, block);
+}
+
+void pbr::encodeBC2(const uint8* rgba, uint8* block) {
+    BlockPixels pixels;
+    loadBlock(rgba, pixels);
+
+    for (uint32 p = 0; p < 16; p += 2) {
+        uint32 a0 = (rgba[4 * p + 3]       * 15 + 127) / 255;
+        uint32 a1 = (rgba[4 * (p + 1) + 3] * 15 + 127) / 255;
+        block[p / 2] = (uint8)(a0 | (a1 << 4));
+    }
+
+    encodeColor(pixels, block + 8);
+}
+
+void pbr::encodeBC3(const uint8* rgba, uint8* block) {
+    encodeBC4(rgba, 3, block);
+    encodeBC1(rgba, block + 8);
+}
+
+/* ==============================================================================
+        BC4 and BC5
+ ============================================================================== */
+// 8 value mode, the first endpoint is kept greater
+static float fitBC4(const BlockPixels& block, float e0, float e1, uint8& a0, uint8& a1, uint8* indices) {
+    a0 = (uint8)(std::max(e0, e1) + 0.5f);
+    a1 = (uint8)(std::min(e0, e1) + 0.5f);
+
+    float palette[8][4];
+    palette[0][0] = a0;
+    palette[1][0] = a1;
+    for (uint32 i = 2; i < 8; ++i)
+        palette[i][0] = ((8 - i) * a0 + (i - 1) * a1) / 7.0f;
+
+    return fitIndices(block, palette, a0 == a1 ? 1 : 8, 1, indices);
+}
+
+void pbr::encodeBC4(const uint8* rgba, uint32 channel, uint8* block) {
+    BlockPixels pixels;
+    float minVal = 255.0f;
+    float maxVal = 0.0f;
+    for (uint32 p = 0; p < 16; ++p) {
+        pixels.ch[0][p] = rgba[4 * p + channel];
+        minVal = std::min(minVal, pixels.ch[0][p]);
+        maxVal = std::max(maxVal, pixels.ch[0][p]);
+    }
+
+    uint8 a0, a1;
+    uint8 indices[16];
+    float error = fitBC4(pixels, maxVal, minVal, a0, a1, indices);
+
+    float r0[4] = { (float)a0 }, r1[4] = { (float)a1 };
+    uint8 ra0, ra1;
+    uint8 refined[16];
+    if (a0 != a1 && refineEndpoints(pixels, 1, indices, BC4_WEIGHTS, r0, r1) &&
+        fitBC4(pixels, r0[0], r1[0], ra0, ra1, refined) < error) {
+        a0 = ra0;
+        a1 = ra1;
+        memcpy(indices, refined, 16);
+    }
+
+    uint64 bits = 0;
+    for (uint32 p = 0; p < 16; ++p)
+        bits |= (uint64)indices[p] << (3 * p);
+
+    block[0] = a0;
+    block[1] = a1;
+    for (uint32 i = 0; i < 6; ++i)
+        block[2 + i] = (uint8)(bits >> (8 * i));
+}
+
+void pbr::encodeBC5(const uint8* rgba, uint8* block) {
+    encodeBC4(rgba, 0, block);
+    encodeBC4(rgba, 1, block + 8);
+}
+
+/* ==============================================================================
+        BC7
+ ============================================================================== */
+// 7 bits per channel and a shared low bit per endpoint, the low bit with the smallest error wins
+static void quantizeBC7(const float endpoint[4], uint8 quant[4], uint32& pbit) {
+    float bestError = std::numeric_limits<float>::max();
+    for (uint32 p = 0; p < 2; ++p) {
+        uint8 q[4];
+        float error = 0.0f;
+        for (uint32 c = 0; c < 4; ++c) {
+            int32 val = (int32)((endpoint[c] - p) * 0.5f + 0.5f);
+            q[c] = (uint8)std::max(0, std::min(val, 127));
+
+            float diff = endpoint[c] - (float)((q[c] << 1) | p);
+            error += diff * diff;
+        }
+
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            memcpy(quant, q, 4);
+        }
+    }
+}
+
+static float fitBC7(const BlockPixels& block, const float e0[4], const float e1[4],
+                    uint8 q0[4], uint8 q1[4], uint32& p0, uint32& p1, uint8* indices) {
+    quantizeBC7(e0, q0, p0);
+    quantizeBC7(e1, q1, p1);
+
+    // Interpolated exactly as the hardware does
+    float palette[16][4];
+    for (uint32 c = 0; c < 4; ++c) {
+        uint32 a = (q0[c] << 1) | p0;
+        uint32 b = (q1[c] << 1) | p1;
+        for (uint32 i = 0; i < 16; ++i)
+            palette[i][c] = (float)(((64 - BC7_WEIGHTS[i]) * a + BC7_WEIGHTS[i] * b + 32) >> 6);
+    }
+
+    return fitIndices(block, palette, 16, 4, indices);
+}
+
+// Writes bits starting at the lowest bit of the block
+static void writeBits(uint8* block, uint32& pos, uint32 value, uint32 numBits) {
+    for (uint32 i = 0; i < numBits; ++i, ++pos)
+        if (value & (1u << i))
+            block[pos >> 3] |= (uint8)(1u << (pos & 7));
+}
+
+void pbr::encodeBC7(const uint8* rgba, uint8* block) {
+    BlockPixels pixels;
+    loadBlock(rgba, pixels);
+
+    float e0[4], e1[4];
+    principalEndpoints(pixels, 4, e0, e1);
+
+    uint8  q0[4], q1[4];
+    uint32 p0, p1;
+    uint8  indices[16];
+    float  error = fitBC7(pixels, e0, e1, q0, q1, p0, p1, indices);
+
+    float weights[16];
+    for (uint32 i = 0; i < 16; ++i)
+        weights[i] = BC7_WEIGHTS[i] / 64.0f;
+
+    uint8  rq0[4], rq1[4];
+    uint32 rp0, rp1;
+    uint8  refined[16];
+    if (refineEndpoints(pixels, 4, indices, weights, e0, e1) &&
+        fitBC7(pixels, e0, e1, rq0, rq1, rp0, rp1, refined) < error) {
+        memcpy(q0, rq0, 4);
+        memcpy(q1, rq1, 4);
+        p0 = rp0;
+        p1 = rp1;
+        memcpy(indices, refined, 16);
+    }
+
+    // The high bit of the first index is implicit, swapping the endpoints clears it
+    if (indices[0] & 8) {
+        std::swap(q0, q1);
+        std::swap(p0, p1);
+        for (uint32 p = 0; p < 16; ++p)
+            indices[p] = 15 - indices[p];
+    }
+
+    memset(block, 0, 16);
+
+    uint32 pos = 0;
+    writeBits(block, pos, 1u << 6, 7);
+    for (uint32 c = 0; c < 4; ++c) {
+        writeBits(block, pos, q0[c], 7);
+        writeBits(block, pos, q1[c], 7);
+    }
+    writeBits(block, pos, p0, 1);
+    writeBits(block, pos, p1, 1);
+
+    writeBits(block, pos, indices[0], 3);
+    for (uint32 p = 1; p < 16; ++p)
+        writeBits(block, pos, indices[p], 4);
+}
+
+bool pbr::encodeBlock(ImageFormat format, const uint8* rgba, uint8* block) {
+    switch (format) {
+        case IMGFMT_DXT1:  encodeBC1(rgba, block);    return true;
+        case IMGFMT_DXT3:  encodeBC2(rgba, block);    return true;
+        case IMGFMT_DXT5:  encodeBC3(rgba, block);    return true;
+        case IMGFMT_ATI1N: encodeBC4(rgba, 0, block); return true;
+        case IMGFMT_ATI2N: encodeBC5(rgba, block);    return true;
+        case IMGFMT_BC7:   encodeBC7(rgba, block);    return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef __PBR_BLOCKCOMPRESSION_H__
+#define __PBR_BLOCKCOMPRESSION_H__
+
+#include <PBR.h>
+#include <Image.h>
+
+namespace pbr {
+
+    // Block encoders, rgba holds the 16 pixels of a 4x4 block in row order, 4 bytes each
+    // Endpoints are fit on the principal axis of the block then refined with least squares,
+    // the index search runs 4 pixels at a time with SSE2
+
+    // Color only, always in 4 color mode (8 bytes)
+    void encodeBC1(const uint8* rgba, uint8* block);
+    // BC1 color with explicit 4-bit alpha (16 bytes)
+    void encodeBC2(const uint8* rgba, uint8* block);
+    // BC1 color with interpolated alpha (16 bytes)
+    void encodeBC3(const uint8* rgba, uint8* block);
+    // Single channel of the pixels (8 bytes)
+    void encodeBC4(const uint8* rgba, uint32 channel, uint8* block);
+    // Red and green channels, two BC4 blocks (16 bytes)
+    void encodeBC5(const uint8* rgba, uint8* block);
+    // Mode 6 only, one subset with RGBA endpoints and 16 indices (16 bytes)
+    void encodeBC7(const uint8* rgba, uint8* block);
+
+    // Encodes with the encoder of a compressed format, false for other formats
+    bool encodeBlock(ImageFormat format, const uint8* rgba, uint8* block);
+
+}
+
+#endif
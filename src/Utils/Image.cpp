@@ -2,12 +2,22 @@
 
 #include <sstream>
 #include <fstream>
+#include <deque>
 #include <path.h>
 
 #include <lodepng.h>
 
 #include <zlib.h>
 
+#include <Profiler.h>
+#include <ThreadPool.h>
+#include <MappedFile.h>
+#include <BlockCompression.h>
+
+#ifdef PBR_SSE2
+#include <emmintrin.h>
+#endif
+
 /*
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
@@ -35,7 +45,7 @@ uint32 pbr::formatToNumChannels(ImageFormat format) {
         1, 2, 3, 4,       // 32-bit signed integer
         0, 0, 0, 0, 0, 0, // Packed
         1, 1, 2, 1,       // Depth
-        0, 0, 0, 0, 0     // Compressed
+        0, 0, 0, 0, 0, 0  // Compressed
     };
 
     return channels[format];
@@ -75,7 +85,7 @@ ImageComponent pbr::formatToImgComp(ImageFormat format) {
         UNKNOWN, UNKNOWN, UNKNOWN,
         FLOAT, FLOAT, FLOAT, FLOAT,       // Depth
         UNKNOWN, UNKNOWN, UNKNOWN,        // Compressed
-        UNKNOWN, UNKNOWN
+        UNKNOWN, UNKNOWN, UNKNOWN
     };
 
     return cmp[format];
@@ -86,6 +96,18 @@ uint32 pbr::mipDimension(uint32 baseDim, uint32 level) {
     return (dim == 0) ? 1 : dim;
 }
 
+bool pbr::isCompressed(ImageFormat format) {
+    return format >= IMGFMT_DXT1 && format <= IMGFMT_BC7;
+}
+
+uint32 pbr::formatToBlockSize(ImageFormat format) {
+    if (!isCompressed(format))
+        return 0;
+
+    // BC1 and BC4 pack a block in 8 bytes, the others in 16
+    return (format == IMGFMT_DXT1 || format == IMGFMT_ATI1N) ? 8 : 16;
+}
+
 Image::Image() {
     _format = IMGFMT_UNKNOWN;
     _width  = 0;
@@ -93,7 +115,8 @@ Image::Image() {
     _depth  = 0;
     _numLevels = 0;
 
-    _data = nullptr;
+    _data   = nullptr;
+    _pixels = nullptr;
 }
 
 Image::~Image() {
@@ -104,6 +127,18 @@ Image::~Image() {
     _numLevels = 0;
 
     _data.reset();
+    _owner.reset();
+    _pixels = nullptr;
+}
+
+void Image::setData(std::unique_ptr<uint8[]> data) {
+    _data   = std::move(data);
+    _pixels = _data.get();
+    _owner.reset();
+}
+
+bool Image::ownsData() const {
+    return _owner == nullptr;
 }
 
 ImageFormat toFormat(uint32 numChannels, uint32 bytesPerChannel) {
@@ -117,7 +152,7 @@ void Image::init(ImageFormat format, uint32 width, uint32 height, uint32 depth,
     _depth     = depth;
     _numLevels = levels;
 
-    _data = std::make_unique<uint8[]>(totalSize());
+    setData(std::make_unique<uint8[]>(totalSize()));
 }
 
 uint32 Image::numLevels() const {
@@ -141,6 +176,9 @@ uint32 Image::size(uint32 level) const {
     uint32 h = mipDimension(_height, level);
     uint32 d = mipDimension(_depth,  level);
 
+    if (isCompressed(_format))
+        return ((w + 3) / 4) * ((h + 3) / 4) * d * formatToBlockSize(_format);
+
     uint32 nChannels    = numChannels();
     uint32 bytesChannel = formatToBytesPerChannel(_format);
 
@@ -208,9 +246,9 @@ bool Image::loadPNG(const std::string& filePath) {
     }
 
     uint32 size = totalSize();
-    _data = std::make_unique<uint8[]>(size);
+    setData(std::make_unique<uint8[]>(size));
 
-    memcpy(_data.get(), &image[0], size);
+    memcpy(_pixels, &image[0], size);
 
     return true;
 }
@@ -323,23 +361,40 @@ bool Image::loadIMG(const std::string& filePath) {
 
     init((ImageFormat)header.fmt, header.width, header.height, header.depth, header.levels);
 
-    uint8* imgData = new uint8[header.totalSize];
-
-    uint8* ptr = imgData;
-
-    for (uint32 lvl = 0; lvl < header.levels; ++lvl) {
-        uint32 sz = size(lvl);
-        file.read((char*)ptr, sz);
-        loadImage(ptr, lvl);
-        ptr += sz;
+    if (totalSize() != header.totalSize) {
+        file.close();
+        return false; // Warn
     }
 
+    // Levels are stored back to back like in memory, read them in place
+    file.read((char*)_pixels, header.totalSize);
     file.close();
 
-    delete[] imgData;
+    return true;
+}
+
+bool Image::mapImage(const std::string& filePath) {
+    PROFILE_ZONE("Image::mapImage");
+
+    sref<MappedFile> mapping = make_sref<MappedFile>();
+    if (!mapping->open(filePath) || mapping->size() < sizeof(IMGHeader))
+        return false;
+
+    IMGHeader header;
+    memcpy(&header, mapping->data(), sizeof(IMGHeader));
+
+    if (!(header.id[0] == 'I' && header.id[1] == 'M' &&
+          header.id[2] == 'G' && header.id[3] == ' '))
+        return false;
+
+    referImage((ImageFormat)header.fmt, header.width, header.height, header.depth,
+               mapping->data() + sizeof(IMGHeader), header.levels, mapping);
 
-    if (totalSize() != header.totalSize)
+    // Never point past the end of the file
+    if (totalSize() != header.totalSize || sizeof(IMGHeader) + header.totalSize > mapping->size()) {
+        init(IMGFMT_UNKNOWN, 0, 0, 0, 0);
         return false; // Warn
+    }
 
     return true;
 }
@@ -372,6 +427,8 @@ bool Image::saveIMG(const std::string& filePath) const {
 }
 
 bool Image::loadImage(const std::string& filePath) {
+    PROFILE_ZONE("Image::loadImage");
+
     filesystem::path path(filePath);
     if (!path.exists()) {
         // Log
@@ -401,16 +458,34 @@ bool Image::loadImage(ImageFormat format, uint32 width, uint32 height, uint32 de
 
     uint32 size = totalSize();
 
-    _data.reset();
-    _data = std::make_unique<uint8[]>(size);
+    setData(std::make_unique<uint8[]>(size));
 
-    memcpy(_data.get(), data, size);
+    memcpy(_pixels, data, size);
+
+    return true;
+}
+
+bool Image::referImage(ImageFormat format, uint32 width, uint32 height, uint32 depth, uint8* data, uint32 numLevels,
+                       const sref<void>& owner) {
+    if (data == nullptr || owner == nullptr)
+        return false;
+
+    _format = format;
+    _width  = width;
+    _height = height;
+    _depth  = depth;
+
+    _numLevels = numLevels;
+
+    _data.reset();
+    _pixels = data;
+    _owner  = owner;
 
     return true;
 }
 
 bool Image::loadImage(const uint8* data, uint32 lvl) {
-    if (_format == IMGFMT_UNKNOWN || _data == nullptr || 
+    if (_format == IMGFMT_UNKNOWN || _pixels == nullptr || 
         _width == 0 || lvl >= _numLevels)
         return false;
 
@@ -419,14 +494,14 @@ bool Image::loadImage(const uint8* data, uint32 lvl) {
         offset += size(l);
 
     uint32 sizeLvl = size(lvl);
-    uint8* start = (uint8*)_data.get() + offset;
+    uint8* start = _pixels + offset;
     memcpy((void*)start, data, sizeLvl);
 
     return true;
 }
 
 bool Image::saveImage(const std::string& filePath, uint32 lvl) const {
-    if (_data == nullptr || _width == 0 || lvl >= _numLevels)
+    if (_pixels == nullptr || _width == 0 || lvl >= _numLevels)
         return false;
 
     filesystem::path path(filePath);
@@ -493,7 +568,7 @@ bool Image::flipX() {
         uint8* src = nullptr;
 
         for (int32 y = 0; y < h; y++) {
-            src = ((uint8*)_data.get() + prevSize) + (y + 1) * w * offset;
+            src = (_pixels + prevSize) + (y + 1) * w * offset;
             for (int32 x = 0; x < w; x++) {
                 memcpy(dst, src, offset);
 
@@ -505,7 +580,7 @@ bool Image::flipX() {
         prevSize += size(lvl);
     }
 
-    _data.swap(newImg);
+    setData(std::move(newImg));
 
     return true;
 }
@@ -526,7 +601,7 @@ bool Image::flipY() {
         uint32 lineWidth = w * nChannels * bytesChannel;
 
         uint8* dst = newImg.get() + prevSize;
-        uint8* src = (_data.get() + prevSize) + (h - 1) * lineWidth;
+        uint8* src = (_pixels + prevSize) + (h - 1) * lineWidth;
 
         for (int32 y = 0; y < h; y++) {
             memcpy(dst, src, lineWidth);
@@ -538,7 +613,7 @@ bool Image::flipY() {
         prevSize += size(lvl);
     }
 
-    _data.swap(newImg);
+    setData(std::move(newImg));
 
     return true;
 }
@@ -573,7 +648,7 @@ bool Image::toGrayscale() {
 
         uint32 nPixels = w * h;
         if (_format <= IMGFMT_RGBA8) {
-            uint8* src  = _data.get()  + prevSize;
+            uint8* src  = _pixels + prevSize;
             uint8* dest = newImg.get() + prevSizeGray;
 
             do {
@@ -581,7 +656,7 @@ bool Image::toGrayscale() {
                 src += nChan;
             } while (--nPixels);
         } else {
-            uint16* src  = (uint16*)_data.get()  + (prevSize / 2);
+            uint16* src  = (uint16*)_pixels + (prevSize / 2);
             uint16* dest = (uint16*)newImg.get() + prevSizeGray;
 
             do {
@@ -599,7 +674,7 @@ bool Image::toGrayscale() {
     else 
         _format = IMGFMT_R16;
 
-    _data.swap(newImg);
+    setData(std::move(newImg));
 
     return true;
 }
@@ -628,7 +703,7 @@ bool Image::toneMap(float exp) {
 
         uint32 nPixels = w * h;
 
-        uint8* src = _data.get()  + prevSize;
+        uint8* src = _pixels + prevSize;
         uint8* dst = newImg.get() + prevSizeMapped;
 
         float* srcf = (float*)src;
@@ -651,7 +726,288 @@ bool Image::toneMap(float exp) {
 
     _format = IMGFMT_RGB8;
 
-    _data.swap(newImg);
+    setData(std::move(newImg));
+
+    return true;
+}
+
+/* ==============================================================================
+        Mipmap generation
+ ============================================================================== */
+// Support of the windowed sinc filters, in pixels of the smaller level
+static PBR_CONSTEXPR float MIP_SINC_RADIUS  = 3.0f;
+static PBR_CONSTEXPR float MIP_KAISER_ALPHA = 4.0f;
+
+struct MipTap {
+    uint32 src;
+    float  weight;
+};
+
+static float sinc(float x) {
+    if (std::abs(x) < 1e-5f)
+        return 1.0f;
+
+    x *= math::PI;
+    return std::sin(x) / x;
+}
+
+// Modified Bessel function of the first kind, order 0
+static float besselI0(float x) {
+    float sum  = 1.0f;
+    float term = 1.0f;
+    for (uint32 k = 1; k < 32 && term > sum * 1e-8f; ++k) {
+        float t = x / (2.0f * k);
+        term *= t * t;
+        sum  += term;
+    }
+    return sum;
+}
+
+static float mipKernel(MipmapFilter filter, float x) {
+    x = std::abs(x);
+    if (filter == MIPFILTER_BOX)
+        return x < 0.5f ? 1.0f : 0.0f;
+
+    if (x >= MIP_SINC_RADIUS)
+        return 0.0f;
+
+    if (filter == MIPFILTER_LANCZOS)
+        return sinc(x) * sinc(x / MIP_SINC_RADIUS);
+
+    float t = x / MIP_SINC_RADIUS;
+    return sinc(x) * besselI0(MIP_KAISER_ALPHA * std::sqrt(1.0f - t * t)) / besselI0(MIP_KAISER_ALPHA);
+}
+
+// Same number of taps for every destination pixel, weights are normalized
+static uint32 mipTaps(MipmapFilter filter, uint32 srcDim, uint32 dstDim, vec<MipTap>& taps) {
+    float scale  = (float)srcDim / dstDim;
+    float radius = (filter == MIPFILTER_BOX ? 0.5f : MIP_SINC_RADIUS) * scale;
+
+    uint32 numTaps = (uint32)std::ceil(2.0f * radius) + 1;
+    taps.resize(dstDim * numTaps);
+
+    for (uint32 x = 0; x < dstDim; ++x) {
+        float center = (x + 0.5f) * scale;
+        int32 first  = (int32)std::floor(center - radius);
+
+        MipTap* tap = &taps[x * numTaps];
+        float   sum = 0.0f;
+        for (uint32 t = 0; t < numTaps; ++t) {
+            int32 i = first + (int32)t;
+            tap[t].src    = (uint32)(((i % (int32)srcDim) + srcDim) % srcDim);
+            tap[t].weight = mipKernel(filter, (i + 0.5f - center) / scale);
+            sum += tap[t].weight;
+        }
+
+        for (uint32 t = 0; t < numTaps; ++t)
+            tap[t].weight /= sum;
+    }
+
+    return numTaps;
+}
+
+// Weighted sum of RGBA float pixels, stride is the distance between two taps in floats
+static void filterPixel(const float* src, size_t stride, const MipTap* taps, uint32 numTaps, float* dst) {
+#ifdef PBR_SSE2
+    __m128 sum = _mm_setzero_ps();
+    for (uint32 t = 0; t < numTaps; ++t)
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + taps[t].src * stride), _mm_set1_ps(taps[t].weight)));
+    _mm_storeu_ps(dst, sum);
+#else
+    float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (uint32 t = 0; t < numTaps; ++t)
+        for (uint32 c = 0; c < 4; ++c)
+            sum[c] += src[taps[t].src * stride + c] * taps[t].weight;
+    memcpy(dst, sum, sizeof(sum));
+#endif
+}
+
+static float srgbToLinear(float c) {
+    return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float linearToSRGB(float c) {
+    return (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+bool Image::generateMipmaps(MipmapFilter filter, MipmapContent content) {
+    bool unorm8  = _format >= IMGFMT_R8    && _format <= IMGFMT_RGBA8;
+    bool unorm16 = _format >= IMGFMT_R16   && _format <= IMGFMT_RGBA16;
+    bool float32 = _format >= IMGFMT_R32F  && _format <= IMGFMT_RGBA32F;
+    if (_pixels == nullptr || _depth > 1 || !(unorm8 || unorm16 || float32))
+        return false;
+
+    uint32 levels = 1;
+    while (((uint32)std::max(_width, _height) >> levels) > 0)
+        ++levels;
+
+    if (levels == 1)
+        return false;
+
+    PROFILE_ZONE("Image::generateMipmaps");
+
+    uint32 nChan = numChannels();
+
+    // Alpha is never converted, gray and alpha images keep it in the second channel
+    uint32 srgbChannels = 0;
+    if (content == MIPMAP_SRGB && !float32)
+        srgbChannels = (nChan == 2 || nChan == 4) ? nChan - 1 : nChan;
+    bool normals = content == MIPMAP_NORMAL && nChan >= 3;
+
+    float srgbTable[256];
+    for (uint32 i = 0; i < 256; ++i)
+        srgbTable[i] = srgbToLinear(i / 255.0f);
+
+    // Levels are kept as RGBA floats until they are written
+    uint32 w = _width;
+    uint32 h = _height;
+    vec<float> src((size_t)w * h * 4, 0.0f);
+
+    const uint8* base = _pixels;
+    Workers.parallelFor(h, [&](uint32 y) {
+        for (uint32 x = 0; x < w; ++x) {
+            size_t pixel = (size_t)y * w + x;
+            float* dst   = &src[pixel * 4];
+            for (uint32 c = 0; c < nChan; ++c) {
+                if (float32)
+                    dst[c] = ((const float*)base)[pixel * nChan + c];
+                else if (unorm16)
+                    dst[c] = ((const uint16*)base)[pixel * nChan + c] / 65535.0f;
+                else if (c < srgbChannels)
+                    dst[c] = srgbTable[base[pixel * nChan + c]];
+                else
+                    dst[c] = base[pixel * nChan + c] / 255.0f;
+            }
+        }
+    });
+
+    uint32 level0 = size(0);
+    uint32 numLevels = _numLevels;
+    _numLevels = levels;
+    std::unique_ptr<uint8[]> chain = std::make_unique<uint8[]>(totalSize());
+    memcpy(chain.get(), _pixels, level0);
+    _numLevels = numLevels;
+
+    vec<MipTap> tapsX, tapsY;
+    vec<float>  rows, dst;
+
+    uint8* out = chain.get() + level0;
+    for (uint32 lvl = 1; lvl < levels; ++lvl) {
+        uint32 dw = mipDimension(_width,  lvl);
+        uint32 dh = mipDimension(_height, lvl);
+
+        uint32 numX = mipTaps(filter, w, dw, tapsX);
+        uint32 numY = mipTaps(filter, h, dh, tapsY);
+
+        // Horizontal pass over every source row, then vertical pass
+        rows.resize((size_t)dw * h * 4);
+        Workers.parallelFor(h, [&](uint32 y) {
+            for (uint32 x = 0; x < dw; ++x)
+                filterPixel(&src[(size_t)y * w * 4], 4, &tapsX[x * numX], numX, &rows[((size_t)y * dw + x) * 4]);
+        });
+
+        dst.resize((size_t)dw * dh * 4);
+        Workers.parallelFor(dh, [&](uint32 y) {
+            for (uint32 x = 0; x < dw; ++x) {
+                float* pixel = &dst[((size_t)y * dw + x) * 4];
+                filterPixel(&rows[(size_t)x * 4], (size_t)dw * 4, &tapsY[y * numY], numY, pixel);
+
+                if (normals) {
+                    float n[3] = { pixel[0] * 2.0f - 1.0f, pixel[1] * 2.0f - 1.0f, pixel[2] * 2.0f - 1.0f };
+                    float len  = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    if (len > 1e-6f)
+                        for (uint32 c = 0; c < 3; ++c)
+                            pixel[c] = n[c] / len * 0.5f + 0.5f;
+                }
+
+                size_t index = (size_t)y * dw + x;
+                for (uint32 c = 0; c < nChan; ++c) {
+                    if (float32) {
+                        ((float*)out)[index * nChan + c] = pixel[c];
+                        continue;
+                    }
+
+                    float val = std::max(0.0f, std::min(pixel[c], 1.0f));
+                    if (unorm16)
+                        ((uint16*)out)[index * nChan + c] = (uint16)(val * 65535.0f + 0.5f);
+                    else
+                        out[index * nChan + c] = (uint8)((c < srgbChannels ? linearToSRGB(val) : val) * 255.0f + 0.5f);
+                }
+            }
+        });
+
+        out += size(lvl);
+        src.swap(dst);
+        w = dw;
+        h = dh;
+    }
+
+    _numLevels = levels;
+    setData(std::move(chain));
+
+    return true;
+}
+
+bool Image::compress(ImageFormat format) {
+    // Only 8-bit unsigned 2D images
+    if (!isCompressed(format) || _pixels == nullptr || _depth > 1 ||
+        _format < IMGFMT_R8 || _format > IMGFMT_RGBA8)
+        return false;
+
+    PROFILE_ZONE("Image::compress");
+
+    uint32 nChan = numChannels();
+
+    ImageFormat srcFormat = _format;
+    _format = format;
+    std::unique_ptr<uint8[]> blocks = std::make_unique<uint8[]>(totalSize());
+    _format = srcFormat;
+
+    // One task per row of blocks of every level
+    struct BlockRow {
+        uint32 level;
+        uint32 y;
+        uint32 offset;
+    };
+
+    vec<BlockRow> rows;
+    uint32 offset    = 0;
+    uint32 blockSize = formatToBlockSize(format);
+    for (uint32 lvl = 0; lvl < _numLevels; ++lvl) {
+        uint32 blocksX = (mipDimension(_width,  lvl) + 3) / 4;
+        uint32 blocksY = (mipDimension(_height, lvl) + 3) / 4;
+        for (uint32 y = 0; y < blocksY; ++y) {
+            rows.push_back({ lvl, y, offset });
+            offset += blocksX * blockSize;
+        }
+    }
+
+    Workers.parallelFor((uint32)rows.size(), [&](uint32 r) {
+        const BlockRow& row = rows[r];
+        uint32 w = mipDimension(_width,  row.level);
+        uint32 h = mipDimension(_height, row.level);
+        const uint8* src = data(row.level);
+        uint8* dst = blocks.get() + row.offset;
+
+        uint8 rgba[64];
+        for (uint32 bx = 0; bx < (w + 3) / 4; ++bx) {
+            // Edges repeat the last row and column, channels missing from the image sample as 0 and alpha as 1
+            for (uint32 p = 0; p < 16; ++p) {
+                uint32 x = std::min(bx * 4 + (p & 3), w - 1);
+                uint32 y = std::min(row.y * 4 + (p >> 2), h - 1);
+
+                const uint8* pixel = src + (y * w + x) * nChan;
+                for (uint32 c = 0; c < 4; ++c)
+                    rgba[4 * p + c] = (c < nChan) ? pixel[c] : (c == 3 ? 255 : 0);
+            }
+
+            encodeBlock(format, rgba, dst);
+            dst += blockSize;
+        }
+    });
+
+    _format = format;
+    setData(std::move(blocks));
 
     return true;
 }
@@ -673,7 +1029,7 @@ int32 Image::depth() const {
 }
 
 uint8* Image::data(uint32 lvl) const {
-    if (_data == nullptr || lvl >= _numLevels)
+    if (_pixels == nullptr || lvl >= _numLevels)
         return nullptr;
 
     // Compute offset to image level
@@ -681,7 +1037,7 @@ uint8* Image::data(uint32 lvl) const {
     for (uint32 l = 0; l < lvl; ++l)
         offset += size(l);
 
-    uint8* start = _data.get() + offset;
+    uint8* start = _pixels + offset;
 
     return start;
 }
@@ -706,6 +1062,10 @@ void Cubemap::init(ImageFormat format, uint32 width, uint32 height, uint32 numLe
 }
 
 bool Cubemap::loadCubemap(const std::string& filePath) {
+    return loadCubemap(filePath, nullptr);
+}
+
+bool Cubemap::loadCubemap(const std::string& filePath, const LevelReady& onLevel) {
     filesystem::path path(filePath);
     if (!path.exists()) {
         // Log
@@ -714,11 +1074,19 @@ bool Cubemap::loadCubemap(const std::string& filePath) {
 
     std::string ext = path.extension();
     if (ext == "cube")
-        return loadCUBE(filePath);
+        return loadCUBE(filePath, false, onLevel);
 
     return false;
 }
 
+bool Cubemap::mapCubemap(const std::string& filePath, const LevelReady& onLevel) {
+    filesystem::path path(filePath);
+    if (path.extension() != "cube")
+        return false;
+
+    return loadCUBE(filePath, true, onLevel);
+}
+
 bool Cubemap::loadCubemap(const std::string paths[6]) {
     for (uint32 i = 0; i < 6; ++i)
         if (!_faces[i].loadImage(paths[i]))
@@ -812,117 +1180,333 @@ Image* Cubemap::face(CubemapFace face) {
     return &_faces[face];
 }
 
-bool Cubemap::loadCUBE(const std::string& filePath) {
-    CUBEHeader header;
+/* ==============================================================================
+        CUBE files
+ ============================================================================== */
+// Chunks of a file in the order of the levels, v1 files hold every level in a single chunk
+struct CUBELayout {
+    ImageFormat    format;
+    uint32         width;
+    uint32         height;
+    uint32         levels;
+    uint32         totalSize;
+    vec<CUBEChunk> chunks;
+};
+
+// Only float channels are shuffled, their exponent bytes compress much better grouped together
+static uint32 shuffleSize(ImageFormat format) {
+    if (format < IMGFMT_R16F || format > IMGFMT_RGBA32F)
+        return 0;
+
+    return formatToBytesPerChannel(format);
+}
 
-    std::ifstream file(filePath, std::ios::in | std::ios::binary);
-    
-    // Read header
-    file.read((char*)&header, sizeof(CUBEHeader));
+// Byte b of every element goes to plane b
+static void shuffleBytes(const uint8* src, uint8* dst, size_t size, uint32 elemSize) {
+    size_t count = size / elemSize;
+    for (size_t i = 0; i < count; ++i)
+        for (uint32 b = 0; b < elemSize; ++b)
+            dst[b * count + i] = src[i * elemSize + b];
+}
 
-    // Validate file signature
-    if (!(header.id[0] == 'C' && header.id[1] == 'U' &&
-          header.id[2] == 'B' && header.id[3] == 'E')) {
-        file.close();
+static void unshuffleBytes(const uint8* src, uint8* dst, size_t size, uint32 elemSize) {
+    size_t count = size / elemSize;
+    for (uint32 b = 0; b < elemSize; ++b)
+        for (size_t i = 0; i < count; ++i)
+            dst[i * elemSize + b] = src[b * count + i];
+}
+
+// Chunks zlib shrinks by less than an eighth are stored, mapped files use them in place
+static bool worthCompressing(uLong compSize, uint32 size) {
+    return compSize <= size - size / 8;
+}
+
+static bool readLayout(const MappedFile& file, CUBELayout& layout) {
+    const uint8* bytes = file.data();
+    size_t fileSize    = file.size();
+
+    if (fileSize >= sizeof(CUBE2Header) && memcmp(bytes, "CUB2", 4) == 0) {
+        CUBE2Header header;
+        memcpy(&header, bytes, sizeof(CUBE2Header));
+
+        size_t numChunks = (size_t)header.levels * 6;
+        if (sizeof(CUBE2Header) + numChunks * sizeof(CUBEChunk) > fileSize)
+            return false;
+
+        layout.format    = (ImageFormat)header.fmt;
+        layout.width     = header.width;
+        layout.height    = header.height;
+        layout.levels    = header.levels;
+        layout.totalSize = header.totalSize;
+        layout.chunks.resize(numChunks);
+        memcpy(layout.chunks.data(), bytes + sizeof(CUBE2Header), numChunks * sizeof(CUBEChunk));
+    } else if (fileSize >= sizeof(CUBEHeader) && memcmp(bytes, "CUBE", 4) == 0) {
+        CUBEHeader header;
+        memcpy(&header, bytes, sizeof(CUBEHeader));
+
+        // Version 1 compresses the whole file as one stream, or stores it
+        layout.format    = (ImageFormat)header.fmt;
+        layout.width     = header.width;
+        layout.height    = header.height;
+        layout.levels    = header.levels;
+        layout.totalSize = header.totalSize;
+        layout.chunks.push_back({ (uint32)sizeof(CUBEHeader), header.totalSize, header.compSize, CUBEFILTER_NONE });
+    } else {
         return false;
     }
 
-    uint8* imgData = new uint8[header.totalSize];
+    if (layout.format == IMGFMT_UNKNOWN || layout.format > IMGFMT_BC7 || layout.levels == 0)
+        return false;
 
-    // Check if file is compressed
-    if (header.totalSize != header.compSize) {
-        uint8* srcBuffer = new uint8[header.compSize];
-        file.read((char*)srcBuffer, header.compSize);
-        file.close();
+    // Chunks must lie inside the file and add up to the levels
+    uint64 total = 0;
+    for (const CUBEChunk& chunk : layout.chunks) {
+        if ((uint64)chunk.offset + chunk.compSize > fileSize || chunk.filter > CUBEFILTER_SHUFFLE)
+            return false;
+        if (chunk.filter == CUBEFILTER_SHUFFLE && shuffleSize(layout.format) == 0)
+            return false;
+
+        total += chunk.size;
+    }
 
-        uLong dstLen = header.totalSize;
-        uLong srcLen = header.compSize;
-        int result = uncompress(imgData, &dstLen, srcBuffer, srcLen);
+    return total == layout.totalSize;
+}
 
-        if (result != Z_OK) {
-            delete[] srcBuffer;
-            delete[] imgData;
+// Every chunk stored unfiltered and right after the previous one, the levels are laid out like in memory
+static bool storedInPlace(const CUBELayout& layout) {
+    uint64 offset = layout.chunks[0].offset;
+    for (const CUBEChunk& chunk : layout.chunks) {
+        if (chunk.compSize != chunk.size || chunk.filter != CUBEFILTER_NONE || chunk.offset != offset)
             return false;
-        }
 
-        delete[] srcBuffer;
+        offset += chunk.size;
+    }
+
+    return true;
+}
+
+// Inflates a chunk to dst and reverts its filter
+static bool decodeChunk(const CUBEChunk& chunk, const uint8* src, uint8* dst, uint32 elemSize) {
+    PROFILE_ZONE("Cubemap::decodeChunk");
+
+    std::unique_ptr<uint8[]> shuffled;
+    uint8* out = dst;
+    if (chunk.filter == CUBEFILTER_SHUFFLE) {
+        shuffled = std::make_unique<uint8[]>(chunk.size);
+        out = shuffled.get();
+    }
+
+    if (chunk.compSize == chunk.size) {
+        memcpy(out, src, chunk.size);
     } else {
-        // Else read it directly from the file
-        file.read((char*)imgData, header.totalSize);
-        file.close();
+        uLong dstLen = chunk.size;
+        if (uncompress(out, &dstLen, src, chunk.compSize) != Z_OK || dstLen != chunk.size)
+            return false;
     }
 
-    // Initialize the image
-    init((ImageFormat)header.fmt, header.width, header.height, header.levels);
+    if (shuffled)
+        unshuffleBytes(out, dst, chunk.size, elemSize);
 
-    uint8* ptr = imgData;
-    for (uint32 f = 0; f < 6; ++f) {
-        for (uint32 lvl = 0; lvl < header.levels; ++lvl) {            
-            uint32 size = _faces[f].size(lvl);
-            //file.read((char*)ptr, size);
-            _faces[f].loadImage(ptr, lvl);
-            ptr += size;
+    return true;
+}
+
+bool Cubemap::loadCUBE(const std::string& filePath, bool map, const LevelReady& onLevel) {
+    PROFILE_ZONE("Cubemap::loadCUBE");
+
+    // Chunks are decoded straight from the mapped file
+    sref<MappedFile> file = make_sref<MappedFile>();
+    CUBELayout layout;
+    if (!file->open(filePath) || !readLayout(*file, layout))
+        return false;
+
+    uint32 numChunks      = (uint32)layout.chunks.size();
+    uint32 levelsPerChunk = 6 * layout.levels / numChunks;
+
+    auto chunkReady = [&](uint32 c) {
+        if (!onLevel)
+            return;
+
+        for (uint32 l = c * levelsPerChunk; l < (c + 1) * levelsPerChunk; ++l)
+            onLevel((CubemapFace)(l / layout.levels), l % layout.levels);
+    };
+
+    if (map && storedInPlace(layout)) {
+        if (!referFaces(layout.format, layout.width, layout.height, layout.levels, layout.totalSize,
+                        file->data() + layout.chunks[0].offset, file))
+            return false;
+
+        for (uint32 c = 0; c < numChunks; ++c)
+            chunkReady(c);
+
+        return true;
+    }
+
+    // The faces share the buffer the chunks are decoded to
+    sref<uint8> imgData(new uint8[layout.totalSize], std::default_delete<uint8[]>());
+    if (!referFaces(layout.format, layout.width, layout.height, layout.levels, layout.totalSize,
+                    imgData.get(), imgData))
+        return false;
+
+    // Every chunk has to hold whole levels
+    vec<uint8*> dst(numChunks);
+    uint8* ptr = imgData.get();
+    for (uint32 c = 0; c < numChunks; ++c) {
+        uint32 size = 0;
+        for (uint32 l = c * levelsPerChunk; l < (c + 1) * levelsPerChunk; ++l)
+            size += _faces[l / layout.levels].size(l % layout.levels);
+
+        if (size != layout.chunks[c].size) {
+            for (uint32 f = 0; f < 6; ++f)
+                _faces[f].init(IMGFMT_UNKNOWN, 0, 0, 0, 0);
+            return false; // Warn
+        }
+
+        dst[c] = ptr;
+        ptr += size;
+    }
+
+    // Chunks are decoded on the worker threads, the calling thread hands the finished ones to onLevel meanwhile
+    struct Decode {
+        std::mutex              mutex;
+        std::condition_variable cond;
+        std::deque<uint32>      done;
+        vec<uint8>              ok;
+    };
+
+    sref<Decode> decode = make_sref<Decode>();
+    decode->ok.resize(numChunks, false);
+
+    uint32 handled = 0;
+    auto consume = [&](bool wait) {
+        std::unique_lock<std::mutex> lock(decode->mutex);
+        while (handled < numChunks) {
+            if (decode->done.empty() && !wait)
+                return;
+            decode->cond.wait(lock, [&decode]() { return !decode->done.empty(); });
+
+            uint32 c = decode->done.front();
+            decode->done.pop_front();
+            bool ok = decode->ok[c] != 0;
+
+            lock.unlock();
+            if (ok)
+                chunkReady(c);
+            ++handled;
+            lock.lock();
+        }
+    };
+
+    uint32 elemSize = shuffleSize(layout.format);
+    for (uint32 c = 0; c < numChunks; ++c) {
+        CUBEChunk chunk  = layout.chunks[c];
+        const uint8* src = file->data() + chunk.offset;
+        uint8* out       = dst[c];
+
+        Workers.submit([decode, file, chunk, src, out, elemSize, c]() {
+            bool ok = decodeChunk(chunk, src, out, elemSize);
+
+            std::lock_guard<std::mutex> lock(decode->mutex);
+            decode->ok[c] = ok;
+            decode->done.push_back(c);
+            decode->cond.notify_one();
+        });
+
+        // Without workers the chunk is already decoded, its upload goes before the next one
+        consume(false);
+    }
+    consume(true);
+
+    for (uint32 c = 0; c < numChunks; ++c) {
+        if (!decode->ok[c]) {
+            for (uint32 f = 0; f < 6; ++f)
+                _faces[f].init(IMGFMT_UNKNOWN, 0, 0, 0, 0);
+            return false; // Warn
         }
     }
 
-    //file.close();
+    return true;
+}
 
-    delete[] imgData;
+bool Cubemap::referFaces(ImageFormat format, uint32 width, uint32 height, uint32 numLevels, uint32 totalSize,
+                         uint8* data, const sref<void>& owner) {
+    uint8* ptr = data;
+    for (uint32 f = 0; f < 6; ++f) {
+        _faces[f].referImage(format, width, height, 1, ptr, numLevels, owner);
+        ptr += _faces[f].totalSize();
+    }
 
-    if (totalSize() != header.totalSize)
+    // Never point past the end of the data
+    if (this->totalSize() != totalSize) {
+        for (uint32 f = 0; f < 6; ++f)
+            _faces[f].init(IMGFMT_UNKNOWN, 0, 0, 0, 0);
         return false; // Warn
+    }
 
     return true;
 }
 
 bool Cubemap::saveCUBE(const std::string& filePath) const {
-    CUBEHeader header;
+    PROFILE_ZONE("Cubemap::saveCUBE");
+
+    uint32 levels    = numLevels();
+    uint32 numChunks = 6 * levels;
+    uint32 elemSize  = shuffleSize(format());
+
+    // Chunks are filtered and compressed on the worker threads, the ones not worth it are stored
+    vec<CUBEChunk> chunks(numChunks);
+    vec<std::unique_ptr<uint8[]>> encoded(numChunks);
+    Workers.parallelFor(numChunks, [&](uint32 c) {
+        const Image& face = _faces[c / levels];
+        uint32 lvl = c % levels;
+        uint32 size = face.size(lvl);
+        const uint8* src = face.data(lvl);
+
+        std::unique_ptr<uint8[]> shuffled;
+        if (elemSize > 1) {
+            shuffled = std::make_unique<uint8[]>(size);
+            shuffleBytes(src, shuffled.get(), size, elemSize);
+        }
+
+        uLong dstLen = compressBound(size);
+        std::unique_ptr<uint8[]> dst = std::make_unique<uint8[]>(dstLen);
+        int result = ::compress(dst.get(), &dstLen, shuffled ? shuffled.get() : src, size);
+
+        chunks[c] = { 0, size, size, CUBEFILTER_NONE };
+        if (result == Z_OK && worthCompressing(dstLen, size)) {
+            chunks[c].compSize = (uint32)dstLen;
+            chunks[c].filter   = shuffled ? CUBEFILTER_SHUFFLE : CUBEFILTER_NONE;
+            encoded[c] = std::move(dst);
+        }
+    });
+
+    CUBE2Header header;
     header.id[0] = 'C';
     header.id[1] = 'U';
     header.id[2] = 'B';
-    header.id[3] = 'E';
+    header.id[3] = '2';
     header.fmt    = format();
     header.width  = width();
     header.height = height();
-    header.levels = numLevels();
+    header.levels = levels;
     header.totalSize = totalSize();
-    header.compSize  = header.totalSize;
-
-    // Copy image data into contiguous buffer
-    uint8* imgData = new uint8[header.totalSize];
-    uint8* auxPtr  = imgData;
-    for (uint32 f = 0; f < 6; ++f) {
-        for (uint32 lvl = 0; lvl < header.levels; ++lvl) {
-            size_t size = _faces[f].size(lvl);
-            memcpy(auxPtr, (const char*)_faces[f].data(lvl), size);
-            auxPtr += size;
-        }
-    }
-
-    // Compress buffer with zlib
-    uLong  dstLen    = compressBound(header.totalSize);
-    uint8* dstBuffer = new uint8[dstLen];
-    int result = compress(dstBuffer, &dstLen, imgData, header.totalSize);
 
-    if (result != Z_OK) {
-        delete[] dstBuffer;
-        delete[] imgData;
-        return false;
+    // Chunk data follows the table
+    uint32 offset = sizeof(CUBE2Header) + numChunks * sizeof(CUBEChunk);
+    for (CUBEChunk& chunk : chunks) {
+        chunk.offset = offset;
+        offset += chunk.compSize;
     }
 
-    // Store the compressed size
-    header.compSize = dstLen;
-
     // Write to file
     std::ofstream file(filePath, std::ios::out | std::ios::binary);
-    file.write((const char*)&header, sizeof(CUBEHeader));
-    file.write((const char*)dstBuffer, dstLen);
+    file.write((const char*)&header, sizeof(CUBE2Header));
+    file.write((const char*)chunks.data(), numChunks * sizeof(CUBEChunk));
+    for (uint32 c = 0; c < numChunks; ++c) {
+        const uint8* data = encoded[c] ? encoded[c].get() : _faces[c / levels].data(c % levels);
+        file.write((const char*)data, chunks[c].compSize);
+    }
     file.close();
 
-    // Release memory
-    delete[] imgData;
-    delete[] dstBuffer;
-
     return true;
 }
 
@@ -4,6 +4,8 @@
 #include <PBR.h>
 #include <PBRMath.h>
 
+#include <functional>
+
 namespace pbr {
 
     enum ImageType : uint32 {
@@ -108,11 +110,28 @@ namespace pbr {
         IMGFMT_BC7   = 56
     };
 
+    enum MipmapFilter : uint32 {
+        MIPFILTER_BOX     = 0,
+        MIPFILTER_KAISER  = 1,
+        MIPFILTER_LANCZOS = 2
+    };
+
+    // What the pixels hold, changes how the levels are filtered
+    enum MipmapContent : uint32 {
+        MIPMAP_LINEAR = 0,
+        MIPMAP_SRGB   = 1,   // Filtered in linear space, alpha excluded
+        MIPMAP_NORMAL = 2    // Tangent space normals in RGB, renormalized after filtering
+    };
+
     uint32 formatToNumChannels(ImageFormat format);
     uint32 formatToBytesPerChannel(ImageFormat format);
     ImageComponent formatToImgComp(ImageFormat format);
     uint32 mipDimension(uint32 baseDim, uint32 level);
 
+    // Compressed formats are stored in 4x4 blocks, levels are padded to whole blocks
+    bool   isCompressed(ImageFormat format);
+    uint32 formatToBlockSize(ImageFormat format);
+
     class Image {
     public:
         Image();
@@ -129,6 +148,17 @@ namespace pbr {
         // Loads a mipmap level from memory
         bool loadImage(const uint8* data, uint32 lvl);
 
+        // Uses the levels in place instead of copying them, owner keeps the memory alive as long as the image needs it
+        // Operations rebuilding the levels move the image to memory of its own
+        bool referImage(ImageFormat format, uint32 width, uint32 height, uint32 depth, uint8* data, uint32 numLevels,
+                        const sref<void>& owner);
+
+        // Maps an .img file, levels are read from the mapped pages and uploads read from them directly
+        bool mapImage(const std::string& filePath);
+
+        // False while the pixels belong to a mapping or another image
+        bool ownsData() const;
+
         bool saveImage (const std::string& filePath, uint32 lvl = 0) const;
         bool saveMipMap(const std::string& filePath) const;
 
@@ -149,6 +179,15 @@ namespace pbr {
         bool flipY();
         bool toGrayscale();
         bool toneMap(float exposure = 1.0f);
+
+        // Replaces the levels below level 0 by a full chain down to 1x1, rows are filtered on the worker threads
+        // Each level is filtered from the previous one in float, addressing wraps like the default sampler
+        // 8 and 16-bit unsigned and 32-bit float 2D images only
+        bool generateMipmaps(MipmapFilter filter = MIPFILTER_KAISER, MipmapContent content = MIPMAP_LINEAR);
+
+        // Encodes every level to a block compressed format, blocks are encoded on the worker threads
+        // Only 8-bit unsigned 2D images, BC7 is encoded with mode 6 alone
+        bool compress(ImageFormat format);
         
         uint32 size(uint32 lvl = 0) const;
         uint32 totalSize()   const;
@@ -163,6 +202,9 @@ namespace pbr {
         bool savePNG  (const std::string& filePath, uint32 lvl = 0) const;
         bool saveEXR  (const std::string& filePath, uint32 lvl = 0) const;
 
+        // Takes the new pixels and drops any external memory
+        void setData(std::unique_ptr<uint8[]> data);
+
         ImageFormat _format;
         int32  _width;
         int32  _height;
@@ -170,6 +212,8 @@ namespace pbr {
         uint32 _numLevels;
 
         std::unique_ptr<uint8[]> _data;
+        uint8*                   _pixels;   // _data or memory held by _owner
+        sref<void>               _owner;
     };
 
     enum CubemapFace : uint32 {
@@ -183,15 +227,24 @@ namespace pbr {
 
     class Cubemap {
     public:
+        // Called on the loading thread once the level of a face holds its data
+        typedef std::function<void(CubemapFace face, uint32 lvl)> LevelReady;
+
         Cubemap();
 
         void init(ImageFormat format, uint32 width, uint32 height, uint32 numLevels = 1);
 
         bool loadCubemap(const std::string& filePath);
+        // Chunks of v2 files are decoded on the worker threads while onLevel consumes the levels already done,
+        // uploads can start before the whole file is decoded. Levels may come in any order
+        bool loadCubemap(const std::string& filePath, const LevelReady& onLevel);
         bool loadCubemap(const std::string paths[6]);
         bool loadCubemap(ImageFormat format, uint32 width, uint32 height, const uint8* data, uint32 numLevels = 1);
         bool loadFace   (CubemapFace face, const uint8* data, uint32 lvl);
 
+        // Maps a .cube file, the faces share the mapping. Compressed files are loaded instead
+        bool mapCubemap(const std::string& filePath, const LevelReady& onLevel = nullptr);
+
         bool saveCubemap(const std::string& filePath);
 
         uint8* data(CubemapFace face, uint32 lvl = 0) const;
@@ -215,7 +268,11 @@ namespace pbr {
         uint32 numLevels() const;
 
     private:
-        bool loadCUBE(const std::string& filePath);
+        // Reads v1 and v2 files, stored levels are used in place when mapping
+        bool loadCUBE(const std::string& filePath, bool map, const LevelReady& onLevel);
+        // Faces use the levels stored face after face in data
+        bool referFaces(ImageFormat format, uint32 width, uint32 height, uint32 numLevels, uint32 totalSize,
+                        uint8* data, const sref<void>& owner);
         bool saveCUBE(const std::string& filePath) const;
 
         Image _faces[6];
@@ -242,6 +299,29 @@ namespace pbr {
         uint32 levels;
     }; // 28 Bytes
 
+    // Version 2 of the .cube format, every level of every face is a chunk of its own so they can be
+    // encoded and decoded in parallel. The header is followed by the table of chunks, face after face
+    struct CUBE2Header {
+        char id[4];       // "CUB2"
+        uint32 fmt;
+        uint32 width;
+        uint32 height;
+        uint32 levels;
+        uint32 totalSize;
+    }; // 24 Bytes
+
+    enum CUBEFilter : uint32 {
+        CUBEFILTER_NONE    = 0,
+        CUBEFILTER_SHUFFLE = 1    // Bytes grouped by their position in the channel, floats compress better
+    };
+
+    struct CUBEChunk {
+        uint32 offset;    // From the start of the file
+        uint32 size;
+        uint32 compSize;  // Equal to size when the chunk is stored
+        uint32 filter;    // CUBEFilter, applied before compression
+    }; // 16 Bytes
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include <MappedFile.h>
+
+#ifdef PBR_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace pbr;
+
+#ifdef PBR_WINDOWS
+MappedFile::MappedFile() : _data(nullptr), _size(0), _file(INVALID_HANDLE_VALUE), _mapping(nullptr) { }
+#else
+MappedFile::MappedFile() : _data(nullptr), _size(0) { }
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef PBR_WINDOWS
+bool MappedFile::open(const std::string& filePath) {
+    close();
+
+    _file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(_file, &fileSize) || fileSize.QuadPart == 0) {
+        close();
+        return false;
+    }
+
+    // Copy on write, the view is writable but the file is not
+    _mapping = CreateFileMappingA(_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if (_mapping == nullptr) {
+        close();
+        return false;
+    }
+
+    _data = (uint8*)MapViewOfFile(_mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (_data == nullptr) {
+        close();
+        return false;
+    }
+
+    _size = (size_t)fileSize.QuadPart;
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data != nullptr)
+        UnmapViewOfFile(_data);
+    if (_mapping != nullptr)
+        CloseHandle(_mapping);
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+
+    _data    = nullptr;
+    _size    = 0;
+    _mapping = nullptr;
+    _file    = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::open(const std::string& filePath) {
+    close();
+
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // Copy on write, the view is writable but the file is not. The mapping outlives the descriptor
+    void* view = mmap(nullptr, (size_t)sb.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (view == MAP_FAILED)
+        return false;
+
+    _data = (uint8*)view;
+    _size = (size_t)sb.st_size;
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (_data != nullptr)
+        munmap(_data, _size);
+
+    _data = nullptr;
+    _size = 0;
+}
+#endif
+
+bool MappedFile::isOpen() const {
+    return _data != nullptr;
+}
+
+uint8* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
@@ -0,0 +1,38 @@
+#ifndef __PBR_MAPPEDFILE_H__
+#define __PBR_MAPPEDFILE_H__
+
+#include <PBR.h>
+
+namespace pbr {
+
+    // Whole file mapped into memory, pages are read from disk when first touched
+    // The mapping is private, writes copy the touched pages and never reach the file
+    class PBR_SHARED MappedFile {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Fails on missing or empty files
+        bool open(const std::string& filePath);
+        void close();
+
+        bool   isOpen() const;
+        uint8* data()   const;
+        size_t size()   const;
+
+    private:
+        uint8* _data;
+        size_t _size;
+
+#ifdef PBR_WINDOWS
+        void* _file;
+        void* _mapping;
+#endif
+    };
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include <Profiler.h>
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+using namespace pbr;
+
+// Buffer of the calling thread, created on its first zone
+static thread_local ProfileBuffer* localBuffer = nullptr;
+static thread_local const char*    localName   = nullptr;
+
+// Event copied out of a buffer while its thread may be recording
+struct TraceEvent {
+    const char* name;
+    uint64      begin;
+    uint64      end;
+};
+
+static uint64 clockNs() {
+    using namespace std::chrono;
+    return (uint64)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+CPUProfiler::CPUProfiler() : _enabled(false) {
+    // Keep zone timestamps non zero, zero marks a zone started while disabled
+    _start = clockNs() - 1;
+}
+
+CPUProfiler::~CPUProfiler() {
+    for (ProfileBuffer* buffer : _buffers)
+        delete buffer;
+}
+
+CPUProfiler& CPUProfiler::get() {
+    static CPUProfiler _inst;
+    return _inst;
+}
+
+void CPUProfiler::setEnabled(bool state) {
+    _enabled.store(state, std::memory_order_relaxed);
+}
+
+bool CPUProfiler::enabled() const {
+    return _enabled.load(std::memory_order_relaxed);
+}
+
+void CPUProfiler::setThreadName(const char* name) {
+    localName = name;
+
+    if (localBuffer)
+        localBuffer->threadName.store(name, std::memory_order_relaxed);
+}
+
+uint64 CPUProfiler::now() const {
+    return clockNs() - _start;
+}
+
+ProfileBuffer* CPUProfiler::threadBuffer() {
+    if (localBuffer)
+        return localBuffer;
+
+    // Only taken once per thread
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    localBuffer = new ProfileBuffer();
+    localBuffer->head       = 0;
+    localBuffer->threadId   = (uint32)_buffers.size();
+    localBuffer->threadName = localName;
+    _buffers.push_back(localBuffer);
+
+    return localBuffer;
+}
+
+void CPUProfiler::addEvent(const char* name, uint64 begin, uint64 end) {
+    ProfileBuffer* buffer = threadBuffer();
+
+    uint64 head = buffer->head.load(std::memory_order_relaxed);
+
+    // Keeps the stores below after the previous publish, writeTrace relies on it to find overwritten slots
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ProfileEvent& event = buffer->events[head % PROFILE_BUFFER_SIZE];
+    event.name.store(name, std::memory_order_relaxed);
+    event.begin.store(begin, std::memory_order_relaxed);
+    event.end.store(end, std::memory_order_relaxed);
+
+    // Publish the event after its data
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool CPUProfiler::writeTrace(const std::string& filePath) const {
+    std::ofstream out(filePath);
+    if (!out)
+        return false;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Chrome trace_event format, complete events with times in microseconds
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[" << std::endl;
+
+    bool first = true;
+    vec<TraceEvent> events(PROFILE_BUFFER_SIZE);
+    for (const ProfileBuffer* buffer : _buffers) {
+        const char* threadName = buffer->threadName.load(std::memory_order_relaxed);
+        if (threadName) {
+            out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId
+                << ",\"args\":{\"name\":\"" << threadName << "\"}}";
+            first = false;
+        }
+
+        // Copy the events first, the thread may still be recording
+        uint64 head  = buffer->head.load(std::memory_order_acquire);
+        uint64 count = head < PROFILE_BUFFER_SIZE ? head : PROFILE_BUFFER_SIZE;
+
+        for (uint64 e = head - count; e < head; ++e) {
+            const ProfileEvent& event = buffer->events[e % PROFILE_BUFFER_SIZE];
+            events[e % PROFILE_BUFFER_SIZE].name  = event.name.load(std::memory_order_relaxed);
+            events[e % PROFILE_BUFFER_SIZE].begin = event.begin.load(std::memory_order_relaxed);
+            events[e % PROFILE_BUFFER_SIZE].end   = event.end.load(std::memory_order_relaxed);
+        }
+
+        // The slot of the event being written and those written since the copy started may hold newer events, drop them
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64 written = buffer->head.load(std::memory_order_relaxed);
+        uint64 oldest  = head - count;
+        if (written - oldest >= PROFILE_BUFFER_SIZE)
+            oldest = written - PROFILE_BUFFER_SIZE + 1;
+
+        for (uint64 e = oldest; e < head; ++e) {
+            const TraceEvent& event = events[e % PROFILE_BUFFER_SIZE];
+
+            out << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId
+                << ",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+            first = false;
+        }
+    }
+
+    out << std::endl << "]}" << std::endl;
+
+    return true;
+}
@@ -0,0 +1,97 @@
+#ifndef __PBR_PROFILER_H__
+#define __PBR_PROFILER_H__
+
+#include <atomic>
+#include <mutex>
+
+#include <PBR.h>
+
+// Times the enclosing scope on the calling thread, see CPUProfiler
+// Builds with PBR_NO_PROFILE compile the zones out
+#ifdef PBR_NO_PROFILE
+#define PROFILE_ZONE(name)
+#else
+#define PROFILE_CONCAT_INNER(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) pbr::ProfileZone PROFILE_CONCAT(_profileZone, __LINE__)(name)
+#endif
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    // Number of zones kept per thread, older zones are overwritten
+    static PBR_CONSTEXPR uint32 PROFILE_BUFFER_SIZE = 64 * 1024;
+
+    // Relaxed atomics, writeTrace may read a slot while its thread overwrites it
+    struct ProfileEvent {
+        std::atomic<const char*> name;
+        std::atomic<uint64>      begin;  // ns since the profiler started
+        std::atomic<uint64>      end;
+    };
+
+    // Ring of finished zones, written only by its thread
+    // head counts the events written, it is published with a release store after each event
+    struct ProfileBuffer {
+        ProfileEvent events[PROFILE_BUFFER_SIZE];
+        std::atomic<uint64> head;
+        uint32      threadId;
+        std::atomic<const char*> threadName;
+    };
+
+    // Collects CPU zones from every thread and exports them as a Chrome trace (chrome://tracing, Perfetto)
+    // Recording is off by default, disabled zones cost a single flag check
+    class PBR_SHARED CPUProfiler {
+    public:
+        ~CPUProfiler();
+
+        static CPUProfiler& get();
+
+        void setEnabled(bool state);
+        bool enabled() const;
+
+        // Shown in the trace instead of the thread number
+        // Only stored until the thread records its first zone, threads that never do take no buffer
+        void setThreadName(const char* name);
+
+        // Writes the zones recorded so far, safe while other threads still record
+        // Zones overwritten during the export are left out
+        bool writeTrace(const std::string& filePath) const;
+
+        uint64 now() const;
+        void addEvent(const char* name, uint64 begin, uint64 end);
+
+    private:
+        CPUProfiler();
+
+        ProfileBuffer* threadBuffer();
+
+        std::atomic<bool> _enabled;
+        uint64 _start;
+
+        mutable std::mutex _mutex;
+        vec<ProfileBuffer*> _buffers;
+    };
+
+    class ProfileZone {
+    public:
+        ProfileZone(const char* name) : _name(name), _begin(0) {
+            CPUProfiler& profiler = CPUProfiler::get();
+            if (profiler.enabled())
+                _begin = profiler.now();
+        }
+
+        ~ProfileZone() {
+            if (_begin != 0)
+                CPUProfiler::get().addEvent(_name, _begin, CPUProfiler::get().now());
+        }
+
+    private:
+        const char* _name;
+        uint64      _begin;
+    };
+
+}
+
+#endif
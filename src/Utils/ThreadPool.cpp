@@ -0,0 +1,119 @@
+#include <ThreadPool.h>
+
+#include <atomic>
+
+#include <Profiler.h>
+
+using namespace pbr;
+
+ThreadPool::ThreadPool() : _stop(false) {
+    // The calling thread also runs tasks, keep one core for it
+    uint32 numCores   = std::thread::hardware_concurrency();
+    uint32 numWorkers = numCores > 1 ? numCores - 1 : 0;
+
+    for (uint32 t = 0; t < numWorkers; ++t)
+        _threads.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_all();
+
+    for (std::thread& thread : _threads)
+        thread.join();
+}
+
+ThreadPool& ThreadPool::get() {
+    static ThreadPool _inst;
+    return _inst;
+}
+
+uint32 ThreadPool::numThreads() const {
+    return (uint32)_threads.size() + 1;
+}
+
+void ThreadPool::parallelFor(uint32 count, const std::function<void(uint32)>& task) {
+    if (count == 0)
+        return;
+
+    // Nothing to gain from the workers
+    if (_threads.empty() || count == 1) {
+        for (uint32 i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    std::atomic<uint32> remaining(count);
+    std::mutex doneMutex;
+    std::condition_variable doneCond;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (uint32 i = 0; i < count; ++i) {
+            _tasks.emplace_back([&, i]() {
+                task(i);
+
+                // Decrement under the lock so the waiter cannot leave (and destroy
+                // the locals) between the last decrement and the notify
+                std::lock_guard<std::mutex> doneLock(doneMutex);
+                if (--remaining == 0)
+                    doneCond.notify_all();
+            });
+        }
+    }
+    _cond.notify_all();
+
+    // Help with the queue instead of sleeping
+    Task next;
+    while (remaining > 0 && popTask(next))
+        next();
+
+    std::unique_lock<std::mutex> doneLock(doneMutex);
+    doneCond.wait(doneLock, [&remaining]() { return remaining == 0; });
+}
+
+void ThreadPool::submit(const Task& task) {
+    if (_threads.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _tasks.push_back(task);
+    }
+    _cond.notify_one();
+}
+
+bool ThreadPool::popTask(Task& task) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_tasks.empty())
+        return false;
+
+    task = std::move(_tasks.front());
+    _tasks.pop_front();
+    return true;
+}
+
+void ThreadPool::workerLoop() {
+    CPUProfiler::get().setThreadName("Worker");
+
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+
+            if (_stop && _tasks.empty())
+                return;
+
+            task = std::move(_tasks.front());
+            _tasks.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef __PBR_THREADPOOL_H__
+#define __PBR_THREADPOOL_H__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+#include <PBR.h>
+
+// Macro to syntax sugar the singleton getter
+#define Workers ThreadPool::get()
+
+namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
+    // Fixed set of worker threads for CPU side engine work
+    // Nothing submitted here may call into the RHI, GL stays on the main thread
+    class PBR_SHARED ThreadPool {
+    public:
+        typedef std::function<void()> Task;
+
+        ~ThreadPool();
+
+        static ThreadPool& get();
+
+        // Workers plus the calling thread, which helps while waiting
+        uint32 numThreads() const;
+
+        // Runs task(i) for every i in [0, count) and returns when all of them finished
+        void parallelFor(uint32 count, const std::function<void(uint32)>& task);
+
+        // Queues the task and returns right away, the caller tracks its completion
+        // Runs it on the calling thread when there are no workers
+        void submit(const Task& task);
+
+    private:
+        ThreadPool();
+
+        void workerLoop();
+        bool popTask(Task& task);
+
+        vec<std::thread> _threads;
+        std::deque<Task> _tasks;
+
+        std::mutex _mutex;
+        std::condition_variable _cond;
+        bool _stop;
+    };
+
+}
+
+#endif
@@ -5,6 +5,14 @@
 #include <Mesh.h>
 #include <LoadXML.h>
 #include <PBRMaterial.h>
+#include <Profiler.h>
+#include <ThreadPool.h>
+#include <TextureStreamer.h>
+#include <Resources.h>
+
+#include <path.h>
+#include <sstream>
+#include <sys/stat.h>
 
 using namespace pbr;
 
@@ -32,6 +40,8 @@ void Utils::throwError(const std::string& error) {
 }
 
 sref<Shape> Utils::loadSceneObject(const std::string& folder) {
+    PROFILE_ZONE("Utils::loadSceneObject");
+
     sref<Shape> obj = make_sref<Mesh>("Objects/" + folder + "/" + folder + ".obj");
 
     LoadXML loader("Objects/" + folder + "/material.xml");
@@ -43,29 +53,232 @@ sref<Shape> Utils::loadSceneObject(const std::string& folder) {
     return obj;
 }
 
+// Prepared copy next to the source, Objects/Name/albedo.png loaded as sRGB is cached as
+// Objects/Name/albedo_png_srgb_mips_bc7.img. The extension keeps albedo.png and albedo.tga apart,
+// the content keeps levels filtered for one use from being loaded for another
+static std::string preparedPath(const std::string& path, ImageFormat fmt, MipmapContent content) {
+    static const char* suffixes[] = { "_bc1", "_bc2", "_bc3", "_bc4", "_bc5", "_bc7" };
+    static const char* contents[] = { "_linear", "_srgb", "_normal" };
+
+    filesystem::path file(path);
+    std::string parent = file.parent_path().str();
+    if (!parent.empty())
+        parent += "/";
+
+    std::string name = file.filenameNoExt();
+    std::string ext  = file.extension();
+    if (!ext.empty())
+        name += "_" + ext;
+
+    return parent + name + contents[content] + "_mips" + (isCompressed(fmt) ? suffixes[fmt - IMGFMT_DXT1] : "") + ".img";
+}
+
+// FNV-1a over the description and the pixels, 8 bytes at a time to keep up with large images
+static uint64 hashImage(const Image& img) {
+    uint64 hash = 14695981039346656037ULL;
+    auto mix = [&hash](uint64 val) {
+        hash ^= val;
+        hash *= 1099511628211ULL;
+    };
+
+    mix(img.format());
+    mix(img.width());
+    mix(img.height());
+    mix(img.depth());
+    mix(img.numLevels());
+
+    const uint8* data = img.data();
+    size_t size  = img.totalSize();
+    size_t words = size / 8;
+    for (size_t w = 0; w < words; ++w) {
+        uint64 val;
+        memcpy(&val, data + w * 8, 8);
+        mix(val);
+    }
+    for (size_t b = words * 8; b < size; ++b)
+        mix(data[b]);
+
+    return hash;
+}
+
+// Last modification time, 0 when the file does not exist
+static int64 modifiedTime(const std::string& filePath) {
+    struct stat sb;
+    if (stat(filePath.c_str(), &sb) != 0)
+        return 0;
+
+    return (int64)sb.st_mtime;
+}
+
+// Uses the cached copy unless the source changed since, images that cannot be mipmapped or compressed are kept as is
+// The cached copy is mapped rather than read, its levels are uploaded from the file pages
+static bool prepareTexture(Image& img, const Utils::TextureLoad& load, ImageFormat fmt) {
+    std::string cached = preparedPath(load.path, fmt, load.content);
+
+    int64 cachedTime = modifiedTime(cached);
+    if (cachedTime != 0 && cachedTime >= modifiedTime(load.path) && img.mapImage(cached) &&
+        (fmt == IMGFMT_UNKNOWN || img.format() == fmt))
+        return true;
+
+    if (!img.loadImage(load.path))
+        return false;
+
+    bool changed = false;
+    if (!img.hasMipMap())
+        changed |= img.generateMipmaps(MIPFILTER_KAISER, load.content);
+    if (fmt != IMGFMT_UNKNOWN)
+        changed |= img.compress(fmt);
+
+    if (changed && !img.saveImage(cached))
+        std::cerr << "[WARNING] Could not cache prepared texture " << cached << std::endl;
+
+    return true;
+}
+
 RRID Utils::loadTexture(const std::string& path) {
-    Image image;
-    TexSampler texSampler;
+    TextureLoad load = { path, IMGFMT_UNKNOWN, MIPMAP_LINEAR };
+    return loadTextures(vec<TextureLoad>(1, load))[0];
+}
+
+vec<RRID> Utils::loadTextures(const vec<TextureLoad>& loads) {
+    PROFILE_ZONE("Utils::loadTextures");
+
+    uint32 count = (uint32)loads.size();
+
+    // Formats the driver cannot sample are left uncompressed
+    vec<ImageFormat> targets(count, IMGFMT_UNKNOWN);
+    for (uint32 t = 0; t < count; ++t)
+        if (RHI.supportsCompressedFormat(loads[t].format))
+            targets[t] = loads[t].format;
+
+    vec<sref<Image>>   images(count);
+    vec<RRID>          textures(count, -1);
+    vec<std::string>   keys(count);
+    vec<uint64>        hashes(count, 0);
+    vec<StagingRegion> regions(count);
+    vec<uint8>         created(count, false);
+    vec<uint8>         staged(count, false);
+    vec<uint8>         streamed(count, false);
+
+    // Files already loaded the same way are shared
+    for (uint32 t = 0; t < count; ++t) {
+        std::ostringstream variant;
+        variant << targets[t] << "/" << loads[t].content;
+
+        keys[t]     = Resources::textureKey(loads[t].path, variant.str());
+        textures[t] = Resource.acquireTexture(keys[t]);
+    }
+
+    // Levels and blocks of each image are processed in parallel too
+    Workers.parallelFor(count, [&](uint32 t) {
+        if (textures[t] != -1)
+            return;
+
+        images[t] = make_sref<Image>();
+        if (prepareTexture(*images[t], loads[t], targets[t]))
+            hashes[t] = hashImage(*images[t]);
+    });
+
+    // Storage and staging memory come from the GL thread
+    for (uint32 t = 0; t < count; ++t) {
+        if (textures[t] != -1)
+            continue;
+
+        const Image& img = *images[t];
+        if (img.format() == IMGFMT_UNKNOWN) {
+            std::cerr << "[ERROR] Could not load texture " << loads[t].path << std::endl;
+            continue;
+        }
+
+        // Copy of a file loaded before, or loaded twice in this batch
+        textures[t] = Resource.acquireTexture(hashes[t], keys[t], img);
+        if (textures[t] != -1) {
+            images[t].reset();
+            continue;
+        }
 
-    image.loadImage(path);
+        TexSampler texSampler(WRAP_REPEAT, WRAP_REPEAT, img.hasMipMap() ? FILTER_LINEAR_MIP_LINEAR : FILTER_LINEAR, FILTER_LINEAR);
 
-    RRID rrid = RHI.createTexture(image, texSampler);
+        // Mipmapped textures only get their small levels now, the rest is streamed in when needed
+        if (TextureStreamer::streamable(img)) {
+            textures[t] = Streamer.addTexture(images[t], texSampler);
+            streamed[t] = true;
+        } else {
+            textures[t] = RHI.createTexture(img.type(), img.format(), img.width(), img.height(), img.depth(),
+                                            texSampler, img.numLevels());
+            created[t]  = textures[t] != -1;
+            staged[t]   = created[t] && RHI.allocStaging(img.totalSize(), regions[t]);
+        }
 
-    return rrid;
+        if (textures[t] != -1)
+            Resource.addCachedTexture(keys[t], hashes[t], textures[t], images[t]);
+    }
+
+    Workers.parallelFor(count, [&](uint32 t) {
+        if (staged[t])
+            memcpy(regions[t].ptr, images[t]->data(), images[t]->totalSize());
+    });
+
+    // Textures that did not fit in staging memory are uploaded from the image
+    for (uint32 t = 0; t < count; ++t) {
+        if (!created[t])
+            continue;
+
+        const Image& img = *images[t];
+
+        size_t offset = 0;
+        for (uint32 lvl = 0; lvl < img.numLevels(); ++lvl) {
+            if (staged[t])
+                RHI.uploadTexture(textures[t], 0, lvl, regions[t], offset);
+            else
+                RHI.setTextureData(textures[t], lvl, img.data(lvl));
+
+            offset += img.size(lvl);
+        }
+    }
+    RHI.submitStaging();
+
+    return textures;
 }
 
 sref<Material> Utils::buildMaterial(const std::string& path, const ParameterMap& map) {
     sref<PBRMaterial> mat = make_sref<PBRMaterial>();
 
+    // Textures of the material are loaded together
+    bool diffuseTex   = !map.hasRGB("diffuse")     && map.hasTexture("diffuse");
+    bool normalTex    = map.hasTexture("normal");
+    bool roughnessTex = !map.hasFloat("roughness") && map.hasTexture("roughness");
+    bool metallicTex  = !map.hasFloat("metallic")  && map.hasTexture("metallic");
+
+    // BC7 keeps the quality of albedo, normals only store x and y (the shader rebuilds z)
+    // and roughness and metallic have a single channel
+    vec<TextureLoad> loads;
+    if (diffuseTex)
+        loads.push_back({ path + "/" + map.getTexture("diffuse"),   IMGFMT_BC7,   MIPMAP_SRGB });
+    if (normalTex)
+        loads.push_back({ path + "/" + map.getTexture("normal"),    IMGFMT_ATI2N, MIPMAP_NORMAL });
+    if (roughnessTex)
+        loads.push_back({ path + "/" + map.getTexture("roughness"), IMGFMT_ATI1N, MIPMAP_LINEAR });
+    if (metallicTex)
+        loads.push_back({ path + "/" + map.getTexture("metallic"),  IMGFMT_ATI1N, MIPMAP_LINEAR });
+
+    vec<RRID> textures = loadTextures(loads);
+    uint32 next = 0;
+
+    // Each texture came with a cache reference, the material gives it back when destroyed
+    for (RRID tex : textures)
+        if (tex != -1)
+            mat->holdTexture(tex);
+
     if (map.hasRGB("diffuse"))
         mat->setDiffuse(Color(map.getRGB("diffuse")));
-    else if (map.hasTexture("diffuse"))
-        mat->setDiffuse(loadTexture(path + "/" + map.getTexture("diffuse")));
+    else if (diffuseTex)
+        mat->setDiffuse(textures[next++]);
     else
         mat->setDiffuse(Color(0.5f, 0.5f, 0.5f));
 
-    if (map.hasTexture("normal"))
-        mat->setNormal(loadTexture(path + "/" + map.getTexture("normal")));
+    if (normalTex)
+        mat->setNormal(textures[next++]);
 
     if (map.hasRGB("specular"))
         mat->setSpecular(Color(map.getRGB("specular")));
@@ -74,15 +287,15 @@ sref<Material> Utils::buildMaterial(const std::string& path, const ParameterMap&
 
     if (map.hasFloat("roughness"))
         mat->setRoughness(map.getFloat("roughness"));
-    else if (map.hasTexture("roughness"))
-        mat->setRoughness(loadTexture(path + "/" + map.getTexture("roughness")));
+    else if (roughnessTex)
+        mat->setRoughness(textures[next++]);
     else
         mat->setRoughness(0.2f);
 
     if (map.hasFloat("metallic"))
         mat->setMetallic(map.getFloat("metallic"));
-    else if (map.hasTexture("metallic"))
-        mat->setMetallic(loadTexture(path + "/" + map.getTexture("metallic")));
+    else if (metallicTex)
+        mat->setMetallic(textures[next++]);
     else
         mat->setMetallic(0.5f);
 
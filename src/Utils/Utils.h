@@ -5,16 +5,32 @@
 #include <fstream>
 
 #include <PBR.h>
+#include <Image.h>
 #include <Shape.h>
 #include <ParameterMap.h>
 
 namespace pbr {
+
+    template<class T>
+    using vec = std::vector<T>;
+
     namespace Utils {
         bool readFile  (const std::string& filePath, std::ios_base::openmode mode, std::string& str);
         void throwError(const std::string& error);
 
         sref<Shape> loadSceneObject(const std::string& folder);
+        // How a texture file is prepared for the GPU, the result is cached next to the file as .img
+        struct TextureLoad {
+            std::string   path;
+            ImageFormat   format;    // Block compressed format, IMGFMT_UNKNOWN keeps the format of the file
+            MipmapContent content;   // Levels missing from the file are generated for this content
+        };
+
         RRID loadTexture(const std::string& path);
+        // Decodes, mipmaps and compresses on the worker threads then uploads through staging memory
+        // Textures come from the Resources cache when possible, every id returned holds a reference to release
+        // -1 for files that could not be read
+        vec<RRID> loadTextures(const vec<TextureLoad>& loads);
         sref<Material> buildMaterial(const std::string& path, const ParameterMap& map);
     }
 }
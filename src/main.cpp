@@ -1,10 +1,27 @@
+#ifndef PBR_NULL_RHI
+
 #include <PBRApp.h>
 #include <Resources.h>
+#include <Profiler.h>
+#include <Shader.h>
+#include <TextureStreamer.h>
 
 using namespace pbr;
 
 PBRApp* app;
 
+// Chrome trace written on exit, empty when tracing is off
+std::string traceFile;
+
+void writeTrace() {
+    if (traceFile.empty())
+        return;
+
+    CPUProfiler::get().setEnabled(false);
+    if (CPUProfiler::get().writeTrace(traceFile))
+        std::cout << "[INFO] CPU trace written to " << traceFile << std::endl;
+}
+
 void display() {
     app->render();
 }
@@ -23,34 +40,125 @@ void timer(int value) {
 }
 
 void cleanup() {
+    app->stopUpdateThread();
     app->cleanup();
     delete app;
+
+    writeTrace();
 }
 
+// Input is read by the update thread in pipelined mode
 void mouseMotion(int x, int y) {
+    std::lock_guard<std::mutex> lock(app->stateMutex());
     app->processMouseMotion(x, y);
 }
 
 void mouseMotionPassive(int x, int y) {
+    std::lock_guard<std::mutex> lock(app->stateMutex());
     app->updateMouse(x, y);
 }
 
 void keyPress(unsigned char key, int x, int y) {
+    std::lock_guard<std::mutex> lock(app->stateMutex());
     app->processKeyPress(key, x, y);
 }
 
 void keyUp(unsigned char key, int x, int y) {
+    std::lock_guard<std::mutex> lock(app->stateMutex());
     app->processKeyUp(key, x, y);
 }
 
 void mouseClick(int button, int state, int x, int y) {
+    std::lock_guard<std::mutex> lock(app->stateMutex());
     app->processMouseClick(button, state, x, y);
 }
 
 int main(int argc, char* argv[]) {
     app = new PBRApp("PBR Demo", 1920, 1080);
 
+    // --pipelined: update on its own thread while the previous frame renders
+    // --headless N [--out prefix]: render N frames offscreen and save them as images
+    // --benchmark path.xml [--frames N] [--warmup N] [--json file]: replay a camera path and
+    //   write frame time statistics, offscreen when combined with --headless
+    // --trace file.json: record CPU zones and write them as a Chrome trace on exit
+    // --shader-files: read shaders from Shaders/ instead of the sources embedded at build time
+    // --texture-budget MB: GPU memory for streamed texture levels
+    int headlessFrames = 0;
+    std::string outPrefix = "frame_";
+
+    BenchmarkSettings benchmark;
+    benchmark.outFile      = "benchmark.json";
+    benchmark.numFrames    = 1000;
+    benchmark.warmupFrames = 60;
+
+    for (int a = 1; a < argc; ++a) {
+        std::string arg(argv[a]);
+        if (arg == "--pipelined")
+            app->setPipelined(true);
+        else if (arg == "--headless" && a + 1 < argc)
+            headlessFrames = std::atoi(argv[++a]);
+        else if (arg == "--out" && a + 1 < argc)
+            outPrefix = argv[++a];
+        else if (arg == "--benchmark" && a + 1 < argc)
+            benchmark.pathFile = argv[++a];
+        else if (arg == "--frames" && a + 1 < argc)
+            benchmark.numFrames = std::atoi(argv[++a]);
+        else if (arg == "--warmup" && a + 1 < argc)
+            benchmark.warmupFrames = std::atoi(argv[++a]);
+        else if (arg == "--json" && a + 1 < argc)
+            benchmark.outFile = argv[++a];
+        else if (arg == "--trace" && a + 1 < argc)
+            traceFile = argv[++a];
+        else if (arg == "--shader-files")
+            ShaderSource::setFileOverride(true);
+        else if (arg == "--texture-budget" && a + 1 < argc)
+            Streamer.setBudget((size_t)std::atoi(argv[++a]) * 1024 * 1024);
+    }
+
+    if (!traceFile.empty()) {
+        CPUProfiler::get().setThreadName("Main");
+        CPUProfiler::get().setEnabled(true);
+    }
+
+    bool runBenchmark = !benchmark.pathFile.empty();
+
+    if (headlessFrames > 0) {
+#ifdef PBR_HEADLESS
+        if (!app->initHeadless()) {
+            std::cerr << "ERROR: Could not create a headless context." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        bool success = true;
+        if (runBenchmark)
+            success = app->runBenchmark(benchmark);
+        else
+            app->runHeadless(headlessFrames, outPrefix);
+
+        app->cleanup();
+        delete app;
+
+        writeTrace();
+        exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+#else
+        std::cerr << "ERROR: Headless mode needs a build with PBR_HEADLESS." << std::endl;
+        exit(EXIT_FAILURE);
+#endif
+    }
+
     app->init(argc, argv);
+
+    if (runBenchmark) {
+        app->setReshapeCallback(reshape);
+
+        bool success = app->runBenchmark(benchmark);
+        app->cleanup();
+        delete app;
+
+        writeTrace();
+        exit(success ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     app->setReshapeCallback(reshape);
     app->setDisplayCallback(display);
     app->setIdleCallback(idle);
@@ -65,4 +173,114 @@ int main(int argc, char* argv[]) {
     app->loop();
 
     exit(EXIT_SUCCESS);
-}
\ No newline at end of file
+}
+
+#else
+
+#include <RenderInterface.h>
+#include <Renderer.h>
+#include <Resources.h>
+
+#include <Scene.h>
+#include <Mesh.h>
+#include <Geometry.h>
+#include <Perspective.h>
+#include <PBRMaterial.h>
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+using namespace pbr;
+
+// Times the renderer CPU work on the null RHI backend, no window or GL context is created
+// Usage: PBRDemo [numObjects] [numFrames]
+static void benchmark(Renderer& renderer, const Scene& scene, const Camera& camera,
+                      const std::string& name, int numFrames) {
+    // Warm up, first frames create the arena and fill the material buffer
+    for (int f = 0; f < 3; ++f)
+        renderer.render(scene, camera);
+
+    RHI.resetCounters();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int f = 0; f < numFrames; ++f)
+        renderer.render(scene, camera);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count() / numFrames;
+
+    const NullRHICounters& c = RHI.counters();
+    std::cout << std::left << std::setw(12) << name << std::right << std::fixed << std::setprecision(3)
+              << std::setw(10) << ms << " ms/frame"
+              << std::setw(10) << c.calls / numFrames << " calls"
+              << std::setw(10) << c.draws / numFrames << " draws"
+              << std::setw(8)  << c.programBinds / numFrames << " programs"
+              << std::setw(8)  << c.bufferBinds / numFrames << " buffers";
+
+    if (c.invalidCalls > 0)
+        std::cout << "  (" << c.invalidCalls / numFrames << " invalid)";
+
+    std::cout << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int numObjects   = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int numFrames    = argc > 2 ? std::atoi(argv[2]) : 100;
+    int numMaterials = 16;
+
+    RHI.initialize();
+
+    Renderer renderer;
+    renderer.prepare();
+    renderer.setSkyboxDraw(false);
+
+    // One shared sphere in a grid of objects, cycling through a few materials
+    sref<Geometry> sphere = make_sref<Geometry>();
+    genSphereGeometry(*sphere, 0.5f, 16, 16);
+
+    vec<sref<Material>> materials;
+    for (int m = 0; m < numMaterials; ++m) {
+        sref<PBRMaterial> mat = make_sref<PBRMaterial>();
+        mat->setDiffuse(Color(m / (float)numMaterials));
+        mat->setMetallic(0.0f);
+        mat->setRoughness(0.5f);
+        materials.push_back(mat);
+    }
+
+    Scene scene;
+    int side = (int)std::ceil(std::sqrt((float)numObjects));
+    for (int o = 0; o < numObjects; ++o) {
+        sref<Mesh> mesh = make_sref<Mesh>(sphere);
+        mesh->setPosition(Vec3((float)(o % side), 0.0f, (float)(o / side)));
+        mesh->updateMatrix();
+        mesh->setMaterial(materials[o % numMaterials]);
+        mesh->_prog = -1;
+        mesh->prepare();
+        scene.addShape(mesh);
+    }
+
+    sref<Camera> camera = make_sref<Perspective>(1920, 1080, Vec3(-3, 3, -3),
+                                                 Vec3(0, 0, 0), Vec3(0, 1, 0), 0.1f, 500.0f, 60.0f);
+    scene.addCamera(camera);
+
+    std::cout << "[INFO] Null RHI benchmark, " << numObjects << " objects, "
+              << numFrames << " frames per mode" << std::endl;
+
+    renderer.setInstancing(false);
+    benchmark(renderer, scene, *camera, "immediate", numFrames);
+
+    renderer.setInstancing(true);
+    benchmark(renderer, scene, *camera, "instanced", numFrames);
+
+    renderer.setThreadedRecording(true);
+    benchmark(renderer, scene, *camera, "threaded", numFrames);
+    renderer.setThreadedRecording(false);
+
+    renderer.setIndirectDraws(true);
+    benchmark(renderer, scene, *camera, "indirect", numFrames);
+
+    exit(EXIT_SUCCESS);
+}
+
+#endif
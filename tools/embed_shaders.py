@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# Embeds the engine shaders into the binary
+#   usage: embed_shaders.py <shader folder> <output .inl>
+#
+# Includes (#include "file") are resolved and comments stripped, newlines are kept
+# so compile errors still point at the lines of the original file.
+# Each shader gets a 64 bit FNV-1a hash of its final text, the program binary cache
+# uses it as key without reading or hashing any file at runtime.
+# The output is only rewritten when it changes, so unchanged shaders don't trigger a rebuild.
+
+import os
+import re
+import sys
+
+EXTENSIONS  = ('.vs', '.fs', '.gs', '.cs')
+INCLUDE     = re.compile(r'^\s*#\s*include\s+"([^"]+)"')
+CHUNK_SIZE  = 4000    # MSVC rejects single string literals over 16K
+DELIMITER   = 'PBR_SHADER'
+
+
+def fnv1a(data):
+    h = 14695981039346656037
+    for b in data:
+        h ^= b
+        h = (h * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+def strip_comments(text):
+    out = []
+    i, n = 0, len(text)
+    while i < n:
+        if text.startswith('//', i):
+            end = text.find('\n', i)
+            i = n if end < 0 else end
+        elif text.startswith('/*', i):
+            end = text.find('*/', i + 2)
+            end = n if end < 0 else end + 2
+            out.append('\n' * text.count('\n', i, end))
+            i = end
+        else:
+            out.append(text[i])
+            i += 1
+
+    # Trailing spaces left where comments were
+    return '\n'.join(line.rstrip() for line in ''.join(out).split('\n'))
+
+
+def resolve(folder, name, stack):
+    if name in stack:
+        sys.exit('embed_shaders: include cycle ' + ' -> '.join(stack + [name]))
+
+    with open(os.path.join(folder, name), encoding='utf-8') as f:
+        text = f.read().replace('\r\n', '\n')
+
+    lines = []
+    for line in text.split('\n'):
+        match = INCLUDE.match(line)
+        if match:
+            lines.append(resolve(folder, match.group(1), stack + [name]).rstrip('\n'))
+        else:
+            lines.append(line)
+
+    return '\n'.join(lines)
+
+
+def literal(text):
+    chunks = [text[i:i + CHUNK_SIZE] for i in range(0, len(text), CHUNK_SIZE)] or ['']
+    return '\n'.join('        R"%s(%s)%s"' % (DELIMITER, chunk, DELIMITER) for chunk in chunks)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: embed_shaders.py <shader folder> <output .inl>')
+
+    folder, output = sys.argv[1], sys.argv[2]
+    names = sorted(f for f in os.listdir(folder) if f.endswith(EXTENSIONS))
+
+    out = ['// Generated by tools/embed_shaders.py from data/Shaders, do not edit',
+           '',
+           'static PBR_CONSTEXPR EmbeddedShader EMBEDDED_SHADERS[] = {']
+
+    for name in names:
+        source = strip_comments(resolve(folder, name, []))
+        if ')' + DELIMITER + '"' in source:
+            sys.exit('embed_shaders: %s contains the literal delimiter' % name)
+
+        out.append('    { "%s", 0x%016xULL,' % (name, fnv1a(source.encode('utf-8'))))
+        out.append(literal(source) + ' },')
+
+    out.append('};')
+    out.append('')
+    text = '\n'.join(out)
+
+    if os.path.exists(output):
+        with open(output, encoding='utf-8') as f:
+            if f.read() == text:
+                return
+
+    with open(output, 'w', encoding='utf-8', newline='\n') as f:
+        f.write(text)
+
+    print('embed_shaders: wrote %d shaders to %s' % (len(names), output))
+
+
+if __name__ == '__main__':
+    main()